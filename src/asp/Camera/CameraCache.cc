@@ -0,0 +1,467 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CameraCache.cc
+///
+
+#include <asp/Camera/CameraCache.h>
+#include <asp/Camera/RPCModel.h>
+#include <asp/Camera/SPOT_XML.h>
+#include <asp/Camera/ASTER_XML.h>
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/cstdint.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <list>
+#include <unistd.h>
+
+using namespace vw;
+namespace fs = boost::filesystem;
+
+namespace {
+
+  const char   CACHE_MAGIC[] = "ASPCAMC";
+  const size_t CACHE_MAGIC_LEN = 7;
+
+  // Guard against allocating huge amounts of memory for a corrupted file
+  const boost::uint64_t MAX_CACHE_ELEMENTS = 100000000;
+
+  // Binary writing and reading of the types that make up the cached
+  // cameras. The reading functions leave the stream in a failed state
+  // on error.
+
+  void write_binary(std::ostream & os, double val){ os.write((char const*)&val, sizeof(val)); }
+  void read_binary(std::istream & is, double & val){ is.read((char*)&val, sizeof(val)); }
+
+  void write_binary(std::ostream & os, boost::int64_t val){ os.write((char const*)&val, sizeof(val)); }
+  void read_binary(std::istream & is, boost::int64_t & val){ is.read((char*)&val, sizeof(val)); }
+
+  void write_binary(std::ostream & os, int val){
+    boost::int32_t v = val;
+    os.write((char const*)&v, sizeof(v));
+  }
+  void read_binary(std::istream & is, int & val){
+    boost::int32_t v = 0;
+    is.read((char*)&v, sizeof(v));
+    val = v;
+  }
+
+  void write_size(std::ostream & os, size_t size){
+    boost::uint64_t v = size;
+    os.write((char const*)&v, sizeof(v));
+  }
+  bool read_size(std::istream & is, size_t & size){
+    boost::uint64_t v = 0;
+    is.read((char*)&v, sizeof(v));
+    if (!is || v > MAX_CACHE_ELEMENTS) {
+      is.setstate(std::ios::failbit);
+      return false;
+    }
+    size = v;
+    return true;
+  }
+
+  void write_binary(std::ostream & os, std::string const& str){
+    write_size(os, str.size());
+    os.write(str.data(), str.size());
+  }
+  void read_binary(std::istream & is, std::string & str){
+    size_t size = 0;
+    if (!read_size(is, size))
+      return;
+    str.resize(size);
+    if (size > 0)
+      is.read(&str[0], size);
+  }
+
+  template <class T, size_t N>
+  void write_binary(std::ostream & os, Vector<T, N> const& vec){
+    for (size_t i = 0; i < N; i++)
+      write_binary(os, vec[i]);
+  }
+  template <class T, size_t N>
+  void read_binary(std::istream & is, Vector<T, N> & vec){
+    for (size_t i = 0; i < N; i++)
+      read_binary(is, vec[i]);
+  }
+
+  void write_binary(std::ostream & os, Quat const& q){
+    write_binary(os, q.w()); write_binary(os, q.x()); write_binary(os, q.y()); write_binary(os, q.z());
+  }
+  void read_binary(std::istream & is, Quat & q){
+    double w = 0, x = 0, y = 0, z = 0;
+    read_binary(is, w); read_binary(is, x); read_binary(is, y); read_binary(is, z);
+    q = Quat(w, x, y, z);
+  }
+
+  template <class T1, class T2>
+  void write_binary(std::ostream & os, std::pair<T1, T2> const& p){
+    write_binary(os, p.first);
+    write_binary(os, p.second);
+  }
+  template <class T1, class T2>
+  void read_binary(std::istream & is, std::pair<T1, T2> & p){
+    read_binary(is, p.first);
+    read_binary(is, p.second);
+  }
+
+  template <class T>
+  void write_binary(std::ostream & os, std::vector<T> const& vec){
+    write_size(os, vec.size());
+    for (size_t i = 0; i < vec.size(); i++)
+      write_binary(os, vec[i]);
+  }
+  template <class T>
+  void read_binary(std::istream & is, std::vector<T> & vec){
+    size_t size = 0;
+    if (!read_size(is, size))
+      return;
+    vec.resize(size);
+    for (size_t i = 0; i < size && is; i++)
+      read_binary(is, vec[i]);
+  }
+
+  template <class T>
+  void write_binary(std::ostream & os, std::list<T> const& vals){
+    write_size(os, vals.size());
+    for (typename std::list<T>::const_iterator it = vals.begin(); it != vals.end(); it++)
+      write_binary(os, *it);
+  }
+  template <class T>
+  void read_binary(std::istream & is, std::list<T> & vals){
+    size_t size = 0;
+    if (!read_size(is, size))
+      return;
+    vals.clear();
+    for (size_t i = 0; i < size && is; i++) {
+      T val;
+      read_binary(is, val);
+      vals.push_back(val);
+    }
+  }
+
+  // What identifies the version of a camera file the cache was made from
+  struct CameraFileKey {
+    std::string    path;
+    boost::int64_t size, mtime;
+  };
+
+  CameraFileKey camera_file_key(std::string const& camera_file){
+    CameraFileKey key;
+    key.path  = fs::absolute(camera_file).string();
+    key.size  = fs::file_size(camera_file);
+    key.mtime = fs::last_write_time(camera_file);
+    return key;
+  }
+
+  // Open a cache file and check its header. Return false if the cache
+  // is missing or out of date.
+  bool open_cache(std::string const& cache_dir, std::string const& camera_file,
+                  std::string const& type, std::ifstream & is){
+
+    try {
+      std::string cache_file = asp::camera_cache_file(cache_dir, camera_file, type);
+      if (!fs::exists(cache_file) || !fs::exists(camera_file))
+        return false;
+
+      is.open(cache_file.c_str(), std::ios::binary);
+      if (!is)
+        return false;
+
+      char magic[CACHE_MAGIC_LEN];
+      is.read(magic, CACHE_MAGIC_LEN);
+      int version = 0;
+      read_binary(is, version);
+      std::string cached_type;
+      read_binary(is, cached_type);
+      CameraFileKey cached_key;
+      read_binary(is, cached_key.path);
+      read_binary(is, cached_key.size);
+      read_binary(is, cached_key.mtime);
+      if (!is || std::string(magic, CACHE_MAGIC_LEN) != std::string(CACHE_MAGIC, CACHE_MAGIC_LEN) ||
+          version != asp::CAMERA_CACHE_VERSION || cached_type != type)
+        return false;
+
+      CameraFileKey key = camera_file_key(camera_file);
+      if (cached_key.path != key.path || cached_key.size != key.size ||
+          cached_key.mtime != key.mtime)
+        return false;
+
+    } catch (std::exception const& e) {
+      vw_out(DebugMessage, "asp") << "Could not read the cached camera for "
+                                  << camera_file << ": " << e.what() << "\n";
+      return false;
+    }
+
+    return true;
+  }
+
+  // Write a cache file to a temporary location and move it in place
+  // when done, so that processes reading the cache at the same time
+  // never see a partial file.
+  class CacheFileWriter {
+    std::string        m_cache_file, m_tmp_file;
+    std::ostringstream m_data;
+  public:
+    CacheFileWriter(std::string const& cache_dir, std::string const& camera_file,
+                    std::string const& type){
+      m_cache_file = asp::camera_cache_file(cache_dir, camera_file, type);
+      std::ostringstream os;
+      os << m_cache_file << ".tmp" << getpid();
+      m_tmp_file = os.str();
+
+      CameraFileKey key = camera_file_key(camera_file);
+      m_data.write(CACHE_MAGIC, CACHE_MAGIC_LEN);
+      write_binary(m_data, asp::CAMERA_CACHE_VERSION);
+      write_binary(m_data, type);
+      write_binary(m_data, key.path);
+      write_binary(m_data, key.size);
+      write_binary(m_data, key.mtime);
+    }
+
+    std::ostream & stream(){ return m_data; }
+
+    void commit(){
+      fs::path dir = fs::path(m_cache_file).parent_path();
+      if (!dir.empty() && !fs::exists(dir))
+        fs::create_directories(dir);
+      {
+        std::ofstream ofs(m_tmp_file.c_str(), std::ios::binary);
+        std::string data = m_data.str();
+        ofs.write(data.data(), data.size());
+        if (!ofs)
+          vw_throw(IOErr() << "Failed to write: " << m_tmp_file << "\n");
+      }
+      fs::rename(m_tmp_file, m_cache_file);
+    }
+
+    ~CacheFileWriter(){
+      boost::system::error_code ec;
+      fs::remove(m_tmp_file, ec);
+    }
+  };
+
+  void warn_write_failure(std::string const& camera_file, std::exception const& e){
+    vw_out(WarningMessage) << "Could not cache the camera loaded from "
+                           << camera_file << ": " << e.what() << "\n";
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+std::string camera_cache_file(std::string const& cache_dir, std::string const& camera_file,
+                              std::string const& type){
+  // Files with the same name in different directories must not collide
+  std::string path = fs::absolute(camera_file).string();
+  std::ostringstream os;
+  os << cache_dir << "/" << fs::path(camera_file).filename().string() << "-"
+     << std::hex << boost::hash<std::string>()(path) << "." << type << ".cache";
+  return os.str();
+}
+
+bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                        DGCameraParams & params){
+  std::ifstream is;
+  if (!open_cache(cache_dir, camera_file, "dg", is))
+    return false;
+
+  read_binary(is, params.positions);
+  read_binary(is, params.velocities);
+  read_binary(is, params.poses);
+  read_binary(is, params.position_t0);
+  read_binary(is, params.position_dt);
+  read_binary(is, params.pose_t0);
+  read_binary(is, params.pose_dt);
+  read_binary(is, params.tlc);
+  read_binary(is, params.tlc_t0);
+  read_binary(is, params.image_size);
+  read_binary(is, params.detector_origin);
+  read_binary(is, params.focal_length);
+  return bool(is);
+}
+
+void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                         DGCameraParams const& params){
+  try {
+    CacheFileWriter writer(cache_dir, camera_file, "dg");
+    std::ostream & os = writer.stream();
+    write_binary(os, params.positions);
+    write_binary(os, params.velocities);
+    write_binary(os, params.poses);
+    write_binary(os, params.position_t0);
+    write_binary(os, params.position_dt);
+    write_binary(os, params.pose_t0);
+    write_binary(os, params.pose_dt);
+    write_binary(os, params.tlc);
+    write_binary(os, params.tlc_t0);
+    write_binary(os, params.image_size);
+    write_binary(os, params.detector_origin);
+    write_binary(os, params.focal_length);
+    writer.commit();
+  } catch (std::exception const& e) {
+    warn_write_failure(camera_file, e);
+  }
+}
+
+bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                        boost::shared_ptr<RPCModel> & model){
+  std::ifstream is;
+  if (!open_cache(cache_dir, camera_file, "rpc", is))
+    return false;
+
+  std::string datum_name, spheroid_name, meridian_name;
+  double semi_major_axis = 0, semi_minor_axis = 0, meridian_offset = 0;
+  RPCModel::CoeffVec line_num_coeff, line_den_coeff, samp_num_coeff, samp_den_coeff;
+  Vector2 xy_offset, xy_scale;
+  Vector3 lonlatheight_offset, lonlatheight_scale;
+  read_binary(is, datum_name);
+  read_binary(is, spheroid_name);
+  read_binary(is, meridian_name);
+  read_binary(is, semi_major_axis);
+  read_binary(is, semi_minor_axis);
+  read_binary(is, meridian_offset);
+  read_binary(is, line_num_coeff);
+  read_binary(is, line_den_coeff);
+  read_binary(is, samp_num_coeff);
+  read_binary(is, samp_den_coeff);
+  read_binary(is, xy_offset);
+  read_binary(is, xy_scale);
+  read_binary(is, lonlatheight_offset);
+  read_binary(is, lonlatheight_scale);
+  if (!is)
+    return false;
+
+  cartography::Datum datum(datum_name, spheroid_name, meridian_name,
+                           semi_major_axis, semi_minor_axis, meridian_offset);
+  model = boost::shared_ptr<RPCModel>(new RPCModel(datum, line_num_coeff, line_den_coeff,
+                                                   samp_num_coeff, samp_den_coeff,
+                                                   xy_offset, xy_scale,
+                                                   lonlatheight_offset, lonlatheight_scale));
+  return true;
+}
+
+void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                         RPCModel const& model){
+  try {
+    CacheFileWriter writer(cache_dir, camera_file, "rpc");
+    std::ostream & os = writer.stream();
+    cartography::Datum const& datum = model.datum();
+    write_binary(os, datum.name());
+    write_binary(os, datum.spheroid_name());
+    write_binary(os, datum.meridian_name());
+    write_binary(os, datum.semi_major_axis());
+    write_binary(os, datum.semi_minor_axis());
+    write_binary(os, datum.meridian_offset());
+    write_binary(os, model.line_num_coeff());
+    write_binary(os, model.line_den_coeff());
+    write_binary(os, model.sample_num_coeff());
+    write_binary(os, model.sample_den_coeff());
+    write_binary(os, model.xy_offset());
+    write_binary(os, model.xy_scale());
+    write_binary(os, model.lonlatheight_offset());
+    write_binary(os, model.lonlatheight_scale());
+    writer.commit();
+  } catch (std::exception const& e) {
+    warn_write_failure(camera_file, e);
+  }
+}
+
+bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                        SpotXML & xml){
+  std::ifstream is;
+  if (!open_cache(cache_dir, camera_file, "spot5", is))
+    return false;
+
+  read_binary(is, xml.lonlat_corners);
+  read_binary(is, xml.pixel_corners);
+  read_binary(is, xml.look_angles);
+  read_binary(is, xml.pose_logs);
+  read_binary(is, xml.position_logs);
+  read_binary(is, xml.velocity_logs);
+  read_binary(is, xml.image_size);
+  read_binary(is, xml.line_period);
+  read_binary(is, xml.center_time);
+  read_binary(is, xml.center_line);
+  read_binary(is, xml.center_col);
+  if (!is)
+    return false;
+
+  // The reference time is not cached, but found as when parsing
+  xml.set_base_time_from_position_logs();
+  return true;
+}
+
+void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                         SpotXML const& xml){
+  try {
+    CacheFileWriter writer(cache_dir, camera_file, "spot5");
+    std::ostream & os = writer.stream();
+    write_binary(os, xml.lonlat_corners);
+    write_binary(os, xml.pixel_corners);
+    write_binary(os, xml.look_angles);
+    write_binary(os, xml.pose_logs);
+    write_binary(os, xml.position_logs);
+    write_binary(os, xml.velocity_logs);
+    write_binary(os, xml.image_size);
+    write_binary(os, xml.line_period);
+    write_binary(os, xml.center_time);
+    write_binary(os, xml.center_line);
+    write_binary(os, xml.center_col);
+    writer.commit();
+  } catch (std::exception const& e) {
+    warn_write_failure(camera_file, e);
+  }
+}
+
+bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                        ASTERXML & xml){
+  std::ifstream is;
+  if (!open_cache(cache_dir, camera_file, "aster", is))
+    return false;
+
+  read_binary(is, xml.m_lattice_mat);
+  read_binary(is, xml.m_sight_mat);
+  read_binary(is, xml.m_world_sight_mat);
+  read_binary(is, xml.m_sat_pos);
+  read_binary(is, xml.m_image_size);
+  return bool(is);
+}
+
+void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                         ASTERXML const& xml){
+  try {
+    CacheFileWriter writer(cache_dir, camera_file, "aster");
+    std::ostream & os = writer.stream();
+    write_binary(os, xml.m_lattice_mat);
+    write_binary(os, xml.m_sight_mat);
+    write_binary(os, xml.m_world_sight_mat);
+    write_binary(os, xml.m_sat_pos);
+    write_binary(os, xml.m_image_size);
+    writer.commit();
+  } catch (std::exception const& e) {
+    warn_write_failure(camera_file, e);
+  }
+}
+
+} // end namespace asp
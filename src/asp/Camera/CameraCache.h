@@ -0,0 +1,76 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CameraCache.h
+///
+/// A binary cache of cameras loaded from XML files. Parsing large
+/// camera XML files is slow, and parallel_stereo starts many
+/// processes which each load the same cameras. Here, what a camera
+/// model is built from is saved in binary form in a cache directory,
+/// the first time a camera is loaded, and read back afterwards.
+///
+/// A cache file records the absolute path of the camera file, its
+/// size and modification time, and the version of the cache layout.
+/// If any of these differ, the cache file is ignored and rewritten.
+
+#ifndef __ASP_CAMERA_CAMERA_CACHE_H__
+#define __ASP_CAMERA_CAMERA_CACHE_H__
+
+#include <asp/Camera/LinescanDGModel.h>
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+namespace asp {
+
+  class RPCModel;
+  class SpotXML;
+  class ASTERXML;
+
+  /// Bump this when the layout of any cached camera changes.
+  const int CAMERA_CACHE_VERSION = 1;
+
+  /// The file in the cache directory for the camera of given type
+  /// loaded from the given file.
+  std::string camera_cache_file(std::string const& cache_dir, std::string const& camera_file,
+                                std::string const& type);
+
+  /// Read a cached camera. Return false if there is no valid cache file
+  /// for the current version of the camera file.
+  bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                          DGCameraParams & params);
+  bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                          boost::shared_ptr<RPCModel> & model);
+  bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                          SpotXML & xml);
+  bool read_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                          ASTERXML & xml);
+
+  /// Save a camera to the cache. Failures only result in a warning, as
+  /// the camera can always be loaded from the original file.
+  void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                           DGCameraParams const& params);
+  void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                           RPCModel const& model);
+  void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                           SpotXML const& xml);
+  void write_cached_camera(std::string const& cache_dir, std::string const& camera_file,
+                           ASTERXML const& xml);
+
+} // end namespace asp
+
+#endif
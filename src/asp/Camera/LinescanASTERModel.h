@@ -92,6 +92,8 @@ namespace asp {
   }; // End class ASTERCameraModel
 
 
+  class ASTERXML;
+
   /// Load a ASTER camera model from an XML file.
   /// - This function does not take care of Xerces XML init/de-init, the caller must
   ///   make sure this is done before/after this function is called!
@@ -99,6 +101,11 @@ namespace asp {
   load_ASTER_camera_model_from_xml(std::string const& path,
 				   boost::shared_ptr<vw::camera::CameraModel> rpc_model);
 
+  /// Build a ASTER camera model from an already parsed XML file.
+  boost::shared_ptr<ASTERCameraModel>
+  load_ASTER_camera_model(ASTERXML const& xml_reader,
+			  boost::shared_ptr<vw::camera::CameraModel> rpc_model);
+
 }      // namespace asp
 
 
@@ -160,6 +160,28 @@ namespace asp {
   typedef LinescanDGModel<vw::camera::PiecewiseAPositionInterpolation,
                   			  vw::camera::SLERPPoseInterpolation> DGCameraModel;
 
+  /// The quantities a DG camera model is built from, once its XML file
+  /// is parsed and the times are converted to seconds. These can be
+  /// cached, so that the model is rebuilt without parsing the XML.
+  struct DGCameraParams {
+    std::vector<vw::Vector3> positions, velocities; ///< Sampled at position_t0 + i*position_dt
+    std::vector<vw::Quat>    poses;                 ///< Sampled at pose_t0 + i*pose_dt
+    double position_t0, position_dt, pose_t0, pose_dt;
+    std::vector<std::pair<double, double> > tlc;    ///< Line to time offset pairs
+    double       tlc_t0;                            ///< The time the offsets are from
+    vw::Vector2i image_size;
+    vw::Vector2  detector_origin;                   ///< In pixels
+    double       focal_length;                      ///< In pixels
+  };
+
+  /// Parse a DG XML file and find the quantities the camera model is built from.
+  /// - This function does not take care of Xerces XML init/de-init, the caller must
+  ///   make sure this is done before/after this function is called!
+  inline DGCameraParams load_dg_camera_params_from_xml(std::string const& path);
+
+  /// Build a DG camera model from its parameters.
+  inline boost::shared_ptr<DGCameraModel> build_dg_camera_model(DGCameraParams const& params);
+
   /// Load a DG camera model from an XML file.
   /// - This function does not take care of Xerces XML init/de-init, the caller must
   ///   make sure this is done before/after this function is called!
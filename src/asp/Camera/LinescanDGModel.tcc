@@ -153,7 +153,7 @@ inline boost::posix_time::ptime parse_time(std::string str)
   return boost::posix_time::time_from_string(str); // Never reached!
 }
 
-boost::shared_ptr<DGCameraModel> load_dg_camera_model_from_xml(std::string const& path)
+DGCameraParams load_dg_camera_params_from_xml(std::string const& path)
 {
   //vw_out() << "DEBUG - Loading DG camera file: " << camera_file << std::endl;
 
@@ -221,19 +221,39 @@ boost::shared_ptr<DGCameraModel> load_dg_camera_model_from_xml(std::string const
 							      geo.detector_origin[1],
 							      0)), 0, 2);
 
-  double et0 = convert( parse_time( eph.start_time ) );
-  double at0 = convert( parse_time( att.start_time ) );
-  double edt = eph.time_interval;
-  double adt = att.time_interval;
-
+  DGCameraParams params;
+  params.positions       = eph.position_vec;
+  params.velocities      = eph.velocity_vec;
+  params.poses           = att.quat_vec;
+  params.position_t0     = convert( parse_time( eph.start_time ) );
+  params.position_dt     = eph.time_interval;
+  params.pose_t0         = convert( parse_time( att.start_time ) );
+  params.pose_dt         = att.time_interval;
+  params.tlc             = img.tlc_vec;
+  params.tlc_t0          = convert( parse_time( img.tlc_start_time ) );
+  params.image_size      = img.image_size;
+  params.detector_origin = final_detector_origin;
+  params.focal_length    = geo.principal_distance;
+  return params;
+} // End function load_dg_camera_params_from_xml()
+
+boost::shared_ptr<DGCameraModel> build_dg_camera_model(DGCameraParams const& params)
+{
   typedef boost::shared_ptr<DGCameraModel> CameraModelPtr;
-  return CameraModelPtr(new DGCameraModel(vw::camera::PiecewiseAPositionInterpolation(eph.position_vec, eph.velocity_vec, et0, edt ),
-					                                vw::camera::LinearPiecewisePositionInterpolation(eph.velocity_vec, et0, edt),
-					                                vw::camera::SLERPPoseInterpolation(att.quat_vec, at0, adt),
-					                                tlc_time_interpolation, img.image_size,
-					                                final_detector_origin,
-					                                geo.principal_distance)
-		    );
+  return CameraModelPtr(new DGCameraModel(vw::camera::PiecewiseAPositionInterpolation(params.positions, params.velocities,
+                                                                                      params.position_t0, params.position_dt),
+                                          vw::camera::LinearPiecewisePositionInterpolation(params.velocities,
+                                                                                           params.position_t0, params.position_dt),
+                                          vw::camera::SLERPPoseInterpolation(params.poses, params.pose_t0, params.pose_dt),
+                                          vw::camera::TLCTimeInterpolation(params.tlc, params.tlc_t0),
+                                          params.image_size, params.detector_origin,
+                                          params.focal_length)
+                        );
+}
+
+boost::shared_ptr<DGCameraModel> load_dg_camera_model_from_xml(std::string const& path)
+{
+  return build_dg_camera_model(load_dg_camera_params_from_xml(path));
 } // End function load_dg_camera_model()
 
 
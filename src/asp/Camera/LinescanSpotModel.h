@@ -179,11 +179,16 @@ namespace asp {
   }; // End class SPOTCameraModel
 
 
+  class SpotXML;
+
   /// Load a SPOT5 camera model from an XML file.
   /// - This function does not take care of Xerces XML init/de-init, the caller must
   ///   make sure this is done before/after this function is called!
   boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model_from_xml(std::string const& path);
 
+  /// Build a SPOT5 camera model from an already parsed XML file.
+  boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model(SpotXML const& xml_reader);
+
 }      // namespace asp
 
 
@@ -34,6 +34,47 @@ using namespace vw;
 
 namespace asp {
 
+  namespace {
+
+    // The monomials in the normalized lat and height (y and z) which
+    // appear in the RPC polynomials. They are computed once per point
+    // and shared among the four polynomials.
+    struct RpcMonomials {
+      double y, z, yz, yy, zz, yyy, yzz, yyz, zzz;
+      RpcMonomials(double y_in, double z_in): y(y_in), z(z_in) {
+        yz  = y*z;  yy  = y*y;  zz  = z*z;
+        yyy = yy*y; yzz = y*zz; yyz = yy*z; zzz = zz*z;
+      }
+    };
+
+    // Evaluate an RPC polynomial with the terms ordered as in
+    // calculate_terms(). Group the terms by the power of x and use
+    // Horner's rule: P = a + x*(b + x*(d + x*c[11])), with a, b, and d
+    // the polynomials in y and z multiplying 1, x, and x^2.
+    inline double rpc_poly(RPCModel::CoeffVec const& c, double x, RpcMonomials const& m) {
+      double a = c[0] + c[2]*m.y + c[3]*m.z + c[6]*m.yz + c[8]*m.yy + c[9]*m.zz
+        + c[15]*m.yyy + c[16]*m.yzz + c[18]*m.yyz + c[19]*m.zzz;
+      double b = c[1] + c[4]*m.y + c[5]*m.z + c[10]*m.yz + c[12]*m.yy + c[13]*m.zz;
+      double d = c[7] + c[14]*m.y + c[17]*m.z;
+      return a + x*(b + x*(d + x*c[11]));
+    }
+
+    // Same as above, also finding the partial derivatives in x and y
+    inline void rpc_poly_and_grad(RPCModel::CoeffVec const& c, double x, RpcMonomials const& m,
+                                  double & val, double & dx, double & dy) {
+      double a = c[0] + c[2]*m.y + c[3]*m.z + c[6]*m.yz + c[8]*m.yy + c[9]*m.zz
+        + c[15]*m.yyy + c[16]*m.yzz + c[18]*m.yyz + c[19]*m.zzz;
+      double b = c[1] + c[4]*m.y + c[5]*m.z + c[10]*m.yz + c[12]*m.yy + c[13]*m.zz;
+      double d = c[7] + c[14]*m.y + c[17]*m.z;
+      double a_y = c[2] + c[6]*m.z + 2.0*c[8]*m.y + 3.0*c[15]*m.yy + c[16]*m.zz + 2.0*c[18]*m.yz;
+      double b_y = c[4] + c[10]*m.z + 2.0*c[12]*m.y;
+      val = a + x*(b + x*(d + x*c[11]));
+      dx  = b + x*(2.0*d + 3.0*x*c[11]);
+      dy  = a_y + x*(b_y + x*c[14]);
+    }
+
+  }
+
   void RPCModel::initialize( DiskImageResourceGDAL* resource ) {
     // Extract Datum (by means of GeoReference)
     cartography::GeoReference georef;
@@ -123,15 +164,41 @@ namespace asp {
    RPCModel::CoeffVec const& sample_num_coeff,
    RPCModel::CoeffVec const& sample_den_coeff){
 
-    CoeffVec term = calculate_terms( normalized_geodetic );
-    Vector2 normalized_pixel( dot_prod(term,sample_num_coeff) /
-                              dot_prod(term,sample_den_coeff),
-                              dot_prod(term,line_num_coeff) /
-                              dot_prod(term,line_den_coeff) );
+    double x = normalized_geodetic[0];
+    RpcMonomials m(normalized_geodetic[1], normalized_geodetic[2]);
+    Vector2 normalized_pixel( rpc_poly(sample_num_coeff, x, m) /
+                              rpc_poly(sample_den_coeff, x, m),
+                              rpc_poly(line_num_coeff,   x, m) /
+                              rpc_poly(line_den_coeff,   x, m) );
 
     return normalized_pixel;
   }
 
+  Vector2 RPCModel::normalized_pixel_and_Jacobian(Vector3 const& normalized_geodetic,
+                                                  Matrix<double, 2, 2> * J) const {
+
+    double x = normalized_geodetic[0];
+    RpcMonomials m(normalized_geodetic[1], normalized_geodetic[2]);
+
+    if (J == NULL)
+      return Vector2( rpc_poly(m_sample_num_coeff, x, m) / rpc_poly(m_sample_den_coeff, x, m),
+                      rpc_poly(m_line_num_coeff,   x, m) / rpc_poly(m_line_den_coeff,   x, m) );
+
+    double sn, sn_x, sn_y, sd, sd_x, sd_y, ln, ln_x, ln_y, ld, ld_x, ld_y;
+    rpc_poly_and_grad(m_sample_num_coeff, x, m, sn, sn_x, sn_y);
+    rpc_poly_and_grad(m_sample_den_coeff, x, m, sd, sd_x, sd_y);
+    rpc_poly_and_grad(m_line_num_coeff,   x, m, ln, ln_x, ln_y);
+    rpc_poly_and_grad(m_line_den_coeff,   x, m, ld, ld_x, ld_y);
+
+    // Quotient rule
+    (*J)[0][0] = (sn_x*sd - sn*sd_x)/(sd*sd);
+    (*J)[0][1] = (sn_y*sd - sn*sd_y)/(sd*sd);
+    (*J)[1][0] = (ln_x*ld - ln*ld_x)/(ld*ld);
+    (*J)[1][1] = (ln_y*ld - ln*ld_y)/(ld*ld);
+
+    return Vector2(sn/sd, ln/ld);
+  }
+
   Vector2 RPCModel::normalized_geodetic_to_normalized_pixel
   (Vector3 const& normalized_geodetic ) const {
 
@@ -369,8 +436,8 @@ namespace asp {
       normalized_geodetic[1] = normalized_lonlat[1];
       normalized_geodetic[2] = (height - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
 
-      Vector2              p = normalized_geodetic_to_normalized_pixel(normalized_geodetic);
-      Matrix<double, 2, 2> J = normalized_geodetic_to_pixel_Jacobian(normalized_geodetic);
+      Matrix<double, 2, 2> J;
+      Vector2              p = normalized_pixel_and_Jacobian(normalized_geodetic, &J);
 
       // The inverse matrix computed analytically
       double det = J[0][0]*J[1][1] - J[0][1]*J[1][0];
@@ -401,6 +468,86 @@ namespace asp {
 
   }
 
+  void RPCModel::point_to_pixel(std::vector<Vector3> const& points,
+                                std::vector<Vector2>      & pixels) const {
+    std::vector<Vector3> geodetics(points.size());
+    for (size_t i = 0; i < points.size(); i++)
+      geodetics[i] = m_datum.cartesian_to_geodetic(points[i]);
+    geodetic_to_pixel(geodetics, pixels);
+  }
+
+  void RPCModel::geodetic_to_pixel(std::vector<Vector3> const& geodetics,
+                                   std::vector<Vector2>      & pixels) const {
+
+    int num = geodetics.size();
+    std::vector<double> X(num), Y(num), Z(num), S(num), L(num);
+    for (int i = 0; i < num; i++) {
+      X[i] = (geodetics[i][0] - m_lonlatheight_offset[0])/m_lonlatheight_scale[0];
+      Y[i] = (geodetics[i][1] - m_lonlatheight_offset[1])/m_lonlatheight_scale[1];
+      Z[i] = (geodetics[i][2] - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
+    }
+
+    for (int i = 0; i < num; i++) {
+      RpcMonomials m(Y[i], Z[i]);
+      S[i] = rpc_poly(m_sample_num_coeff, X[i], m) / rpc_poly(m_sample_den_coeff, X[i], m);
+      L[i] = rpc_poly(m_line_num_coeff,   X[i], m) / rpc_poly(m_line_den_coeff,   X[i], m);
+    }
+
+    pixels.resize(num);
+    for (int i = 0; i < num; i++)
+      pixels[i] = Vector2(S[i]*m_xy_scale[0] + m_xy_offset[0],
+                          L[i]*m_xy_scale[1] + m_xy_offset[1]);
+  }
+
+  void RPCModel::image_to_ground(std::vector<Vector2> const& pixels,
+                                 std::vector<double>  const& heights,
+                                 std::vector<Vector2>      & lonlats) const {
+
+    VW_ASSERT(pixels.size() == heights.size(),
+              ArgumentErr() << "Expecting as many pixels as heights.\n");
+
+    // Same as the single-point version, with Newton's method
+    // performed for all points in lockstep. Use as initial guess the
+    // center of the valid region.
+    double abs_tolerance = 1e-6;
+    int num = pixels.size();
+    std::vector<double> X(num, 0.0), Y(num, 0.0), Z(num), PX(num), PY(num);
+    std::vector<char> active(num, 1);
+    for (int i = 0; i < num; i++) {
+      PX[i] = (pixels[i][0]  - m_xy_offset[0])/m_xy_scale[0];
+      PY[i] = (pixels[i][1]  - m_xy_offset[1])/m_xy_scale[1];
+      Z [i] = (heights[i] - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
+    }
+
+    for (int iter = 0; iter < 10; iter++) {
+      int num_active = 0;
+      for (int i = 0; i < num; i++) {
+        if (!active[i])
+          continue;
+
+        Matrix<double, 2, 2> J;
+        Vector2 p = normalized_pixel_and_Jacobian(Vector3(X[i], Y[i], Z[i]), &J);
+
+        double ex  = p[0] - PX[i], ey = p[1] - PY[i];
+        double det = J[0][0]*J[1][1] - J[0][1]*J[1][0];
+        X[i] -= ( J[1][1]*ex - J[0][1]*ey)/det;
+        Y[i] -= (-J[1][0]*ex + J[0][0]*ey)/det;
+
+        if (ex*ex + ey*ey < abs_tolerance*abs_tolerance)
+          active[i] = 0;
+        else
+          num_active++;
+      }
+      if (num_active == 0)
+        break;
+    }
+
+    lonlats.resize(num);
+    for (int i = 0; i < num; i++)
+      lonlats[i] = Vector2(X[i]*m_lonlatheight_scale[0] + m_lonlatheight_offset[0],
+                           Y[i]*m_lonlatheight_scale[1] + m_lonlatheight_offset[1]);
+  }
+
   void RPCModel::point_and_dir(Vector2 const& pix, Vector3 & P, Vector3 & dir ) const {
 
     // For an RPC model there is no defined origin so it and the ray need to be computed.
@@ -37,6 +37,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace vw {
   class DiskImageResourceGDAL;
@@ -88,6 +89,26 @@ namespace asp {
 
     vw::Vector2 geodetic_to_pixel( vw::Vector3 const& geodetic ) const;
 
+    /// Find the normalized pixel and its Jacobian in respect to the
+    /// normalized lon and lat (if J is not NULL). The monomials are
+    /// shared among the four polynomials, which are evaluated in
+    /// Horner form, so this is much faster than using calculate_terms().
+    vw::Vector2 normalized_pixel_and_Jacobian(vw::Vector3 const& normalized_geodetic,
+                                              vw::Matrix<double, 2, 2> * J) const;
+
+    /// Batched versions of point_to_pixel(), geodetic_to_pixel(), and
+    /// image_to_ground(), to be used when many points need to be
+    /// processed at once, such as for a tile of a map-projected
+    /// image. The coordinates are stored internally in separate arrays
+    /// to help the compiler vectorize the loops.
+    void point_to_pixel   (std::vector<vw::Vector3> const& points,
+                           std::vector<vw::Vector2>      & pixels) const;
+    void geodetic_to_pixel(std::vector<vw::Vector3> const& geodetics,
+                           std::vector<vw::Vector2>      & pixels) const;
+    void image_to_ground  (std::vector<vw::Vector2> const& pixels,
+                           std::vector<double>      const& heights,
+                           std::vector<vw::Vector2>      & lonlats) const;
+
     // Access to constants
     vw::cartography::Datum const& datum   () const { return m_datum;               }
     CoeffVec    const& line_num_coeff     () const { return m_line_num_coeff;      }
@@ -167,6 +167,11 @@ void SpotXML::parse_xml(xercesc::DOMElement* node) {
   //std::cout << "Parse line times\n";
   read_line_times(sensor_config_node);
   
+  set_base_time_from_position_logs();
+  //std::cout << "Done parsing XML.\n";
+}
+
+void SpotXML::set_base_time_from_position_logs() {
   // Set up the base time
   // - The position log starts before the image does, so the first
   //   time there should be a good reference time.
@@ -182,7 +187,6 @@ void SpotXML::parse_xml(xercesc::DOMElement* node) {
     }
   }
   m_time_ref_functor.set_base_time(earliest_time);
-  //std::cout << "Done parsing XML.\n";
 }
 
 
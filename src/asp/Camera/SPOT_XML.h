@@ -96,6 +96,11 @@ namespace asp {
     /// Parse an XML tree to populate the data
     void parse_xml(xercesc::DOMElement* node);
 
+    /// Set the reference time to the earliest time in the position
+    /// log. Must be called after the fields are filled in other than
+    /// by parsing XML.
+    void set_base_time_from_position_logs();
+
     /// Fills in an ImageFormat object required to read the associated .BIL file.
     static vw::ImageFormat get_image_format(std::string const& xml_path);
 
@@ -0,0 +1,215 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Camera/LinescanDGModel.h>
+#include <asp/Camera/LinescanSpotModel.h>
+#include <asp/Camera/SPOT_XML.h>
+#include <asp/Camera/ASTER_XML.h>
+#include <asp/Camera/RPC_XML.h>
+#include <asp/Camera/RPCModel.h>
+#include <asp/Camera/CameraCache.h>
+#include <vw/Core/Stopwatch.h>
+#include <test/Helpers.h>
+#include <xercesc/util/PlatformUtils.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+using namespace xercesc;
+using namespace vw::test;
+
+namespace fs = boost::filesystem;
+
+// The tests change the timestamps of the camera files, so work on
+// copies of them rather than on the files in the source tree. Return
+// the copy.
+std::string copy_to_test_dir(std::string const& test_dir, std::string const& file) {
+  fs::create_directories(test_dir);
+  std::string copy = test_dir + "/" + fs::path(file).filename().string();
+  fs::copy_file(file, copy, fs::copy_option::overwrite_if_exists);
+  return copy;
+}
+
+// Loading a cached camera must give the same camera as parsing the
+// XML file. Print how long each takes, as a benchmark of startup latency.
+TEST(CameraCache, DG) {
+  XMLPlatformUtils::Initialize();
+
+  std::string test_dir  = "camera_cache_test_dg";
+  std::string cache_dir = test_dir + "/cache";
+  fs::remove_all(test_dir);
+  std::string xml = copy_to_test_dir(test_dir, "dg_example1.xml");
+
+  int num_loads = 10;
+  Stopwatch xml_sw;
+  xml_sw.start();
+  DGCameraParams params;
+  for (int i = 0; i < num_loads; i++)
+    params = load_dg_camera_params_from_xml(xml);
+  xml_sw.stop();
+
+  DGCameraParams cached_params;
+  EXPECT_FALSE(read_cached_camera(cache_dir, xml, cached_params));
+  write_cached_camera(cache_dir, xml, params);
+
+  Stopwatch cache_sw;
+  cache_sw.start();
+  for (int i = 0; i < num_loads; i++)
+    EXPECT_TRUE(read_cached_camera(cache_dir, xml, cached_params));
+  cache_sw.stop();
+
+  std::cout << "Time to load a DG camera from XML: "
+            << xml_sw.elapsed_seconds()/num_loads << " seconds, from the cache: "
+            << cache_sw.elapsed_seconds()/num_loads << " seconds.\n";
+
+  boost::shared_ptr<DGCameraModel> cam1 = build_dg_camera_model(params);
+  boost::shared_ptr<DGCameraModel> cam2 = build_dg_camera_model(cached_params);
+  for (int i = 0; i < 30000; i += 5000) {
+    for (int j = 0; j < 24000; j += 5000) {
+      Vector2 pix(i, j);
+      EXPECT_VECTOR_NEAR(cam1->camera_center(pix),   cam2->camera_center(pix),   1e-8);
+      EXPECT_VECTOR_NEAR(cam1->pixel_to_vector(pix), cam2->pixel_to_vector(pix), 1e-12);
+    }
+  }
+
+  // Once the camera file changes, its cache must not be used
+  fs::last_write_time(xml, fs::last_write_time(xml) + 1);
+  EXPECT_FALSE(read_cached_camera(cache_dir, xml, cached_params));
+
+  fs::remove_all(test_dir);
+  XMLPlatformUtils::Terminate();
+}
+
+TEST(CameraCache, RPC) {
+  XMLPlatformUtils::Initialize();
+
+  std::string test_dir  = "camera_cache_test_rpc";
+  std::string cache_dir = test_dir + "/cache";
+  fs::remove_all(test_dir);
+  std::string xml = copy_to_test_dir(test_dir, "dg_example1.xml");
+
+  boost::shared_ptr<RPCModel> model_ptr;
+  {
+    RPCXML rpc_xml;
+    rpc_xml.read_from_file(xml);
+    model_ptr.reset(new RPCModel(*rpc_xml.rpc_ptr()));
+  }
+  RPCModel const& model = *model_ptr;
+  boost::shared_ptr<RPCModel> cached_model;
+  EXPECT_FALSE(read_cached_camera(cache_dir, xml, cached_model));
+  write_cached_camera(cache_dir, xml, model);
+  ASSERT_TRUE(read_cached_camera(cache_dir, xml, cached_model));
+
+  EXPECT_EQ(model.datum().name(), cached_model->datum().name());
+  EXPECT_NEAR(model.datum().semi_major_axis(), cached_model->datum().semi_major_axis(), 1e-8);
+  EXPECT_VECTOR_NEAR(model.line_num_coeff(),   cached_model->line_num_coeff(),   0);
+  EXPECT_VECTOR_NEAR(model.sample_den_coeff(), cached_model->sample_den_coeff(), 0);
+  Vector3 llh = model.lonlatheight_offset();
+  for (int i = -2; i <= 2; i++) {
+    Vector3 geodetic = llh + Vector3(i*0.01, -i*0.01, i*100);
+    EXPECT_VECTOR_NEAR(model.geodetic_to_pixel(geodetic),
+                       cached_model->geodetic_to_pixel(geodetic), 1e-10);
+  }
+
+  fs::remove_all(test_dir);
+  XMLPlatformUtils::Terminate();
+}
+
+// Kept separate so that the SpotXML destructors run before Xerces
+// is terminated.
+void spot5_cache_test(std::string const& test_dir) {
+
+  std::string cache_dir = test_dir + "/cache";
+  std::string xml = copy_to_test_dir(test_dir, "spot_example1.xml");
+
+  SpotXML xml_reader;
+  xml_reader.read_xml(xml);
+  SpotXML cached_reader;
+  EXPECT_FALSE(read_cached_camera(cache_dir, xml, cached_reader));
+  write_cached_camera(cache_dir, xml, xml_reader);
+  ASSERT_TRUE(read_cached_camera(cache_dir, xml, cached_reader));
+
+  EXPECT_EQ(xml_reader.image_size, cached_reader.image_size);
+  EXPECT_EQ(xml_reader.center_time, cached_reader.center_time);
+  EXPECT_EQ(xml_reader.position_logs.size(), cached_reader.position_logs.size());
+
+  // The cameras depend on the reference time, which is not in the cache
+  boost::shared_ptr<SPOTCameraModel> cam1 = load_spot5_camera_model(xml_reader);
+  boost::shared_ptr<SPOTCameraModel> cam2 = load_spot5_camera_model(cached_reader);
+  for (int i = 0; i < xml_reader.image_size[0]; i += 100) {
+    for (int j = 0; j < xml_reader.image_size[1]; j += 20000) {
+      Vector2 pix(i, j);
+      EXPECT_VECTOR_NEAR(cam1->camera_center(pix),   cam2->camera_center(pix),   1e-8);
+      EXPECT_VECTOR_NEAR(cam1->pixel_to_vector(pix), cam2->pixel_to_vector(pix), 1e-12);
+    }
+  }
+}
+
+TEST(CameraCache, SPOT5) {
+  XMLPlatformUtils::Initialize();
+  std::string test_dir = "camera_cache_test_spot5";
+  fs::remove_all(test_dir);
+  spot5_cache_test(test_dir);
+  fs::remove_all(test_dir);
+  XMLPlatformUtils::Terminate();
+}
+
+// There is no ASTER camera among the test files, so cache one made up
+// here. The cache is keyed on the file it would be loaded from.
+TEST(CameraCache, ASTER) {
+  std::string test_dir  = "camera_cache_test_aster";
+  std::string cache_dir = test_dir + "/cache";
+  fs::remove_all(test_dir);
+  std::string xml = copy_to_test_dir(test_dir, "dg_example1.xml");
+
+  ASTERXML aster;
+  aster.m_image_size = Vector2i(4200, 4100);
+  for (int r = 0; r < 3; r++) {
+    std::vector<Vector2> lattice_row;
+    std::vector<Vector3> sight_row, world_sight_row;
+    for (int c = 0; c < 4; c++) {
+      lattice_row.push_back(Vector2(c*1000.0, r*1000.0));
+      sight_row.push_back(Vector3(0.1*c, -0.1*r, 1.0));
+      world_sight_row.push_back(Vector3(1.0, 0.1*c, -0.1*r));
+    }
+    aster.m_lattice_mat.push_back(lattice_row);
+    aster.m_sight_mat.push_back(sight_row);
+    aster.m_world_sight_mat.push_back(world_sight_row);
+    aster.m_sat_pos.push_back(Vector3(7e6, r*1e3, -r*1e3));
+  }
+
+  ASTERXML cached;
+  EXPECT_FALSE(read_cached_camera(cache_dir, xml, cached));
+  write_cached_camera(cache_dir, xml, aster);
+  ASSERT_TRUE(read_cached_camera(cache_dir, xml, cached));
+
+  EXPECT_EQ(aster.m_image_size, cached.m_image_size);
+  ASSERT_EQ(aster.m_lattice_mat.size(), cached.m_lattice_mat.size());
+  ASSERT_EQ(aster.m_sat_pos.size(), cached.m_sat_pos.size());
+  for (size_t r = 0; r < aster.m_lattice_mat.size(); r++) {
+    ASSERT_EQ(aster.m_lattice_mat[r].size(), cached.m_lattice_mat[r].size());
+    for (size_t c = 0; c < aster.m_lattice_mat[r].size(); c++) {
+      EXPECT_VECTOR_NEAR(aster.m_lattice_mat[r][c],     cached.m_lattice_mat[r][c],     0);
+      EXPECT_VECTOR_NEAR(aster.m_sight_mat[r][c],       cached.m_sight_mat[r][c],       0);
+      EXPECT_VECTOR_NEAR(aster.m_world_sight_mat[r][c], cached.m_world_sight_mat[r][c], 0);
+    }
+    EXPECT_VECTOR_NEAR(aster.m_sat_pos[r], cached.m_sat_pos[r], 0);
+  }
+
+  fs::remove_all(test_dir);
+}
@@ -30,6 +30,7 @@
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/RPCStereoModel.h>
 #include <asp/Core/StereoSettings.h>
+#include <vw/Core/Stopwatch.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 
@@ -206,6 +207,95 @@ TEST( StereoSessionRPC, CheckStereo ) {
 
 
 
+/// The shared-monomial RPC kernel must agree with the original
+/// formulation using the 20 terms, the batched RPC functions must
+/// agree with the single-point ones, and image_to_ground() must invert
+/// them. Also report the throughput of the single-point and batched
+/// functions, as a benchmark.
+TEST( StereoSessionRPC, BatchedProjection ) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  // Geodetic points on a grid in the valid region of the model
+  const int NUM_SIDE = 300;
+  std::vector<Vector3> geodetics;
+  Vector3 offset = model.lonlatheight_offset(), scale = model.lonlatheight_scale();
+  for (int i = 0; i < NUM_SIDE; i++) {
+    for (int j = 0; j < NUM_SIDE; j++) {
+      double u = 1.6*i/(NUM_SIDE - 1.0) - 0.8, v = 1.6*j/(NUM_SIDE - 1.0) - 0.8;
+      geodetics.push_back(offset + elem_prod(scale, Vector3(u, v, u*v)));
+    }
+  }
+  int num = geodetics.size();
+
+  Stopwatch sw1;
+  sw1.start();
+  std::vector<Vector2> pixels1(num);
+  for (int i = 0; i < num; i++)
+    pixels1[i] = model.geodetic_to_pixel(geodetics[i]);
+  sw1.stop();
+
+  Stopwatch sw2;
+  sw2.start();
+  std::vector<Vector2> pixels2;
+  model.geodetic_to_pixel(geodetics, pixels2);
+  sw2.stop();
+
+  ASSERT_EQ(num, (int)pixels2.size());
+  for (int i = 0; i < num; i++) {
+    EXPECT_VECTOR_NEAR( pixels1[i], pixels2[i], 1e-8 );
+    // Compare with the original formulation using the terms
+    Vector3 ng = elem_quot(geodetics[i] - offset, scale);
+    Vector2 np = RPCModel::normalized_geodetic_to_normalized_pixel
+      (ng, model.line_num_coeff(), model.line_den_coeff(),
+       model.sample_num_coeff(), model.sample_den_coeff());
+    RPCModel::CoeffVec t = RPCModel::calculate_terms(ng);
+    EXPECT_NEAR( np[0], dot_prod(t, model.sample_num_coeff())/dot_prod(t, model.sample_den_coeff()), 1e-12 );
+    EXPECT_NEAR( np[1], dot_prod(t, model.line_num_coeff())/dot_prod(t, model.line_den_coeff()),     1e-12 );
+  }
+
+  // Same for points given in ECEF
+  std::vector<Vector3> points(num);
+  for (int i = 0; i < num; i++)
+    points[i] = model.datum().geodetic_to_cartesian(geodetics[i]);
+  std::vector<Vector2> pixels3;
+  model.point_to_pixel(points, pixels3);
+  for (int i = 0; i < num; i += 97)
+    EXPECT_VECTOR_NEAR( model.point_to_pixel(points[i]), pixels3[i], 1e-8 );
+
+  // The Jacobian from the fast kernel must match the original one
+  Vector3 ng(0.1, -0.2, 0.3);
+  Matrix<double, 2, 2> J;
+  model.normalized_pixel_and_Jacobian(ng, &J);
+  Matrix<double, 2, 2> J0 = model.normalized_geodetic_to_pixel_Jacobian(ng);
+  EXPECT_LT( max(abs(J - J0))/max(abs(J0)), 1e-12 );
+
+  // Go back to the ground in bulk
+  std::vector<double> heights(num);
+  for (int i = 0; i < num; i++)
+    heights[i] = geodetics[i][2];
+  Stopwatch sw3;
+  sw3.start();
+  std::vector<Vector2> lonlats;
+  model.image_to_ground(pixels2, heights, lonlats);
+  sw3.stop();
+  for (int i = 0; i < num; i++)
+    EXPECT_VECTOR_NEAR( subvector(geodetics[i], 0, 2), lonlats[i], 1e-8 );
+  for (int i = 0; i < num; i += 97)
+    EXPECT_VECTOR_NEAR( lonlats[i], model.image_to_ground(pixels2[i], heights[i]), 1e-8 );
+
+  std::cout << "Projected " << num << " points in " << sw1.elapsed_seconds()
+            << " seconds one at a time and in " << sw2.elapsed_seconds()
+            << " seconds batched. Batched image_to_ground took "
+            << sw3.elapsed_seconds() << " seconds." << std::endl;
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
 /// Make sure that the AdjustedCameraModel class handles cropping with RPC models
 TEST( StereoSessionRPC, CheckRpcCrop ) {
 
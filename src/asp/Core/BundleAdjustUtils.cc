@@ -22,11 +22,18 @@
 #include <asp/Core/BundleAdjustUtils.h>
 
 #include <vw/Core/Log.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Camera/CameraModel.h>
 #include <vw/BundleAdjustment/ControlNetwork.h>
+#include <vw/InterestPoint/Matcher.h>
 #include <vw/Stereo/StereoModel.h>
 
+#include <boost/filesystem/operations.hpp>
+
 #include <string>
+#include <set>
+#include <fstream>
+#include <sstream>
 
 using namespace vw;
 using namespace vw::camera;
@@ -155,3 +162,254 @@ void asp::compute_stereo_residuals(std::vector<boost::shared_ptr<CameraModel> >
   vw_out() << "\nStereo Intersection Residuals -- Min: " << min_error
            << "  Max: " << max_error << "  Average: " << (error_sum/n) << "\n";
 }
+
+namespace {
+
+  // An interest point in a given image, as found in match files
+  struct TrackElement {
+    int   image;
+    float x, y, sigma;
+    bool operator<(TrackElement const& other) const {
+      if (image != other.image) return image < other.image;
+      if (x     != other.x    ) return x     < other.x;
+      return y < other.y;
+    }
+  };
+
+  // Union-find with path compression and union by rank
+  class DisjointSets {
+    std::vector<int> m_parent, m_rank;
+  public:
+    int add() {
+      m_parent.push_back(m_parent.size());
+      m_rank.push_back(0);
+      return m_parent.size() - 1;
+    }
+    int find(int a) {
+      int root = a;
+      while (m_parent[root] != root)
+        root = m_parent[root];
+      while (m_parent[a] != root) {
+        int next = m_parent[a];
+        m_parent[a] = root;
+        a = next;
+      }
+      return root;
+    }
+    void unite(int a, int b) {
+      a = find(a); b = find(b);
+      if (a == b) return;
+      if (m_rank[a] < m_rank[b]) std::swap(a, b);
+      m_parent[b] = a;
+      if (m_rank[a] == m_rank[b]) m_rank[a]++;
+    }
+  };
+
+  // Triangulate a range of tracks. A track is triangulated from each
+  // pair of consecutive measures whose rays are not too close to
+  // parallel, and the results are averaged.
+  class TriangulateTracksTask : public vw::Task {
+    std::vector<boost::shared_ptr<CameraModel> > const& m_camera_models;
+    std::vector<ControlPoint> & m_points;
+    std::vector<char>         & m_valid; // not vector<bool>, written concurrently
+    size_t m_begin, m_end;
+    double m_min_angle;
+  public:
+    TriangulateTracksTask(std::vector<boost::shared_ptr<CameraModel> > const& camera_models,
+                          std::vector<ControlPoint> & points, std::vector<char> & valid,
+                          size_t begin, size_t end, double min_angle):
+      m_camera_models(camera_models), m_points(points), m_valid(valid),
+      m_begin(begin), m_end(end), m_min_angle(min_angle){}
+
+    void operator()() {
+      for (size_t it = m_begin; it < m_end; it++) {
+        ControlPoint & cp = m_points[it];
+        Vector3 sum;
+        int count = 0;
+        for (size_t j = 0; j+1 < cp.size(); j++) {
+          try {
+            CameraModel * cam1 = m_camera_models[cp[j].image_id()].get();
+            CameraModel * cam2 = m_camera_models[cp[j+1].image_id()].get();
+            Vector2 pix1 = cp[j].position(), pix2 = cp[j+1].position();
+            double cos_angle = dot_prod(cam1->pixel_to_vector(pix1),
+                                        cam2->pixel_to_vector(pix2));
+            if (cos_angle > cos(m_min_angle))
+              continue;
+            StereoModel sm(cam1, cam2);
+            double error;
+            Vector3 xyz = sm(pix1, pix2, error);
+            if (xyz == Vector3())
+              continue;
+            sum += xyz;
+            count++;
+          } catch (...) {}
+        }
+        m_valid[it] = (count > 0);
+        if (count > 0)
+          cp.set_position(sum/count);
+      }
+    }
+  };
+
+  std::string control_network_cache_file(std::string const& prefix) {
+    return prefix + "-control.cnet";
+  }
+  std::string control_network_inputs_file(std::string const& prefix) {
+    return prefix + "-control-inputs.txt";
+  }
+}
+
+bool asp::build_control_network_streaming(ControlNetwork & cnet,
+                                          std::vector<boost::shared_ptr<CameraModel> >
+                                          const& camera_models,
+                                          std::map< std::pair<int, int>, std::string>
+                                          const& match_files,
+                                          int min_matches, double min_angle_radians,
+                                          int num_threads) {
+
+  // Merge the matches into tracks, one match file at a time. The
+  // lookup from pixel to track element has one entry for each
+  // distinct matched interest point, so it grows with the total
+  // number of matches, but only the descriptors and match lists of
+  // the current file are in memory.
+  std::map<TrackElement, int> element_ids;
+  std::vector<TrackElement>   elements;
+  DisjointSets sets;
+  size_t num_matches = 0;
+  typedef std::map< std::pair<int, int>, std::string>::const_iterator MatchIter;
+  for (MatchIter it = match_files.begin(); it != match_files.end(); it++) {
+
+    std::string const& match_file = it->second;
+    if (!boost::filesystem::exists(match_file))
+      continue;
+
+    std::vector<ip::InterestPoint> ip1, ip2;
+    ip::read_binary_match_file(match_file, ip1, ip2);
+    if (int(ip1.size()) < min_matches) {
+      vw_out() << "Skipping " << match_file << " as it has only " << ip1.size()
+               << " matches.\n";
+      continue;
+    }
+    vw_out(DebugMessage,"asp") << "Loaded " << ip1.size() << " matches from "
+                               << match_file << "\n";
+    num_matches += ip1.size();
+
+    int images[2] = {it->first.first, it->first.second};
+    for (size_t k = 0; k < ip1.size(); k++) {
+      int ids[2];
+      for (int side = 0; side < 2; side++) {
+        ip::InterestPoint const& ip = (side == 0) ? ip1[k] : ip2[k];
+        TrackElement elem;
+        elem.image = images[side];
+        elem.x = ip.x; elem.y = ip.y; elem.sigma = ip.scale;
+        std::map<TrackElement, int>::iterator id_it = element_ids.find(elem);
+        if (id_it == element_ids.end()) {
+          ids[side] = sets.add();
+          element_ids[elem] = ids[side];
+          elements.push_back(elem);
+        }else{
+          ids[side] = id_it->second;
+        }
+      }
+      sets.unite(ids[0], ids[1]);
+    }
+  }
+  element_ids.clear();
+
+  // Collect the tracks
+  std::map<int, int> root_to_track;
+  std::vector< std::vector<int> > tracks;
+  for (size_t e = 0; e < elements.size(); e++) {
+    int root = sets.find(e);
+    std::map<int, int>::iterator track_it = root_to_track.find(root);
+    if (track_it == root_to_track.end()) {
+      root_to_track[root] = tracks.size();
+      tracks.push_back(std::vector<int>(1, e));
+    }else{
+      tracks[track_it->second].push_back(e);
+    }
+  }
+  root_to_track.clear();
+
+  // Make control points out of consistent tracks
+  std::vector<ControlPoint> points;
+  size_t num_inconsistent = 0;
+  for (size_t t = 0; t < tracks.size(); t++) {
+    std::vector<int> const& track = tracks[t];
+    std::set<int> images;
+    ControlPoint cp(ControlPoint::TiePoint);
+    for (size_t k = 0; k < track.size(); k++) {
+      TrackElement const& elem = elements[track[k]];
+      images.insert(elem.image);
+      cp.add_measure(ControlMeasure(elem.x, elem.y, elem.sigma, elem.sigma, elem.image));
+    }
+    if (images.size() != track.size()) {
+      num_inconsistent++;
+      continue;
+    }
+    points.push_back(cp);
+  }
+  tracks.clear();
+  elements.clear();
+  vw_out() << "Formed " << points.size() << " tracks out of " << num_matches
+           << " matches (discarded " << num_inconsistent << " inconsistent tracks).\n";
+
+  // Triangulate the tracks in batches
+  std::vector<char> valid(points.size(), 0);
+  {
+    FifoWorkQueue queue(std::max(num_threads, 1));
+    size_t batch_size = 1000;
+    for (size_t begin = 0; begin < points.size(); begin += batch_size) {
+      size_t end = std::min(begin + batch_size, points.size());
+      boost::shared_ptr<Task> task(new TriangulateTracksTask(camera_models, points, valid,
+                                                             begin, end, min_angle_radians));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
+
+  size_t num_added = 0;
+  for (size_t it = 0; it < points.size(); it++) {
+    if (!valid[it]) continue;
+    cnet.add_control_point(points[it]);
+    num_added++;
+  }
+  vw_out() << "Triangulated " << num_added << " of " << points.size() << " tracks.\n";
+
+  return (num_added > 0);
+}
+
+void asp::write_control_network_cache(std::string const& prefix,
+                                      std::string const& inputs_description,
+                                      ControlNetwork & cnet) {
+  // Write_binary() appends the .cnet extension
+  vw_out() << "Writing: " << control_network_cache_file(prefix) << std::endl;
+  cnet.write_binary(prefix + "-control");
+
+  std::ofstream ofs(control_network_inputs_file(prefix).c_str());
+  ofs << inputs_description;
+  ofs.close();
+}
+
+bool asp::read_control_network_cache(std::string const& prefix,
+                                     std::string const& inputs_description,
+                                     ControlNetwork & cnet) {
+
+  std::string cnet_file   = control_network_cache_file(prefix);
+  std::string inputs_file = control_network_inputs_file(prefix);
+  if (!boost::filesystem::exists(cnet_file) || !boost::filesystem::exists(inputs_file))
+    return false;
+
+  std::ifstream ifs(inputs_file.c_str());
+  std::ostringstream cached_description;
+  cached_description << ifs.rdbuf();
+  if (cached_description.str() != inputs_description) {
+    vw_out() << "The inputs changed since " << cnet_file << " was written. "
+             << "Will not use it.\n";
+    return false;
+  }
+
+  vw_out() << "Loading cached control network: " << cnet_file << std::endl;
+  cnet.read_binary(cnet_file);
+  return true;
+}
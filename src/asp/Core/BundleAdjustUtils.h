@@ -27,6 +27,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
 #include <boost/smart_ptr/shared_ptr.hpp>
 
@@ -60,6 +61,38 @@ namespace asp{
                          vw::Vector3 const& position_correction,
                          vw::Quat    const& pose_correction);
 
+  /// Build a control network from pairwise match files. The files
+  /// are read one at a time, and matching interest points are merged
+  /// into tracks with union-find. Memory still grows with the number
+  /// of distinct matched interest points, but only their image and
+  /// pixel are kept, not their descriptors or the match lists.
+  /// Pairs with fewer than
+  /// min_matches matches are skipped, as are tracks seeing the same
+  /// image twice. Tracks are triangulated in parallel with the given
+  /// number of threads, and points whose rays meet at an angle less
+  /// than min_angle_radians are discarded. Return false if no points
+  /// were found.
+  bool build_control_network_streaming(vw::ba::ControlNetwork & cnet,
+                                       std::vector<boost::shared_ptr<vw::camera::CameraModel> >
+                                       const& camera_models,
+                                       std::map< std::pair<int, int>, std::string>
+                                       const& match_files,
+                                       int min_matches, double min_angle_radians,
+                                       int num_threads);
+
+  /// Save a control network in binary format, together with a
+  /// description of the inputs it was made from, as <prefix>-control.cnet
+  /// and <prefix>-control-inputs.txt.
+  void write_control_network_cache(std::string const& prefix,
+                                   std::string const& inputs_description,
+                                   vw::ba::ControlNetwork & cnet);
+
+  /// Load a control network saved with write_control_network_cache(),
+  /// if it exists and was made from the same inputs. Return true on success.
+  bool read_control_network_cache(std::string const& prefix,
+                                  std::string const& inputs_description,
+                                  vw::ba::ControlNetwork & cnet);
+
   ///
   void compute_stereo_residuals(std::vector<boost::shared_ptr<vw::camera::CameraModel> >
                                 const& camera_models,
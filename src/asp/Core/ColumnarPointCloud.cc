@@ -0,0 +1,482 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ColumnarPointCloud.cc
+///
+
+#include <asp/Core/ColumnarPointCloud.h>
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <zlib.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace vw;
+
+namespace {
+
+  // Version 2 added the georeference. Version 1 files are still read.
+  const char   APC_MAGIC[]    = "ASPAPC02";
+  const char   APC_MAGIC_V1[] = "ASPAPC01";
+  const size_t APC_MAGIC_LEN  = 8;
+
+  // The size of the part of the header before the block table
+  size_t apc_prefix_size(std::string const& georef_wkt){
+    return APC_MAGIC_LEN + 4*sizeof(boost::int32_t) + 4*sizeof(double)
+      + sizeof(boost::uint64_t) + georef_wkt.size();
+  }
+
+  // The size of one entry in the block table
+  size_t apc_block_entry_size(int num_channels){
+    return 6*sizeof(double) + sizeof(boost::uint64_t) + sizeof(boost::int32_t)
+      + (num_channels + 1)*2*sizeof(boost::uint64_t);
+  }
+
+  template<class T>
+  void append_value(std::string & buf, T const& val){
+    buf.append(reinterpret_cast<const char*>(&val), sizeof(T));
+  }
+
+  // Read a value from a memory-mapped file, checking that we stay within it.
+  template<class T>
+  T read_value(const char * data, size_t data_size, size_t & pos, std::string const& file){
+    if (pos + sizeof(T) > data_size)
+      vw_throw( IOErr() << "Truncated point cloud file: " << file << "\n" );
+    T val;
+    std::memcpy(&val, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return val;
+  }
+
+  template<class T>
+  void append_array(std::string & buf, std::vector<T> const& vals){
+    if (!vals.empty())
+      buf.append(reinterpret_cast<const char*>(&vals[0]), vals.size()*sizeof(T));
+  }
+
+  std::string compress_buffer(std::string const& in){
+    uLongf out_len = compressBound(in.size());
+    std::string out(out_len, '\0');
+    int ret = compress2(reinterpret_cast<Bytef*>(&out[0]), &out_len,
+                        reinterpret_cast<const Bytef*>(in.data()), in.size(),
+                        Z_BEST_SPEED);
+    if (ret != Z_OK)
+      vw_throw( IOErr() << "Failed to compress point cloud data.\n" );
+    out.resize(out_len);
+    return out;
+  }
+
+  void uncompress_buffer(const char * in, size_t in_len, size_t out_len,
+                         std::vector<char> & out, std::string const& file){
+    out.resize(out_len);
+    uLongf len = out_len;
+    int ret = uncompress(reinterpret_cast<Bytef*>(out.empty() ? NULL : &out[0]), &len,
+                         reinterpret_cast<const Bytef*>(in), in_len);
+    if (ret != Z_OK || len != out_len)
+      vw_throw( IOErr() << "Corrupted point cloud file: " << file << "\n" );
+  }
+
+  // The size in bytes of one value of a given channel
+  size_t channel_value_size(int channel, int coord_type){
+    if (channel >= 3 || coord_type == asp::COORD_FLOAT32)
+      return sizeof(float);
+    if (coord_type == asp::COORD_QUANTIZED_INT32)
+      return sizeof(boost::int32_t);
+    return sizeof(double);
+  }
+
+  BBox2i block_box_helper(int block, int cols, int rows, int block_size){
+    int num_blocks_x = (cols + block_size - 1)/block_size;
+    int bx = block % num_blocks_x, by = block / num_blocks_x;
+    BBox2i box(bx*block_size, by*block_size, block_size, block_size);
+    box.crop(BBox2i(0, 0, cols, rows));
+    return box;
+  }
+
+} // end anonymous namespace
+
+bool asp::is_columnar_point_cloud(std::string const& file){
+  std::string ext = boost::filesystem::path(file).extension().string();
+  boost::algorithm::to_lower(ext);
+  return ext == columnar_point_cloud_extension();
+}
+
+//=============================================================================
+// Writer
+
+asp::ColumnarPointCloudWriter::ColumnarPointCloudWriter(std::string const& filename,
+                                                        int cols, int rows,
+                                                        int num_channels, int block_size,
+                                                        vw::Vector3 const& offset,
+                                                        double rounding_error,
+                                                        std::string const& georef_wkt):
+  m_filename(filename), m_cols(cols), m_rows(rows), m_num_channels(num_channels),
+  m_block_size(block_size), m_offset(offset), m_rounding_error(rounding_error),
+  m_georef_wkt(georef_wkt), m_closed(false) {
+
+  if (cols < 0 || rows < 0 || block_size <= 0 || num_channels < 3)
+    vw_throw( ArgumentErr() << "Invalid dimensions for point cloud: " << filename << "\n" );
+
+  int num_blocks = ((cols + block_size - 1)/block_size) * ((rows + block_size - 1)/block_size);
+  m_blocks.resize(num_blocks);
+  for (int b = 0; b < num_blocks; b++) {
+    ColumnarBlockInfo & info = m_blocks[b];
+    for (int i = 0; i < 3; i++) {
+      info.bbox_min[i] =  std::numeric_limits<double>::max();
+      info.bbox_max[i] = -std::numeric_limits<double>::max();
+    }
+    info.num_points = 0;
+    info.coord_type = COORD_FLOAT64;
+    info.offsets.resize(num_channels + 1, 0);
+    info.sizes.resize(num_channels + 1, 0);
+  }
+
+  m_file.open(filename.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+  if (!m_file.is_open())
+    vw_throw( IOErr() << "Unable to open " << filename << " for writing.\n" );
+
+  // Reserve space for the header, it will be written at the end
+  m_end = apc_prefix_size(m_georef_wkt) + num_blocks*apc_block_entry_size(num_channels);
+  std::string zeros(m_end, '\0');
+  m_file.write(zeros.data(), zeros.size());
+}
+
+asp::ColumnarPointCloudWriter::~ColumnarPointCloudWriter(){
+  if (!m_closed) {
+    try {
+      close();
+    } catch (...) {}
+  }
+}
+
+BBox2i asp::ColumnarPointCloudWriter::block_box(int block) const {
+  return block_box_helper(block, m_cols, m_rows, m_block_size);
+}
+
+void asp::ColumnarPointCloudWriter::write_block(int block, std::vector<double> const& values){
+
+  BBox2i box = block_box(block);
+  size_t num_pix = size_t(box.width())*box.height();
+  if (values.size() != num_pix*m_num_channels)
+    vw_throw( ArgumentErr() << "Wrong number of values for point cloud block.\n" );
+
+  ColumnarBlockInfo & info = m_blocks[block];
+
+  // Find the valid points and their bounding box
+  std::vector<boost::uint8_t> mask(num_pix, 0);
+  double max_dev = 0.0;
+  for (size_t p = 0; p < num_pix; p++) {
+    const double * pix = &values[p*m_num_channels];
+    if (pix[0] == 0 && pix[1] == 0 && pix[2] == 0)
+      continue;
+    mask[p] = 1;
+    info.num_points++;
+    for (int i = 0; i < 3; i++) {
+      info.bbox_min[i] = std::min(info.bbox_min[i], pix[i]);
+      info.bbox_max[i] = std::max(info.bbox_max[i], pix[i]);
+      max_dev = std::max(max_dev, std::abs(pix[i] - m_offset[i]));
+    }
+  }
+
+  // Decide how to store xyz. Fall back to doubles if the quantized
+  // values would overflow.
+  if (m_rounding_error > 0 &&
+      max_dev/m_rounding_error < double(std::numeric_limits<boost::int32_t>::max()) - 1)
+    info.coord_type = COORD_QUANTIZED_INT32;
+  else if (m_rounding_error <= 0 && m_offset != Vector3())
+    info.coord_type = COORD_FLOAT32;
+  else
+    info.coord_type = COORD_FLOAT64;
+
+  // Compress the mask and each channel separately
+  std::vector<std::string> buffers(m_num_channels + 1);
+  buffers[0] = compress_buffer(std::string(mask.begin(), mask.end()));
+  for (int c = 0; c < m_num_channels; c++) {
+    std::string raw;
+    raw.reserve(num_pix*channel_value_size(c, info.coord_type));
+    for (size_t p = 0; p < num_pix; p++) {
+      double val = mask[p] ? values[p*m_num_channels + c] : 0.0;
+      if (c >= 3) {
+        append_value(raw, float(val));
+        continue;
+      }
+      if (mask[p])
+        val -= m_offset[c];
+      if (info.coord_type == COORD_QUANTIZED_INT32)
+        append_value(raw, boost::int32_t(round(val/m_rounding_error)));
+      else if (info.coord_type == COORD_FLOAT32)
+        append_value(raw, float(val));
+      else
+        append_value(raw, val);
+    }
+    buffers[c+1] = compress_buffer(raw);
+  }
+
+  Mutex::Lock lock(m_mutex);
+  m_file.seekp(m_end);
+  for (size_t i = 0; i < buffers.size(); i++) {
+    info.offsets[i] = m_end;
+    info.sizes[i]   = buffers[i].size();
+    m_file.write(buffers[i].data(), buffers[i].size());
+    m_end += buffers[i].size();
+  }
+  if (!m_file.good())
+    vw_throw( IOErr() << "Failed writing to " << m_filename << "\n" );
+}
+
+void asp::ColumnarPointCloudWriter::close(){
+
+  Mutex::Lock lock(m_mutex);
+  if (m_closed)
+    return;
+  m_closed = true;
+
+  std::string header(APC_MAGIC, APC_MAGIC_LEN);
+  append_value(header, boost::int32_t(m_cols));
+  append_value(header, boost::int32_t(m_rows));
+  append_value(header, boost::int32_t(m_num_channels));
+  append_value(header, boost::int32_t(m_block_size));
+  for (int i = 0; i < 3; i++)
+    append_value(header, m_offset[i]);
+  append_value(header, m_rounding_error);
+  append_value(header, boost::uint64_t(m_georef_wkt.size()));
+  header.append(m_georef_wkt);
+
+  for (size_t b = 0; b < m_blocks.size(); b++) {
+    ColumnarBlockInfo const& info = m_blocks[b];
+    for (int i = 0; i < 3; i++) append_value(header, info.bbox_min[i]);
+    for (int i = 0; i < 3; i++) append_value(header, info.bbox_max[i]);
+    append_value(header, info.num_points);
+    append_value(header, info.coord_type);
+    append_array(header, info.offsets);
+    append_array(header, info.sizes);
+  }
+
+  m_file.seekp(0);
+  m_file.write(header.data(), header.size());
+  m_file.close();
+  if (m_file.fail())
+    vw_throw( IOErr() << "Failed writing to " << m_filename << "\n" );
+}
+
+//=============================================================================
+// Reader
+
+asp::ColumnarPointCloudReader::ColumnarPointCloudReader(std::string const& filename,
+                                                        double cache_size_mb):
+  m_filename(filename), m_cache_size_mb(cache_size_mb){
+
+  try {
+    m_file.open(filename);
+  } catch (std::exception const& e) {
+    vw_throw( IOErr() << "Unable to open point cloud " << filename << ": " << e.what() << "\n" );
+  }
+
+  const char * data = m_file.data();
+  size_t size = m_file.size();
+  bool is_v1 = (size >= APC_MAGIC_LEN && std::memcmp(data, APC_MAGIC_V1, APC_MAGIC_LEN) == 0);
+  if (size < APC_MAGIC_LEN || (!is_v1 && std::memcmp(data, APC_MAGIC, APC_MAGIC_LEN) != 0))
+    vw_throw( IOErr() << "Not a point cloud in the columnar format: " << filename << "\n" );
+
+  size_t pos = APC_MAGIC_LEN;
+  m_cols         = read_value<boost::int32_t>(data, size, pos, filename);
+  m_rows         = read_value<boost::int32_t>(data, size, pos, filename);
+  m_num_channels = read_value<boost::int32_t>(data, size, pos, filename);
+  m_block_size   = read_value<boost::int32_t>(data, size, pos, filename);
+  for (int i = 0; i < 3; i++)
+    m_offset[i]  = read_value<double>(data, size, pos, filename);
+  m_rounding_error = read_value<double>(data, size, pos, filename);
+  if (!is_v1) {
+    boost::uint64_t wkt_len = read_value<boost::uint64_t>(data, size, pos, filename);
+    if (pos + wkt_len > size)
+      vw_throw( IOErr() << "Truncated point cloud file: " << filename << "\n" );
+    m_georef_wkt = std::string(data + pos, wkt_len);
+    pos += wkt_len;
+  }
+
+  if (m_cols < 0 || m_rows < 0 || m_block_size <= 0 || m_num_channels < 3)
+    vw_throw( IOErr() << "Corrupted point cloud file: " << filename << "\n" );
+
+  int num_blocks = ((m_cols + m_block_size - 1)/m_block_size)
+    * ((m_rows + m_block_size - 1)/m_block_size);
+  m_blocks.resize(num_blocks);
+  for (int b = 0; b < num_blocks; b++) {
+    ColumnarBlockInfo & info = m_blocks[b];
+    for (int i = 0; i < 3; i++) info.bbox_min[i] = read_value<double>(data, size, pos, filename);
+    for (int i = 0; i < 3; i++) info.bbox_max[i] = read_value<double>(data, size, pos, filename);
+    info.num_points = read_value<boost::uint64_t>(data, size, pos, filename);
+    info.coord_type = read_value<boost::int32_t>(data, size, pos, filename);
+    info.offsets.resize(m_num_channels + 1);
+    info.sizes.resize(m_num_channels + 1);
+    for (int c = 0; c <= m_num_channels; c++)
+      info.offsets[c] = read_value<boost::uint64_t>(data, size, pos, filename);
+    for (int c = 0; c <= m_num_channels; c++) {
+      info.sizes[c] = read_value<boost::uint64_t>(data, size, pos, filename);
+      if (info.offsets[c] + info.sizes[c] > size)
+        vw_throw( IOErr() << "Truncated point cloud file: " << filename << "\n" );
+    }
+  }
+}
+
+BBox2i asp::ColumnarPointCloudReader::block_box(int block) const {
+  return block_box_helper(block, m_cols, m_rows, m_block_size);
+}
+
+BBox3 asp::ColumnarPointCloudReader::point_bbox() const {
+  BBox3 bbox;
+  for (size_t b = 0; b < m_blocks.size(); b++) {
+    if (m_blocks[b].num_points == 0)
+      continue;
+    bbox.grow(Vector3(m_blocks[b].bbox_min[0], m_blocks[b].bbox_min[1], m_blocks[b].bbox_min[2]));
+    bbox.grow(Vector3(m_blocks[b].bbox_max[0], m_blocks[b].bbox_max[1], m_blocks[b].bbox_max[2]));
+  }
+  return bbox;
+}
+
+boost::uint64_t asp::ColumnarPointCloudReader::num_points() const {
+  boost::uint64_t count = 0;
+  for (size_t b = 0; b < m_blocks.size(); b++)
+    count += m_blocks[b].num_points;
+  return count;
+}
+
+void asp::ColumnarPointCloudReader::decode_block(int block, int num_channels,
+                                                 std::vector<double> & values) const {
+
+  ColumnarBlockInfo const& info = m_blocks[block];
+  BBox2i box = block_box(block);
+  size_t num_pix = size_t(box.width())*box.height();
+  values.assign(num_pix*num_channels, 0.0);
+  if (info.num_points == 0)
+    return;
+
+  const char * data = m_file.data();
+  std::vector<char> mask, raw;
+  uncompress_buffer(data + info.offsets[0], info.sizes[0], num_pix, mask, m_filename);
+
+  // Only the channels we need are decompressed
+  for (int c = 0; c < num_channels; c++) {
+    size_t val_size = channel_value_size(c, info.coord_type);
+    uncompress_buffer(data + info.offsets[c+1], info.sizes[c+1], num_pix*val_size,
+                      raw, m_filename);
+    for (size_t p = 0; p < num_pix; p++) {
+      if (!mask[p])
+        continue;
+      const char * ptr = &raw[p*val_size];
+      double val;
+      if (c >= 3 || info.coord_type == COORD_FLOAT32) {
+        float f; std::memcpy(&f, ptr, sizeof(f)); val = f;
+      } else if (info.coord_type == COORD_QUANTIZED_INT32) {
+        boost::int32_t q; std::memcpy(&q, ptr, sizeof(q)); val = q*m_rounding_error;
+      } else {
+        std::memcpy(&val, ptr, sizeof(val));
+      }
+      if (c < 3)
+        val += m_offset[c];
+      values[p*num_channels + c] = val;
+    }
+  }
+}
+
+asp::ColumnarPointCloudReader::DecodedBlock
+asp::ColumnarPointCloudReader::cached_block(int block, int num_channels) const {
+
+  {
+    Mutex::Lock lock(m_cache_mutex);
+    for (std::list<DecodedBlock>::iterator it = m_cache.begin(); it != m_cache.end(); it++) {
+      if (it->block == block && it->num_channels >= num_channels) {
+        m_cache.splice(m_cache.begin(), m_cache, it); // now most recently used
+        return m_cache.front();
+      }
+    }
+  }
+
+  // Decode without holding the lock, so other threads can read other
+  // blocks meanwhile.
+  boost::shared_ptr< std::vector<double> > values(new std::vector<double>);
+  decode_block(block, num_channels, *values);
+  DecodedBlock decoded;
+  decoded.block        = block;
+  decoded.num_channels = num_channels;
+  decoded.values       = values;
+
+  // Keep at least one block, and the most recent ones up to the cache size
+  Mutex::Lock lock(m_cache_mutex);
+  m_cache.push_front(decoded);
+  double size_mb = 0;
+  std::list<DecodedBlock>::iterator it = m_cache.begin();
+  for (; it != m_cache.end(); it++) {
+    double block_mb = it->values->size()*sizeof(double)/(1024.0*1024.0);
+    if (it != m_cache.begin() && size_mb + block_mb > m_cache_size_mb)
+      break;
+    size_mb += block_mb;
+  }
+  m_cache.erase(it, m_cache.end());
+
+  return decoded;
+}
+
+void asp::ColumnarPointCloudReader::read_region(BBox2i const& region, int num_channels,
+                                                std::vector<double> & values) const {
+
+  if (num_channels < 1 || num_channels > m_num_channels)
+    vw_throw( ArgumentErr() << "Cannot read " << num_channels << " channels from "
+              << m_filename << "\n" );
+
+  values.assign(size_t(region.width())*region.height()*num_channels, 0.0);
+
+  BBox2i crop_region = region;
+  crop_region.crop(BBox2i(0, 0, m_cols, m_rows));
+  if (crop_region.empty())
+    return;
+
+  int num_blocks_x = (m_cols + m_block_size - 1)/m_block_size;
+  int bx0 = crop_region.min().x()/m_block_size, bx1 = (crop_region.max().x() - 1)/m_block_size;
+  int by0 = crop_region.min().y()/m_block_size, by1 = (crop_region.max().y() - 1)/m_block_size;
+
+  for (int by = by0; by <= by1; by++) {
+    for (int bx = bx0; bx <= bx1; bx++) {
+      int block = by*num_blocks_x + bx;
+      BBox2i box = block_box(block);
+      DecodedBlock decoded = cached_block(block, num_channels);
+      std::vector<double> const& block_values = *decoded.values;
+      int block_channels = decoded.num_channels;
+
+      BBox2i overlap = box;
+      overlap.crop(crop_region);
+      for (int row = overlap.min().y(); row < overlap.max().y(); row++) {
+        for (int col = overlap.min().x(); col < overlap.max().x(); col++) {
+          size_t src = (size_t(row - box.min().y())*box.width() + (col - box.min().x()))
+            *block_channels;
+          size_t dst = (size_t(row - region.min().y())*region.width() + (col - region.min().x()))
+            *num_channels;
+          for (int c = 0; c < num_channels; c++)
+            values[dst + c] = block_values[src + c];
+        }
+      }
+    }
+  }
+}
+
+vw::BBox3 asp::columnar_point_cloud_bbox(std::string const& file){
+  return ColumnarPointCloudReader(file).point_bbox();
+}
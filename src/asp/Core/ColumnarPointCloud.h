@@ -0,0 +1,314 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ColumnarPointCloud.h
+///
+/// A container for the point clouds produced by stereo_tri, as an
+/// alternative to the multi-channel -PC.tif. The cloud is split into
+/// square blocks. For each block the header stores the bounding box
+/// of its valid points and their count, so the bounding box of the
+/// whole cloud is known without reading any points. The header also
+/// keeps the georeference of the cloud, as WKT. Within a block,
+/// each channel is compressed separately. The xyz channels are stored
+/// relative to a given offset, as integers which are multiples of the
+/// rounding error, or as floats or doubles. Files are memory-mapped
+/// for reading.
+///
+/// As with -PC.tif, a pixel whose first three channels are zero is
+/// invalid.
+
+#ifndef __ASP_CORE_COLUMNAR_POINT_CLOUD_H__
+#define __ASP_CORE_COLUMNAR_POINT_CLOUD_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Math/Vector.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Image/Manipulation.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <fstream>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The extension of files in this format.
+  inline std::string columnar_point_cloud_extension(){ return ".apc"; }
+
+  /// Return true if the file name has the columnar point cloud extension.
+  bool is_columnar_point_cloud(std::string const& file);
+
+  /// How the xyz channels of a block are stored.
+  enum ColumnarCoordType { COORD_FLOAT32 = 0, COORD_QUANTIZED_INT32 = 1, COORD_FLOAT64 = 2 };
+
+  /// The description of one block of the cloud, stored in the file header.
+  struct ColumnarBlockInfo {
+    double          bbox_min[3], bbox_max[3]; // of the valid points, with the offset added back
+    boost::uint64_t num_points;               // number of valid points
+    boost::int32_t  coord_type;               // a ColumnarCoordType
+    // Offset and compressed size of the validity mask, followed by
+    // these for each channel.
+    std::vector<boost::uint64_t> offsets, sizes;
+  };
+
+  /// Write a point cloud one block at a time. Blocks can be written
+  /// in any order and from multiple threads. The block table is written
+  /// by close().
+  class ColumnarPointCloudWriter {
+  public:
+    /// If the rounding error is positive, the xyz channels minus the
+    /// offset are stored as integer multiples of it. Otherwise they are
+    /// stored as floats if the offset is non-zero, and as doubles if not.
+    /// The georeference, if any, is saved as WKT.
+    ColumnarPointCloudWriter(std::string const& filename, int cols, int rows,
+                             int num_channels, int block_size,
+                             vw::Vector3 const& offset, double rounding_error,
+                             std::string const& georef_wkt = "");
+    ~ColumnarPointCloudWriter();
+
+    int num_blocks() const { return m_blocks.size(); }
+    vw::BBox2i block_box(int block) const;
+
+    /// Write a block. The values are for the pixels of block_box(block),
+    /// row after row, with the channels of each pixel together.
+    void write_block(int block, std::vector<double> const& values);
+
+    void close();
+
+  private:
+    std::string     m_filename;
+    std::ofstream   m_file;
+    int             m_cols, m_rows, m_num_channels, m_block_size;
+    vw::Vector3     m_offset;
+    double          m_rounding_error;
+    std::string     m_georef_wkt;
+    boost::uint64_t m_end; // where the next block will go
+    std::vector<ColumnarBlockInfo> m_blocks;
+    vw::Mutex       m_mutex;
+    bool            m_closed;
+  };
+
+  /// Read a point cloud in the columnar format. It is safe to read
+  /// from multiple threads. The most recently decoded blocks are
+  /// kept, up to the given number of megabytes, so that reading a
+  /// block in several pieces decodes it only once.
+  class ColumnarPointCloudReader {
+  public:
+    ColumnarPointCloudReader(std::string const& filename, double cache_size_mb = 256);
+
+    int cols        () const { return m_cols;         }
+    int rows        () const { return m_rows;         }
+    int num_channels() const { return m_num_channels; }
+    int block_size  () const { return m_block_size;   }
+    vw::Vector3 offset() const { return m_offset;     }
+
+    /// The WKT of the georeference of the cloud, or empty if it has none.
+    std::string georef_wkt() const { return m_georef_wkt; }
+
+    int num_blocks() const { return m_blocks.size(); }
+    vw::BBox2i block_box(int block) const;
+    ColumnarBlockInfo const& block_info(int block) const { return m_blocks[block]; }
+
+    /// The bounding box of all valid points, from the header only.
+    vw::BBox3 point_bbox() const;
+
+    /// The number of valid points, from the header only.
+    boost::uint64_t num_points() const;
+
+    /// Decode the first num_channels channels of the pixels in the
+    /// given region into 'values', row after row, with the channels of
+    /// each pixel together. Invalid pixels are zero.
+    void read_region(vw::BBox2i const& region, int num_channels,
+                     std::vector<double> & values) const;
+
+  private:
+    /// A decoded block, with the first num_channels channels of each pixel.
+    struct DecodedBlock {
+      int block, num_channels;
+      boost::shared_ptr< const std::vector<double> > values;
+    };
+
+    void decode_block(int block, int num_channels, std::vector<double> & values) const;
+
+    /// Return a decoded block with at least num_channels channels,
+    /// from the cache if possible.
+    DecodedBlock cached_block(int block, int num_channels) const;
+
+    std::string m_filename;
+    boost::iostreams::mapped_file_source m_file;
+    int         m_cols, m_rows, m_num_channels, m_block_size;
+    vw::Vector3 m_offset;
+    double      m_rounding_error;
+    std::string m_georef_wkt;
+    std::vector<ColumnarBlockInfo> m_blocks;
+
+    // The decoded blocks, most recently used first
+    double                          m_cache_size_mb;
+    mutable std::list<DecodedBlock> m_cache;
+    mutable vw::Mutex               m_cache_mutex;
+  };
+
+  /// The bounding box of the valid points in a columnar point cloud,
+  /// read from its header.
+  vw::BBox3 columnar_point_cloud_bbox(std::string const& file);
+
+  /// An image view of the first m channels of a columnar point cloud.
+  template <int m>
+  class ColumnarPointCloudView: public vw::ImageViewBase< ColumnarPointCloudView<m> > {
+    boost::shared_ptr<ColumnarPointCloudReader> m_reader;
+  public:
+    typedef vw::Vector<double, m> pixel_type;
+    typedef pixel_type            result_type;
+    typedef vw::ProceduralPixelAccessor<ColumnarPointCloudView> pixel_accessor;
+
+    ColumnarPointCloudView(boost::shared_ptr<ColumnarPointCloudReader> reader):
+      m_reader(reader){
+      VW_ASSERT(1 <= m && m <= m_reader->num_channels(),
+                vw::ArgumentErr() << "Cannot read " << m << " channels from a point cloud with "
+                << m_reader->num_channels() << " channels.\n");
+    }
+
+    inline vw::int32 cols  () const { return m_reader->cols(); }
+    inline vw::int32 rows  () const { return m_reader->rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    /// The size of the blocks in the file. Rasterizing in regions
+    /// aligned to these avoids decoding a block more than once.
+    int block_size() const { return m_reader->block_size(); }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    // This is slow, even though the block of the pixel is cached. Rasterize instead.
+    inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p = 0 ) const {
+      std::vector<double> values;
+      m_reader->read_region(vw::BBox2i(i, j, 1, 1), m, values);
+      pixel_type pix;
+      for (int c = 0; c < m; c++) pix[c] = values[c];
+      return pix;
+    }
+
+    typedef vw::CropView< vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      std::vector<double> values;
+      m_reader->read_region(bbox, m, values);
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      size_t count = 0;
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          for (int c = 0; c < m; c++)
+            tile(col, row)[c] = values[count++];
+        }
+      }
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Open the first m channels of a columnar point cloud as an image.
+  template <int m>
+  ColumnarPointCloudView<m> read_columnar_point_cloud(std::string const& file){
+    boost::shared_ptr<ColumnarPointCloudReader> reader(new ColumnarPointCloudReader(file));
+    return ColumnarPointCloudView<m>(reader);
+  }
+
+  namespace columnar_point_cloud_private {
+
+    /// Rasterize and write one block of the cloud.
+    template <class ImageT>
+    class WriteBlockTask: public vw::Task, private boost::noncopyable {
+      ImageT const& m_image;
+      ColumnarPointCloudWriter & m_writer;
+      int m_block;
+      vw::ProgressCallback const& m_progress;
+      vw::Mutex & m_progress_mutex;
+      int & m_num_done;
+    public:
+      WriteBlockTask(ImageT const& image, ColumnarPointCloudWriter & writer, int block,
+                     vw::ProgressCallback const& progress, vw::Mutex & progress_mutex,
+                     int & num_done):
+        m_image(image), m_writer(writer), m_block(block), m_progress(progress),
+        m_progress_mutex(progress_mutex), m_num_done(num_done){}
+
+      virtual void operator()(){
+        typedef typename ImageT::pixel_type PixelT;
+        const int n = vw::math::VectorSize<PixelT>::value;
+        vw::BBox2i box = m_writer.block_box(m_block);
+        vw::ImageView<PixelT> tile = crop(m_image, box);
+        std::vector<double> values(size_t(box.width())*box.height()*n);
+        size_t count = 0;
+        for (int row = 0; row < tile.rows(); row++) {
+          for (int col = 0; col < tile.cols(); col++) {
+            for (int c = 0; c < n; c++)
+              values[count++] = tile(col, row)[c];
+          }
+        }
+        m_writer.write_block(m_block, values);
+
+        vw::Mutex::Lock lock(m_progress_mutex);
+        m_num_done++;
+        m_progress.report_fractional_progress(m_num_done, m_writer.num_blocks());
+      }
+    };
+  }
+
+  /// Write a point cloud image in the columnar format, rasterizing
+  /// the blocks with the given number of threads. The offset is
+  /// subtracted from the first three channels before saving them.
+  template <class ImageT>
+  void write_columnar_point_cloud(std::string const& filename,
+                                  vw::Vector3 const& offset, double rounding_error,
+                                  vw::ImageViewBase<ImageT> const& image,
+                                  int block_size, int num_threads,
+                                  vw::ProgressCallback const& progress,
+                                  std::string const& georef_wkt = ""){
+
+    typedef typename ImageT::pixel_type PixelT;
+    const int n = vw::math::VectorSize<PixelT>::value;
+    ColumnarPointCloudWriter writer(filename, image.impl().cols(), image.impl().rows(),
+                                    n, block_size, offset, rounding_error, georef_wkt);
+
+    vw::Mutex progress_mutex;
+    int num_done = 0;
+    progress.report_progress(0);
+    vw::FifoWorkQueue queue(std::max(num_threads, 1));
+    for (int block = 0; block < writer.num_blocks(); block++) {
+      boost::shared_ptr<columnar_point_cloud_private::WriteBlockTask<ImageT> >
+        task(new columnar_point_cloud_private::WriteBlockTask<ImageT>
+             (image.impl(), writer, block, progress, progress_mutex, num_done));
+      queue.add_task(task);
+    }
+    queue.join_all();
+    progress.report_finished();
+
+    writer.close();
+  }
+
+} // end namespace asp
+
+#endif
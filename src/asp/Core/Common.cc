@@ -27,6 +27,7 @@
 #include <string>
 #include <vector>
 #include <unistd.h>
+#include <sys/resource.h>
 
 #include <gdal_version.h>
 #include <proj_api.h>
@@ -219,6 +220,18 @@ std::string asp::current_posix_time_string() {
   return boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time());
 }
 
+// Peak resident memory. Linux reports ru_maxrss in KB, OSX in bytes.
+double asp::peak_memory_mb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.0;
+#ifdef __APPLE__
+  return double(usage.ru_maxrss)/(1024.0*1024.0);
+#else
+  return double(usage.ru_maxrss)/1024.0;
+#endif
+}
+
 // Unless user-specified, compute the rounding error for a given
 // planet (a point on whose surface is given by 'shift'). Return an
 // inverse power of 2, 1/2^10 for Earth and proportionally less for
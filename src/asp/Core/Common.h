@@ -81,6 +81,9 @@ namespace asp {
   /// Print time function
   std::string current_posix_time_string();
 
+  /// Return the peak resident memory used so far by the current process, in MB.
+  double peak_memory_mb();
+
   /// Run a system command and append the output to a given file
   void run_cmd_app_to_file(std::string cmd, std::string file);
 
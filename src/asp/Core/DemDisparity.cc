@@ -19,8 +19,13 @@
 /// \file DEMDisparity.cc
 ///
 
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/Settings.h>
 #include <vw/Image/ImageView.h>
 #include <vw/Image/Transform.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PerPixelViews.h>
+#include <vw/Image/BlockRasterize.h>
 #include <vw/Image/MaskViews.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Camera/CameraModel.h>
@@ -39,45 +44,112 @@ using namespace vw::cartography;
 
 namespace asp {
 
+  // The DEM disparity is computed as a single image whose pixels
+  // hold both the disparity (first two channels) and the disparity
+  // spread (last two channels). That way each tile is produced
+  // independently, without writing to shared state, and the
+  // disparity and spread are split only when saved to disk.
+  typedef PixelMask<Vector4i> DispSpreadPixT;
+
+  struct ExtractDisparity: public ReturnFixedType< PixelMask<Vector2f> > {
+    PixelMask<Vector2f> operator() (DispSpreadPixT const& pix) const {
+      PixelMask<Vector2f> out(pix.child()[0], pix.child()[1]);
+      if (!is_valid(pix)) out.invalidate();
+      return out;
+    }
+  };
+
+  struct ExtractSpread: public ReturnFixedType< PixelMask<Vector2i> > {
+    PixelMask<Vector2i> operator() (DispSpreadPixT const& pix) const {
+      PixelMask<Vector2i> out(pix.child()[2], pix.child()[3]);
+      if (!is_valid(pix)) out.invalidate();
+      return out;
+    }
+  };
+
   template <class ImageT, class DEMImageT>
   class DemDisparity : public ImageViewBase<DemDisparity<ImageT, DEMImageT> > {
     ImageT            m_left_image;
     double            m_dem_error;
     GeoReference      m_dem_georef;
     const DEMImageT & m_dem;
+    GeoReference      m_coarse_dem_georef;
+    ImageView<PixelMask<float> > const& m_coarse_dem;
     Vector2f          m_downsample_scale;
     boost::shared_ptr<camera::CameraModel> m_left_camera_model;
     boost::shared_ptr<camera::CameraModel> m_right_camera_model;
     bool            m_do_align;
     Matrix<double>  m_align_left_matrix, m_align_right_matrix;
     int             m_pixel_sample;
-    ImageView<PixelMask<Vector2i> > & m_disparity_spread;
+
+    // Intersect the ray through a given low-res left image pixel with
+    // the given DEM, starting from the given guess. Return false
+    // on failure.
+    template <class DemT>
+    bool intersect_ray(Vector2 const& left_lowres_pix,
+                       DemT const& dem, GeoReference const& dem_georef,
+                       Vector3 const& xyz_guess, double height_error_tol,
+                       Vector3 & left_camera_vec, Vector3 & xyz) const {
+
+      double max_abs_tol      = height_error_tol/4.0; // abs cost function change b/w iterations
+      double max_rel_tol      = 1e-14;                // rel cost function change b/w iterations
+      int    num_max_iter     = 50;
+      bool   treat_nodata_as_zero = false;
+
+      Vector2 left_fullres_pix = elem_quot(left_lowres_pix, m_downsample_scale);
+      if (m_do_align){
+        // Need to go to the image pixel in the untransformed image
+        left_fullres_pix = HomographyTransform(m_align_left_matrix).reverse(left_fullres_pix);
+      }
+
+      Vector3 left_camera_ctr;
+      try {
+        left_camera_ctr = m_left_camera_model->camera_center(left_fullres_pix);
+        left_camera_vec = m_left_camera_model->pixel_to_vector(left_fullres_pix);
+      } catch (...) {
+        return false;
+      }
+
+      bool has_intersection = false;
+      xyz = camera_pixel_to_dem_xyz(left_camera_ctr, left_camera_vec,
+                                    dem, dem_georef,
+                                    treat_nodata_as_zero,
+                                    has_intersection,
+                                    height_error_tol, max_abs_tol,
+                                    max_rel_tol, num_max_iter,
+                                    xyz_guess
+                                    );
+      return has_intersection && xyz != Vector3();
+    }
 
   public:
     DemDisparity( ImageViewBase<ImageT> const& left_image,
                   double dem_error, GeoReference dem_georef,
                   DEMImageT const& dem,
+                  GeoReference coarse_dem_georef,
+                  ImageView<PixelMask<float> > const& coarse_dem,
                   Vector2f const& downsample_scale,
                   boost::shared_ptr<camera::CameraModel> left_camera_model,
                   boost::shared_ptr<camera::CameraModel> right_camera_model,
                   bool do_align,
                   Matrix<double> const& align_left_matrix, Matrix<double> const& align_right_matrix,
-                  int pixel_sample, ImageView<PixelMask<Vector2i> > & disparity_spread)
+                  int pixel_sample)
       :m_left_image(left_image.impl()),
        m_dem_error(dem_error),
        m_dem_georef(dem_georef),
        m_dem(dem),
+       m_coarse_dem_georef(coarse_dem_georef),
+       m_coarse_dem(coarse_dem),
        m_downsample_scale(downsample_scale),
        m_left_camera_model(left_camera_model),
        m_right_camera_model(right_camera_model),
        m_do_align(do_align),
        m_align_left_matrix(align_left_matrix),
        m_align_right_matrix(align_right_matrix),
-       m_pixel_sample(pixel_sample),
-       m_disparity_spread(disparity_spread){}
+       m_pixel_sample(pixel_sample){}
 
     // Image View interface
-    typedef PixelMask<Vector2i> pixel_type;
+    typedef DispSpreadPixT pixel_type;
     typedef pixel_type result_type;
     typedef ProceduralPixelAccessor<DemDisparity> pixel_accessor;
 
@@ -95,76 +167,56 @@ namespace asp {
     typedef CropView<ImageView<pixel_type> > prerasterize_type;
     inline prerasterize_type prerasterize(BBox2i const& bbox) const {
 
-      prerasterize_type lowres_disparity = prerasterize_type(ImageView<pixel_type>(bbox.width(),
-                                                                                   bbox.height()),
-                                                             -bbox.min().x(), -bbox.min().y(),
-                                                             cols(), rows() );
-
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++){
-        for (int col = bbox.min().x(); col < bbox.max().x(); col++){
-          lowres_disparity(col, row).invalidate();
-          m_disparity_spread(col, row).invalidate();
+      // The output tile, holding both the disparity and its spread.
+      // All pixels start as invalid.
+      ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      for (int col = 0; col < tile.cols(); col++){
+        for (int row = 0; row < tile.rows(); row++){
+          tile(col, row).invalidate();
         }
       }
 
       double height_error_tol = std::max(m_dem_error/4.0, 1.0); // height error in meters
-      double max_abs_tol      = height_error_tol/4.0; // abs cost function change b/w iterations
-      double max_rel_tol      = 1e-14;                // rel cost function change b/w iterations
-      int    num_max_iter     = 50;
-      bool   treat_nodata_as_zero = false;
-
-      Vector3 prev_xyz;
 
       // Estimate the DEM region we expect to use and crop it into an
-      // ImageView.  This will make the algorithm much faster than
-      // accessing individual DEM pixels from disk. To do that, find
-      // the pixel values on a small set of points of the diagonals of
-      // the current tile.
-
-      std::vector<Vector2> diagonals;
-      int wid = bbox.width() - 1, hgt = bbox.height() - 1, dim = std::max(1, std::max(wid, hgt)/10);
-      for (int i = 0; i <= dim; i++)
-        diagonals.push_back(bbox.min() + Vector2(double(i)*wid/dim, double(i)*hgt/dim));
-      for (int i = 0; i <= dim; i++)
-        diagonals.push_back(bbox.min() + Vector2(double(i)*wid/dim, hgt - double(i)*hgt/dim));
-
+      // ImageView. This will make the algorithm much faster than
+      // accessing individual DEM pixels from disk. To do that,
+      // intersect in bulk the rays through a coarse grid of pixels
+      // in the current tile with the coarse in-memory DEM. Each ray
+      // is seeded with the solution of its neighbor.
+      int wid = bbox.width() - 1, hgt = bbox.height() - 1;
+      int num = std::max(1, std::max(wid, hgt)/10);
+      // The tolerance is in meters. If the coarse DEM is in degrees,
+      // convert its pixel size to meters along the equator.
+      double coarse_pixel_size = std::abs(m_coarse_dem_georef.transform()(0, 0));
+      if (!m_coarse_dem_georef.is_projected())
+        coarse_pixel_size *= 2.0*M_PI*m_coarse_dem_georef.datum().semi_major_axis()/360.0;
+      double coarse_tol = std::max(height_error_tol, coarse_pixel_size);
       BBox2i dem_box;
-      for (unsigned k = 0; k < diagonals.size(); k++){
-
-        Vector2 left_lowres_pix = diagonals[k];
-
-        Vector2 left_fullres_pix = elem_quot(left_lowres_pix, m_downsample_scale);
-        if (m_do_align){
-          // Need to go to the image pixel in the untransformed image
-          left_fullres_pix = HomographyTransform(m_align_left_matrix).reverse(left_fullres_pix);
-        }
+      Vector3 prev_xyz;
+      for (int i = 0; i <= num; i++){
+        for (int j = 0; j <= num; j++){
+
+          // Traverse in a serpentine order, so that consecutive
+          // samples are always neighbors.
+          int jj = (i%2 == 0) ? j : num - j;
+          Vector2 left_lowres_pix = bbox.min() + Vector2(double(jj)*wid/num,
+                                                         double(i)*hgt/num);
+          Vector3 left_camera_vec, xyz;
+          if (!intersect_ray(left_lowres_pix, m_coarse_dem, m_coarse_dem_georef,
+                             prev_xyz, coarse_tol, left_camera_vec, xyz))
+            continue;
+          prev_xyz = xyz;
 
-        bool has_intersection;
-        Vector3 left_camera_ctr, left_camera_vec;
-        try {
-          left_camera_ctr = m_left_camera_model->camera_center(left_fullres_pix);
-          left_camera_vec = m_left_camera_model->pixel_to_vector(left_fullres_pix);
-        } catch (...) {
-          continue;
+          Vector3 llh = m_dem_georef.datum().cartesian_to_geodetic( xyz );
+          Vector2 pix = round(m_dem_georef.lonlat_to_pixel(subvector(llh, 0, 2)));
+          dem_box.grow(pix);
         }
-        Vector3 xyz = camera_pixel_to_dem_xyz(left_camera_ctr, left_camera_vec,
-                                              m_dem, m_dem_georef,
-                                              treat_nodata_as_zero,
-                                              has_intersection,
-                                              height_error_tol, max_abs_tol,
-                                              max_rel_tol, num_max_iter,
-                                              prev_xyz
-                                              );
-        if ( !has_intersection || xyz == Vector3() ) continue;
-        prev_xyz = xyz;
-
-        Vector3 llh = m_dem_georef.datum().cartesian_to_geodetic( xyz );
-        Vector2 pix = round(m_dem_georef.lonlat_to_pixel(subvector(llh, 0, 2)));
-        dem_box.grow(pix);
       }
 
       // Expand the DEM box just in case as the above calculation is
-      // not fool-proof if the DEM has a lot of no-data regions.
+      // not fool-proof if the DEM has a lot of no-data regions. Also
+      // account for the coarse DEM having a lower resolution.
       int expand = std::max(100, (int)(0.1*std::max(dem_box.width(), dem_box.height())));
       dem_box.expand(expand);
       dem_box.crop(bounding_box(m_dem));
@@ -173,43 +225,31 @@ namespace asp {
       GeoReference georef_crop = crop(m_dem_georef, dem_box);
       ImageView <PixelMask<float> > dem_crop = crop(m_dem, dem_box);
 
-      // Compute the DEM disparity. Use one in every 'm_pixel_sample' pixels.
+      // The solutions in the previous sampled row, used as initial
+      // guesses for the current row.
+      std::vector<Vector3> prev_row_xyz(bbox.width());
 
+      // Compute the DEM disparity. Use one in every 'm_pixel_sample' pixels.
       for (int row = bbox.min().y(); row < bbox.max().y(); row++){
         if (row%m_pixel_sample != 0) continue;
 
-        // Must wipe the previous guess since we are now too far from it
         prev_xyz = Vector3();
-
         for (int col = bbox.min().x(); col < bbox.max().x(); col++){
           if (col%m_pixel_sample != 0) continue;
 
-          Vector2 left_lowres_pix = Vector2(col, row);
+          // Seed from the left neighbor if it was solved, else from
+          // the neighbor in the row above.
+          Vector3 & above_xyz = prev_row_xyz[col - bbox.min().x()];
+          Vector3 xyz_guess = (prev_xyz != Vector3()) ? prev_xyz : above_xyz;
 
-          Vector2 left_fullres_pix = elem_quot(left_lowres_pix, m_downsample_scale);
-          if (m_do_align){
-            // Need to go to the image pixel in the untransformed image
-            left_fullres_pix = HomographyTransform(m_align_left_matrix).reverse(left_fullres_pix);
-          }
-
-          bool has_intersection;
-          Vector3 left_camera_ctr, left_camera_vec;
-          try {
-            left_camera_ctr = m_left_camera_model->camera_center(left_fullres_pix);
-            left_camera_vec = m_left_camera_model->pixel_to_vector(left_fullres_pix);
-          } catch (...) {
-            continue;
-          }
-          Vector3 xyz = camera_pixel_to_dem_xyz(left_camera_ctr, left_camera_vec,
-                                                dem_crop, georef_crop,
-                                                treat_nodata_as_zero,
-                                                has_intersection,
-                                                height_error_tol, max_abs_tol,
-                                                max_rel_tol, num_max_iter,
-                                                prev_xyz
-                                                );
-          if ( !has_intersection || xyz == Vector3() ) continue;
-          prev_xyz = xyz;
+          Vector2 left_lowres_pix = Vector2(col, row);
+          Vector3 left_camera_vec, xyz;
+          bool success = intersect_ray(left_lowres_pix, dem_crop, georef_crop,
+                                       xyz_guess, height_error_tol, left_camera_vec, xyz);
+          // Wipe the guess from above if we failed, as it is now stale
+          above_xyz = success ? xyz : Vector3();
+          prev_xyz  = success ? xyz : Vector3();
+          if (!success) continue;
 
           // Since our DEM is only known approximately, the true
           // intersection point of the ray coming from the left camera
@@ -219,7 +259,7 @@ namespace asp {
 
           ImageView< PixelMask<Vector2> > curr_pixel_disp_range(3, 1);
           double bias[] = {-1.0, 1.0, 0.0};
-          int success[] = {0, 0, 0};
+          int success_vec[] = {0, 0, 0};
 
           for (int k = 0; k < curr_pixel_disp_range.cols(); k++){
 
@@ -236,23 +276,25 @@ namespace asp {
 
             Vector2 right_lowres_pix = elem_prod(right_fullres_pix, m_downsample_scale);
             curr_pixel_disp_range(k, 0) = right_lowres_pix - left_lowres_pix;
-            success[k] = 1;
+            success_vec[k] = 1;
 
             // If the disparities at the endpoints of the range were successful,
             // don't bother with the middle estimate.
-            if (k == 1 && success[0] && success[1]) break;
+            if (k == 1 && success_vec[0] && success_vec[1]) break;
           }
 
           BBox2f search_range = stereo::get_disparity_range(curr_pixel_disp_range);
           if (search_range ==  BBox2f(0,0,0,0)) continue;
 
-          lowres_disparity(col, row) = round( (search_range.min() + search_range.max())/2.0 );
-          m_disparity_spread(col, row) = ceil( (search_range.max() - search_range.min())/2.0 );
-
+          Vector2 disp   = round( (search_range.min() + search_range.max())/2.0 );
+          Vector2 spread = ceil( (search_range.max() - search_range.min())/2.0 );
+          pixel_type & out = tile(col - bbox.min().x(), row - bbox.min().y());
+          out = pixel_type(Vector4i(int(disp[0]),   int(disp[1]),
+                                    int(spread[0]), int(spread[1])));
         }
       }
 
-      return lowres_disparity;
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
     }
 
     template <class DestT>
@@ -266,22 +308,24 @@ namespace asp {
   dem_disparity( ImageViewBase<ImageT> const& left,
                  double dem_error, GeoReference dem_georef,
                  DEMImageT const& dem,
+                 GeoReference coarse_dem_georef,
+                 ImageView<PixelMask<float> > const& coarse_dem,
                  Vector2f const& downsample_scale,
                  boost::shared_ptr<camera::CameraModel> left_camera_model,
                  boost::shared_ptr<camera::CameraModel> right_camera_model,
                  bool do_align,
                  Matrix<double> const& align_left_matrix,
                  Matrix<double> const& align_right_matrix,
-                 int pixel_sample,
-                 ImageView<PixelMask<Vector2i> > & disparity_spread
+                 int pixel_sample
                  ) {
     typedef DemDisparity<ImageT, DEMImageT> return_type;
     return return_type( left.impl(),
                         dem_error, dem_georef,
-                        dem, downsample_scale,
+                        dem, coarse_dem_georef, coarse_dem,
+                        downsample_scale,
                         left_camera_model, right_camera_model,
                         do_align, align_left_matrix, align_right_matrix,
-                        pixel_sample, disparity_spread
+                        pixel_sample
                         );
   }
 
@@ -344,41 +388,54 @@ namespace asp {
       vw_out(DebugMessage,"asp") << "Right alignment matrix: " << align_right_matrix << "\n";
     }
 
+    // Keep in memory a coarse version of the DEM. It is used to
+    // quickly estimate, for each tile, the region of the full DEM
+    // to read.
+    int max_coarse_dem_size = 1024;
+    int coarse_factor = std::max(1, (int)ceil(double(std::max(dem.cols(), dem.rows()))
+                                              /max_coarse_dem_size));
+    GeoReference coarse_dem_georef = resample(dem_georef, 1.0/coarse_factor);
+    ImageView<PixelMask<float> > coarse_dem = subsample(dem, coarse_factor);
+
     // Smaller tiles is better
     Vector2 orig_tile_size = opt.raster_tile_size;
     opt.raster_tile_size = Vector2i(64, 64);
 
-    // This image is small enough that we can keep it in memory
-    ImageView<PixelMask<Vector2i> > disparity_spread(left_image_sub.cols(), left_image_sub.rows());
-
-    ImageViewRef<PixelMask<Vector2f> > lowres_disparity
-      = pixel_cast<PixelMask<Vector2f> >(dem_disparity(left_image_sub,
-                                                       dem_error, dem_georef,
-                                                       dem, downsample_scale,
-                                                       left_camera_model, right_camera_model,
-                                                       do_align,
-                                                       align_left_matrix, align_right_matrix,
-                                                       pixel_sample, disparity_spread
-                                                       ));
+    // Compute the disparity and spread together. This image is small
+    // enough that we can keep it in memory. ISIS does not support
+    // multi-threading.
+    int num_threads = vw_settings().default_num_threads();
+    if (session_name == "isis")
+      num_threads = 1;
+
+    Stopwatch sw;
+    sw.start();
+    ImageView<DispSpreadPixT> disp_and_spread
+      = block_rasterize(dem_disparity(left_image_sub,
+                                      dem_error, dem_georef, dem,
+                                      coarse_dem_georef, coarse_dem,
+                                      downsample_scale,
+                                      left_camera_model, right_camera_model,
+                                      do_align,
+                                      align_left_matrix, align_right_matrix,
+                                      pixel_sample
+                                      ),
+                        opt.raster_tile_size, num_threads);
+    sw.stop();
+    vw_out() << "Low-resolution disparity from DEM computation time: "
+             << sw.elapsed_seconds() << " seconds.\n";
+
     std::string disparity_file = opt.out_prefix + "-D_sub.tif";
     vw_out() << "Writing low-resolution disparity: " << disparity_file << "\n";
-    if ( session_name == "isis" ){
-      // ISIS does not support multi-threading
-      boost::scoped_ptr<DiskImageResource> drsrc( vw::cartography::build_gdal_rsrc( disparity_file,
-                                                                        lowres_disparity, opt ) );
-      write_image(*drsrc, lowres_disparity,
-                  TerminalProgressCallback("asp", "\t--> Low-resolution disparity: "));
-    }else{
-      vw::cartography::block_write_gdal_image( disparity_file,
-                                   lowres_disparity,
-                                   opt,
-                                   TerminalProgressCallback("asp", "\t--> Low-resolution disparity:") );
-    }
+    vw::cartography::block_write_gdal_image( disparity_file,
+                                 per_pixel_filter(disp_and_spread, ExtractDisparity()),
+                                 opt,
+                                 TerminalProgressCallback("asp", "\t--> Low-resolution disparity:") );
 
     std::string disp_spread_file = opt.out_prefix + "-D_sub_spread.tif";
     vw_out() << "Writing low-resolution disparity spread: " << disp_spread_file << "\n";
     vw::cartography::block_write_gdal_image( disp_spread_file,
-                                 disparity_spread,
+                                 per_pixel_filter(disp_and_spread, ExtractSpread()),
                                  opt,
                                  TerminalProgressCallback("asp", "\t--> Low-resolution disparity spread:") );
 
@@ -0,0 +1,270 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ImagePyramid.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/AntiAliasing.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/Cartography/GeoReference.h>
+#include <asp/Core/ImagePyramid.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+using namespace vw;
+namespace fs = boost::filesystem;
+
+namespace {
+
+  // Bump this when the way the levels are made changes.
+  const int IMAGE_PYRAMID_VERSION = 1;
+
+  const char * INDEX_FILE = "pyramid.txt";
+
+  // Used for levels when the image has no nodata value
+  const double DEFAULT_NODATA = -32768.0;
+
+  // Format a hash as a fixed-width hex string
+  std::string hash_to_string(size_t hash){
+    std::ostringstream os;
+    os << std::hex << std::setw(2*sizeof(size_t)) << std::setfill('0') << hash;
+    return os.str();
+  }
+}
+
+namespace asp {
+
+std::string file_content_hash(std::string const& file){
+
+  std::ifstream fh(file.c_str(), std::ios::binary);
+  if (!fh)
+    vw_throw(IOErr() << "Cannot read: " << file << "\n");
+  fh.seekg(0, std::ios::end);
+  boost::int64_t size = fh.tellg();
+
+  // Any byte may differ between two runs, as with a different crop or
+  // normalization, so all of them are hashed. Whole 8-byte words are
+  // hashed at a time, for speed.
+  const size_t CHUNK = 1<<20;
+  size_t hash = 0;
+  boost::hash_combine(hash, size);
+  std::vector<boost::uint64_t> buf(CHUNK/sizeof(boost::uint64_t));
+  fh.seekg(0);
+  while (fh) {
+    fh.read(reinterpret_cast<char*>(&buf[0]), CHUNK);
+    size_t num_read = fh.gcount();
+    if (num_read == 0)
+      break;
+    size_t num_words = num_read/sizeof(boost::uint64_t);
+    boost::hash_combine(hash, boost::hash_range(buf.begin(), buf.begin() + num_words));
+    const char * tail = reinterpret_cast<const char*>(&buf[0]) + num_words*sizeof(boost::uint64_t);
+    boost::hash_combine(hash, boost::hash_range(tail, tail + num_read % sizeof(boost::uint64_t)));
+  }
+
+  return hash_to_string(hash);
+}
+
+std::string file_stamp_hash(std::string const& file){
+  if (!fs::exists(file))
+    vw_throw(IOErr() << "Cannot read: " << file << "\n");
+  size_t hash = 0;
+  boost::hash_combine(hash, fs::absolute(file).string());
+  boost::hash_combine(hash, boost::int64_t(fs::file_size(file)));
+  boost::hash_combine(hash, boost::int64_t(fs::last_write_time(file)));
+  return hash_to_string(hash);
+}
+
+ImagePyramid::ImagePyramid(std::string const& image_file, std::string const& mask_file,
+                           std::string const& cache_dir, int min_size, bool hash_contents,
+                           vw::cartography::GdalWriteOptions const& opt):
+  m_image_file(image_file), m_mask_file(mask_file){
+
+  m_nodata = DEFAULT_NODATA;
+  double nodata;
+  if (vw::read_nodata_val(image_file, nodata))
+    m_nodata = nodata;
+
+  // The mask is part of what the levels are made from
+  std::string hash;
+  if (hash_contents) {
+    hash = "content-" + file_content_hash(image_file);
+    if (!mask_file.empty())
+      hash += "-" + file_content_hash(mask_file);
+  }else{
+    hash = "stamp-" + file_stamp_hash(image_file);
+    if (!mask_file.empty())
+      hash += "-" + file_stamp_hash(mask_file);
+  }
+  m_dir = (fs::path(cache_dir) / hash).string();
+
+  if (read_index()) {
+    vw_out() << "\t--> Using the image pyramid in: " << m_dir << "\n";
+    return;
+  }
+  build(min_size, opt);
+}
+
+std::string ImagePyramid::level_file(int level) const {
+  return level_file_in(m_dir, level);
+}
+
+std::string ImagePyramid::level_file_in(std::string const& dir, int level) const {
+  if (level == 0)
+    return m_image_file;
+  return dir + "/level-" + boost::lexical_cast<std::string>(level) + ".tif";
+}
+
+double ImagePyramid::level_scale(int level) const {
+  return 0.5*( double(m_sizes[level].x())/m_sizes[0].x() +
+               double(m_sizes[level].y())/m_sizes[0].y() );
+}
+
+int ImagePyramid::level_for_scale(double scale) const {
+  int level = 0;
+  while (level + 1 < num_levels() && level_scale(level + 1) >= scale)
+    level++;
+  return level;
+}
+
+ImagePyramid::MaskedImageType ImagePyramid::masked_level(int level) const {
+  DiskImageView< PixelGray<float> > img(level_file(level));
+  if (level == 0 && !m_mask_file.empty())
+    return copy_mask(img, create_mask(DiskImageView<uint8>(m_mask_file)));
+  return create_mask(img, m_nodata);
+}
+
+// The index has the version, the nodata value, and the size of each
+// level. It must agree with the image, and all levels must exist.
+bool ImagePyramid::read_index(){
+
+  m_sizes.clear();
+  std::ifstream fh((m_dir + "/" + INDEX_FILE).c_str());
+  int version = -1, num_levels = 0;
+  double nodata = 0.0;
+  if (!(fh >> version >> nodata >> num_levels) || version != IMAGE_PYRAMID_VERSION)
+    return false;
+
+  for (int level = 0; level < num_levels; level++) {
+    Vector2i size;
+    if (!(fh >> size[0] >> size[1]))
+      return false;
+    m_sizes.push_back(size);
+  }
+
+  try {
+    for (int level = 0; level < num_levels; level++) {
+      DiskImageView<float> img(level_file(level));
+      if (img.cols() != m_sizes[level].x() || img.rows() != m_sizes[level].y())
+        return false;
+    }
+  } catch (...) {
+    return false;
+  }
+
+  m_nodata = nodata;
+  return num_levels > 0;
+}
+
+void ImagePyramid::build(int min_size, vw::cartography::GdalWriteOptions const& opt){
+
+  // Write in a temporary directory, renamed when done
+  std::string build_dir = fs::unique_path(m_dir + "-tmp-%%%%%%%%").string();
+  fs::create_directories(build_dir);
+  vw_out() << "\t--> Writing the image pyramid in: " << m_dir << "\n";
+
+  cartography::GeoReference georef;
+  bool has_georef = cartography::read_georeference(georef, m_image_file);
+  bool has_nodata = true;
+
+  // Enforce no predictor in compression, it works badly with sub-images
+  vw::cartography::GdalWriteOptions opt_nopred = opt;
+  opt_nopred.gdal_options["PREDICTOR"] = "1";
+
+  DiskImageView<float> img(m_image_file);
+  m_sizes.clear();
+  m_sizes.push_back(Vector2i(img.cols(), img.rows()));
+
+  // Each level is made from the previous one, so the full image is read only once
+  int level = 0;
+  while (std::max(m_sizes[level].x(), m_sizes[level].y()) > min_size &&
+         std::min(m_sizes[level].x(), m_sizes[level].y()) >= 2) {
+
+    DiskImageView< PixelGray<float> > prev(level_file_in(build_dir, level));
+    MaskedImageType prev_masked;
+    if (level == 0 && !m_mask_file.empty())
+      prev_masked = copy_mask(prev, create_mask(DiskImageView<uint8>(m_mask_file)));
+    else
+      prev_masked = create_mask(prev, m_nodata);
+    MaskedImageType sub = resample_aa(prev_masked, 0.5);
+    level++;
+
+    cartography::GeoReference sub_georef;
+    if (has_georef)
+      sub_georef = resample(georef, 0.5*( double(sub.cols())/m_sizes[0].x() +
+                                          double(sub.rows())/m_sizes[0].y() ));
+
+    std::string tag = "\t    Level " + boost::lexical_cast<std::string>(level) + ": ";
+    vw::cartography::block_write_gdal_image(level_file_in(build_dir, level),
+                                            apply_mask(sub, m_nodata),
+                                            has_georef, sub_georef,
+                                            has_nodata, m_nodata,
+                                            opt_nopred, TerminalProgressCallback("asp", tag));
+    m_sizes.push_back(Vector2i(sub.cols(), sub.rows()));
+  }
+
+  std::string index = build_dir + "/" + INDEX_FILE;
+  {
+    std::ofstream fh(index.c_str());
+    fh.precision(17);
+    fh << IMAGE_PYRAMID_VERSION << "\n" << m_nodata << "\n" << m_sizes.size() << "\n";
+    for (size_t it = 0; it < m_sizes.size(); it++)
+      fh << m_sizes[it].x() << " " << m_sizes[it].y() << "\n";
+    if (!fh)
+      vw_throw(IOErr() << "Failed writing: " << index << "\n");
+  }
+
+  // Publish the pyramid. Another process may have published the same
+  // one meanwhile, and then that one is used. A pyramid from an older
+  // version is replaced.
+  std::vector<Vector2i> sizes = m_sizes;
+  if (fs::exists(m_dir) && !read_index())
+    fs::remove_all(m_dir);
+  try {
+    fs::rename(build_dir, m_dir);
+  } catch (fs::filesystem_error const& e) {
+    fs::remove_all(build_dir);
+    if (!read_index())
+      vw_throw(IOErr() << "Could not write the image pyramid in: " << m_dir << "\n");
+    return;
+  }
+  m_sizes = sizes;
+}
+
+} // end namespace asp
@@ -0,0 +1,104 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ImagePyramid.h
+///
+/// A multi-level pyramid of an image, written to disk once and read by
+/// any tool needing the image at a lower resolution. Each level is a
+/// tiled GeoTIFF half the size of the previous one, with invalid
+/// pixels set to nodata. Level 0 is the image itself.
+///
+/// The pyramid is kept in a subdirectory of a cache directory named
+/// after a hash of the image path, size, and modification time, so it
+/// is reused as long as the image does not change. Optionally, a hash
+/// of the image contents is used instead, so that the pyramid is also
+/// reused by later runs producing the same image, even under a
+/// different name, at the cost of reading the whole image. The levels
+/// are written in a temporary directory which is renamed when complete,
+/// so processes sharing the cache directory never see a partial pyramid.
+
+#ifndef __ASP_CORE_IMAGE_PYRAMID_H__
+#define __ASP_CORE_IMAGE_PYRAMID_H__
+
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  class ImagePyramid {
+  public:
+
+    typedef vw::ImageViewRef< vw::PixelMask< vw::PixelGray<float> > > MaskedImageType;
+
+    /// Open the pyramid of the given image in the cache directory,
+    /// building it first if missing. Pixels are invalid where the
+    /// mask file, if not empty, is zero, or where the image equals
+    /// its nodata value. Levels are made until the larger dimension
+    /// is no more than min_size. If hash_contents is true, the pyramid
+    /// is looked up by the contents of the image rather than by its
+    /// path and timestamp.
+    ImagePyramid(std::string const& image_file, std::string const& mask_file,
+                 std::string const& cache_dir, int min_size, bool hash_contents,
+                 vw::cartography::GdalWriteOptions const& opt);
+
+    /// The number of levels, including the image itself.
+    int num_levels() const { return m_sizes.size(); }
+
+    /// The file of a level. Level 0 is the input image.
+    std::string level_file(int level) const;
+
+    vw::Vector2i level_size(int level) const { return m_sizes[level]; }
+
+    /// The size of a level relative to the image, averaged over the two dimensions.
+    double level_scale(int level) const;
+
+    /// The coarsest level whose scale is at least the given one.
+    int level_for_scale(double scale) const;
+
+    /// A level with its invalid pixels masked.
+    MaskedImageType masked_level(int level) const;
+
+    /// The directory having the levels.
+    std::string const& dir() const { return m_dir; }
+
+  private:
+
+    bool read_index();
+    void build(int min_size, vw::cartography::GdalWriteOptions const& opt);
+    std::string level_file_in(std::string const& dir, int level) const;
+
+    std::string m_image_file, m_mask_file, m_dir;
+    std::vector<vw::Vector2i> m_sizes;
+    double m_nodata;
+  };
+
+  /// A hash of the size and of all the bytes of a file, as a hex
+  /// string. This reads the whole file.
+  std::string file_content_hash(std::string const& file);
+
+  /// A hash of the absolute path, size, and modification time of a
+  /// file, as a hex string. This does not read the file.
+  std::string file_stamp_hash(std::string const& file);
+
+} // end namespace asp
+
+#endif
@@ -0,0 +1,229 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file PixelQuantiles.cc
+///
+
+#include <asp/Core/PixelQuantiles.h>
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace {
+
+  const int NUM_MARKERS = 5;
+
+  // The desired position of each P^2 marker is 1 + (count - 1)*increment.
+  void marker_increments(double quantile, double * increments){
+    increments[0] = 0.0;
+    increments[1] = quantile/2.0;
+    increments[2] = quantile;
+    increments[3] = (1.0 + quantile)/2.0;
+    increments[4] = 1.0;
+  }
+
+  // Linearly interpolate between the order statistics of sorted values.
+  double exact_quantile(std::vector<double> const& sorted, double quantile){
+    double pos = quantile*(sorted.size() - 1);
+    int lo = std::max(0, std::min(int(floor(pos)), int(sorted.size()) - 1));
+    int hi = std::min(lo + 1, int(sorted.size()) - 1);
+    return sorted[lo] + (pos - lo)*(sorted[hi] - sorted[lo]);
+  }
+}
+
+namespace asp {
+
+PixelQuantiles::PixelQuantiles(int num_pixels, std::vector<double> const& quantiles,
+                               int max_exact):
+  m_quantiles(quantiles), m_max_exact(std::max(max_exact, NUM_MARKERS)){
+
+  for (size_t it = 0; it < m_quantiles.size(); it++) {
+    if (m_quantiles[it] < 0.0 || m_quantiles[it] > 1.0)
+      vw_throw(ArgumentErr() << "Quantiles must be between 0 and 1.\n");
+  }
+
+  m_stride = std::max(m_max_exact, int(2*NUM_MARKERS*m_quantiles.size()));
+  m_counts.resize(num_pixels, 0);
+  m_data.resize(size_t(num_pixels)*m_stride, 0.0f);
+}
+
+double PixelQuantiles::bytes_per_pixel(int num_quantiles, int max_exact){
+  int stride = std::max(std::max(max_exact, NUM_MARKERS), 2*NUM_MARKERS*num_quantiles);
+  return sizeof(float)*stride + sizeof(int);
+}
+
+void PixelQuantiles::add(int pixel, double val){
+
+  int & count = m_counts[pixel];
+  float * data = &m_data[size_t(pixel)*m_stride];
+
+  if (count < m_max_exact) {
+    data[count] = val;
+    count++;
+    return;
+  }
+
+  if (count == m_max_exact) {
+    start_estimates(pixel, val);
+    count++;
+    return;
+  }
+
+  count++;
+  for (size_t it = 0; it < m_quantiles.size(); it++)
+    update_estimate(data + 2*NUM_MARKERS*it, m_quantiles[it], count, val);
+}
+
+// Switch from exact values to estimates. Place the markers at the
+// order statistics of the values seen so far, then add the new value.
+void PixelQuantiles::start_estimates(int pixel, double val){
+
+  float * data = &m_data[size_t(pixel)*m_stride];
+  int count = m_counts[pixel];
+  std::vector<double> sorted(data, data + count);
+  std::sort(sorted.begin(), sorted.end());
+
+  double increments[NUM_MARKERS];
+  for (size_t it = 0; it < m_quantiles.size(); it++) {
+    float * heights   = data + 2*NUM_MARKERS*it;
+    float * positions = heights + NUM_MARKERS;
+    marker_increments(m_quantiles[it], increments);
+    for (int i = 0; i < NUM_MARKERS; i++) {
+      // Positions are 1-based and must be strictly increasing
+      int pos = int(round(1.0 + (count - 1)*increments[i]));
+      int prev = (i == 0) ? 0 : int(positions[i-1]);
+      pos = std::max(pos, prev + 1);
+      pos = std::min(pos, count - (NUM_MARKERS - 1 - i));
+      positions[i] = pos;
+      heights[i]   = sorted[pos - 1];
+    }
+  }
+
+  for (size_t it = 0; it < m_quantiles.size(); it++)
+    update_estimate(data + 2*NUM_MARKERS*it, m_quantiles[it], count + 1, val);
+}
+
+// The P^2 update, given the count including the new value.
+void PixelQuantiles::update_estimate(float * markers, double quantile, int count,
+                                     double val){
+
+  double q[NUM_MARKERS], n[NUM_MARKERS], increments[NUM_MARKERS];
+  for (int i = 0; i < NUM_MARKERS; i++) {
+    q[i] = markers[i];
+    n[i] = markers[NUM_MARKERS + i];
+  }
+  marker_increments(quantile, increments);
+
+  // Find the cell the value falls in, extending the extremes if needed
+  int k = 0;
+  if (val < q[0]) {
+    q[0] = val;
+    k = 0;
+  }else if (val >= q[NUM_MARKERS-1]) {
+    q[NUM_MARKERS-1] = val;
+    k = NUM_MARKERS - 2;
+  }else{
+    while (k < NUM_MARKERS - 2 && val >= q[k+1])
+      k++;
+  }
+  for (int i = k + 1; i < NUM_MARKERS; i++)
+    n[i] += 1.0;
+
+  // Move the middle markers towards their desired positions, by one
+  // step, with a parabolic prediction of the height if it stays
+  // between the neighbors, and a linear one otherwise.
+  for (int i = 1; i < NUM_MARKERS - 1; i++) {
+    double d = 1.0 + (count - 1)*increments[i] - n[i];
+    if ((d >= 1.0 && n[i+1] - n[i] > 1.0) || (d <= -1.0 && n[i-1] - n[i] < -1.0)) {
+      double s = (d > 0) ? 1.0 : -1.0;
+      double qp = q[i] + s/(n[i+1] - n[i-1]) *
+        ( (n[i] - n[i-1] + s)*(q[i+1] - q[i])/(n[i+1] - n[i]) +
+          (n[i+1] - n[i] - s)*(q[i] - q[i-1])/(n[i] - n[i-1]) );
+      if (q[i-1] < qp && qp < q[i+1]) {
+        q[i] = qp;
+      }else{
+        int j = i + int(s);
+        q[i] = q[i] + s*(q[j] - q[i])/(n[j] - n[i]);
+      }
+      n[i] += s;
+    }
+  }
+
+  for (int i = 0; i < NUM_MARKERS; i++) {
+    markers[i]               = q[i];
+    markers[NUM_MARKERS + i] = n[i];
+  }
+}
+
+int PixelQuantiles::find_quantile(double quantile) const {
+  for (size_t it = 0; it < m_quantiles.size(); it++) {
+    if (m_quantiles[it] == quantile)
+      return it;
+  }
+  return -1;
+}
+
+double PixelQuantiles::quantile(int pixel, int quantile_index) const {
+
+  int count = m_counts[pixel];
+  if (count <= 0)
+    vw_throw(ArgumentErr() << "Cannot find a quantile without values.\n");
+
+  float const* data = &m_data[size_t(pixel)*m_stride];
+  double quantile = m_quantiles[quantile_index];
+
+  if (count <= m_max_exact) {
+    std::vector<double> sorted(data, data + count);
+    std::sort(sorted.begin(), sorted.end());
+    return exact_quantile(sorted, quantile);
+  }
+
+  // The extreme markers are the exact min and max
+  float const* heights = data + 2*NUM_MARKERS*quantile_index;
+  if (quantile <= 0.0) return heights[0];
+  if (quantile >= 1.0) return heights[NUM_MARKERS-1];
+  return heights[2];
+}
+
+double PixelQuantiles::nmad(int pixel) const {
+
+  int count = m_counts[pixel];
+  if (count <= 0)
+    vw_throw(ArgumentErr() << "Cannot find the NMAD without values.\n");
+
+  if (count <= m_max_exact) {
+    float const* data = &m_data[size_t(pixel)*m_stride];
+    std::vector<double> vals(data, data + count);
+    std::sort(vals.begin(), vals.end());
+    double median = exact_quantile(vals, 0.5);
+    for (size_t it = 0; it < vals.size(); it++)
+      vals[it] = std::abs(vals[it] - median);
+    std::sort(vals.begin(), vals.end());
+    return 1.4826*exact_quantile(vals, 0.5);
+  }
+
+  int q1 = find_quantile(0.25), q3 = find_quantile(0.75);
+  if (q1 < 0 || q3 < 0)
+    vw_throw(ArgumentErr() << "Estimating the NMAD requires tracking the quartiles.\n");
+
+  return 0.7413*(quantile(pixel, q3) - quantile(pixel, q1));
+}
+
+} // end namespace asp
@@ -0,0 +1,78 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file PixelQuantiles.h
+///
+/// Streaming order statistics for each pixel of a tile, for when many
+/// images are stacked. The values at each pixel are added one at a
+/// time. Up to a given number of them are kept as floats, and the
+/// quantiles are then exact. Beyond that, each quantile is estimated
+/// with the P^2 algorithm (Jain and Chlamtac, 1985), which uses
+/// constant memory per quantile. Memory per pixel is fixed up front.
+
+#ifndef __ASP_CORE_PIXEL_QUANTILES_H__
+#define __ASP_CORE_PIXEL_QUANTILES_H__
+
+#include <vector>
+
+namespace asp {
+
+  class PixelQuantiles {
+  public:
+
+    /// Track the given quantiles, each in [0, 1], for this many
+    /// pixels. Values at a pixel are stored exactly until there are
+    /// more than max_exact of them (at least 5).
+    PixelQuantiles(int num_pixels, std::vector<double> const& quantiles, int max_exact);
+
+    void add(int pixel, double val);
+
+    /// The number of values added at this pixel.
+    int count(int pixel) const { return m_counts[pixel]; }
+
+    /// The quantile with given index in the list passed to the
+    /// constructor. Exact values are interpolated linearly between
+    /// order statistics, so the median of an even number of values is
+    /// the mean of the middle two. The pixel must have values.
+    double quantile(int pixel, int quantile_index) const;
+
+    /// The normalized median absolute deviation, 1.4826 * median(|x - median(x)|).
+    /// When estimated, it is found from the interquartile range as
+    /// 0.7413 * (Q3 - Q1), which is the same for symmetric
+    /// distributions. Then the quantiles 0.25 and 0.75 must be tracked.
+    double nmad(int pixel) const;
+
+    /// Memory used per pixel, to help choose the tile size.
+    static double bytes_per_pixel(int num_quantiles, int max_exact);
+
+  private:
+
+    void start_estimates(int pixel, double val);
+    void update_estimate(float * markers, double quantile, int count, double val);
+    int  find_quantile(double quantile) const;
+
+    std::vector<double> m_quantiles;
+    int                 m_max_exact, m_stride;
+    std::vector<int>    m_counts;
+    // For each pixel, either the exact values, or for each quantile
+    // the heights of its five markers followed by their positions.
+    std::vector<float>  m_data;
+  };
+
+} // end namespace asp
+
+#endif
@@ -25,6 +25,7 @@
 #include <asp/Core/PointUtils.h>
 #include <vw/Cartography/Chipper.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/FileIO/DiskImageView.h>
 #include <boost/math/special_functions/fpclassify.hpp>
 
 using namespace vw;
@@ -906,7 +907,7 @@ bool asp::georef_from_pc_files(std::vector<std::string> const& files,
 
     // Sometimes ASP PC files can have georef, written there by stereo
     try {
-      if (!is_las(files[i]) && read_georeference(local_georef, files[i])){
+      if (!is_las(files[i]) && read_point_cloud_georef(files[i], local_georef)){
 	georef = local_georef;
 	return true;
       }
@@ -1005,6 +1006,44 @@ boost::uint64_t asp::csv_file_size(std::string const& file){
   return num_total_points;
 }
 
+bool asp::read_point_cloud_georef(std::string const& file,
+                                  vw::cartography::GeoReference & georef){
+  if (!asp::is_columnar_point_cloud(file))
+    return vw::cartography::read_georeference(georef, file);
+  std::string wkt = ColumnarPointCloudReader(file).georef_wkt();
+  if (wkt.empty())
+    return false;
+  georef.set_wkt(wkt);
+  return true;
+}
+
+// The number of channels in a point cloud, tif or columnar
+int asp::get_point_cloud_num_channels(std::string const& file){
+  if (asp::is_columnar_point_cloud(file))
+    return ColumnarPointCloudReader(file).num_channels();
+  return vw::get_num_channels(file);
+}
+
+// The dimensions of a point cloud, tif or columnar
+vw::Vector2i asp::get_point_cloud_size(std::string const& file){
+  if (asp::is_columnar_point_cloud(file)) {
+    ColumnarPointCloudReader reader(file);
+    return vw::Vector2i(reader.cols(), reader.rows());
+  }
+  vw::DiskImageView<float> img(file);
+  return vw::Vector2i(img.cols(), img.rows());
+}
+
+// The block size of a point cloud, tif or columnar
+vw::Vector2i asp::get_point_cloud_block_size(std::string const& file){
+  if (asp::is_columnar_point_cloud(file)) {
+    int block_size = ColumnarPointCloudReader(file).block_size();
+    return vw::Vector2i(block_size, block_size);
+  }
+  vw::DiskImageView<float> img(file);
+  return img.resource()->block_read_size();
+}
+
 // Erases a file suffix if one exists and returns the base string
 std::string asp::prefix_from_pointcloud_filename(std::string const& filename) {
   std::string result = filename;
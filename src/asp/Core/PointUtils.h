@@ -33,6 +33,7 @@
 #include <vw/FileIO/DiskImageUtils.h>
 
 #include <asp/Core/Common.h>
+#include <asp/Core/ColumnarPointCloud.h>
 
 namespace vw{
   namespace cartography{
@@ -227,11 +228,30 @@ namespace asp {
   /// Erases a file suffix if one exists and returns the base string
   std::string prefix_from_pointcloud_filename(std::string const& filename);
 
+  /// Read the georeference of an ASP point cloud, either a tif or in
+  /// the columnar format. Return false if it has none.
+  bool read_point_cloud_georef(std::string const& file,
+                               vw::cartography::GeoReference & georef);
+
+  /// The number of channels in a point cloud file, either a tif or
+  /// in the columnar format.
+  int get_point_cloud_num_channels(std::string const& file);
+
+  /// The dimensions of a point cloud image, either a tif or in the
+  /// columnar format.
+  vw::Vector2i get_point_cloud_size(std::string const& file);
+
+  /// The size of the blocks in which a point cloud is stored, either
+  /// a tif or in the columnar format. Reading in regions aligned to
+  /// these is fastest.
+  vw::Vector2i get_point_cloud_block_size(std::string const& file);
+
 
   /// Read a point cloud file in the format written by ASP.
   /// Given a point cloud with n channels, return the first m channels.
   /// We must have 1 <= m <= n <= 6.
   /// If the image was written by subtracting a shift, put that shift back.
+  /// Files in the columnar format (.apc) are read as well.
   template<int m>
   vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename);
 
@@ -337,6 +357,10 @@ namespace asp {
 template<int m>
 vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename){
 
+  // The columnar format stores the shift itself and adds it back on reading
+  if (asp::is_columnar_point_cloud(filename))
+    return asp::read_columnar_point_cloud<m>(filename);
+
   vw::Vector3 shift;
   std::string shift_str;
   boost::shared_ptr<vw::DiskImageResource> rsrc
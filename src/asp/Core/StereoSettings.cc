@@ -127,7 +127,13 @@ namespace asp {
       ("skip-image-normalization", po::bool_switch(&global.skip_image_normalization)->default_value(false)->implicit_value(true),
                      "Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.")
       ("part-of-multiview-run", po::bool_switch(&global.part_of_multiview_run)->default_value(false)->implicit_value(true),
-                    "If the current run is part of a larger multiview run.");
+                    "If the current run is part of a larger multiview run.")
+      ("image-pyramid-dir",        po::value(&global.image_pyramid_dir)->default_value(""),
+                     "Write multi-level pyramids of the preprocessed images in this directory, and make the subsampled images from them. Pyramids are reused as long as the images do not change.")
+      ("image-pyramid-hash-contents", po::bool_switch(&global.image_pyramid_hash_contents)->default_value(false)->implicit_value(true),
+                     "Look up the image pyramids by a hash of the image contents rather than by the image path and timestamp, so that they are also reused by later runs producing the same images. This reads each image fully.")
+      ("subsample-with-masks",     po::bool_switch(&global.subsample_with_masks)->default_value(false)->implicit_value(true),
+                     "Make the subsampled images in the same pass that writes the masks, saving a reading of the images. They are then box-filtered, which changes the low-resolution disparity somewhat.");
   }
 
   CorrelationDescription::CorrelationDescription() : po::options_description("Correlation Options") {
@@ -141,6 +147,8 @@ namespace asp {
                      "Correlation seed strategy. [0 None, 1 Use low-res disparity from stereo, 2 Use low-res disparity from provided DEM (see disparity-estimation-dem), 3 Use low-res disparity produced by sparse_disp (in development)]")
       ("corr-sub-seed-percent",  po::value(&global.seed_percent_pad)->default_value(0.25),
                      "Percent fudge factor for disparity seed's search range.")
+      ("lowres-corr-levels",     po::value(&global.lowres_corr_levels)->default_value(0),
+                     "With corr-seed-mode 1, find the low-resolution disparity coarse-to-fine, starting from L_sub and R_sub halved this many times. The disparity at each level narrows the search range at the next. If 0, search the full range at the resolution of L_sub.")
       ("cost-mode",              po::value(&global.cost_mode)->default_value(2),
                      "Correlation cost metric. [0 Absolute, 1 Squared, 2 Normalized Cross Correlation, 3 Census Transform (SGM only), 4 Ternary Census Transform (SGM only)]")
       ("xcorr-threshold",        po::value(&global.xcorr_threshold)->default_value(2),
@@ -179,7 +187,9 @@ namespace asp {
       ("corr-tile-size",         po::value(&global.corr_tile_size_ovr)->default_value(ASPGlobalOptions::corr_tile_size()),
                      "Override the default tile size used for processing.")
       ("sgm-collar-size",        po::value(&global.sgm_collar_size)->default_value(512),
-                     "Extend SGM calculation to this distance to increase accuracy at tile borders.");
+                     "Extend SGM calculation to this distance to increase accuracy at tile borders.")
+      ("corr-subtile-min-size",  po::value(&global.corr_subtile_min_size)->default_value(0),
+                     "Split a correlation tile into sub-tiles no smaller than this, each with its own search range, when this shrinks the search. Set to 0 to disable.");
 
 
     po::options_description backwards_compat_options("Aliased backwards compatibility options");
@@ -291,6 +301,8 @@ namespace asp {
       ("piecewise-adjustment-camera-weight", po::value(&global.piecewise_adjustment_camera_weight)->default_value(1.0), "The weight to use for the sum of squares of adjustments component of the cost function. Increasing this value will constrain the adjustments to be smaller.")
       ("point-cloud-rounding-error",        po::value(&global.point_cloud_rounding_error)->default_value(0.0),
                                             "How much to round the output point cloud values, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. Default: 1/2^10 for Earth and proportionally less for smaller bodies.")
+      ("point-cloud-format",                po::value(&global.point_cloud_format)->default_value("tif"),
+                                            "Save the point cloud as a multi-channel tif (-PC.tif), or in the columnar format (-PC.apc), with per-block bounding boxes and separately compressed channels, which is faster to read for point2dem, point2las, and pc_align. Options: tif, apc. The apc format is not supported by parallel_stereo.")
       ("save-double-precision-point-cloud", po::bool_switch(&global.save_double_precision_point_cloud)->default_value(false)->implicit_value(true),
                                             "Save the final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at twice the storage).")
       ("compute-point-cloud-center-only",   po::bool_switch(&global.compute_point_cloud_center_only)->default_value(false)->implicit_value(true),
@@ -329,6 +341,8 @@ namespace asp {
        "Delete any subsampled and other files created by the GUI when exiting.")
       ("create-image-pyramids-only",   po::bool_switch(&global.create_image_pyramids_only)->default_value(false)->implicit_value(true),
        "Without starting the GUI, build multi-resolution pyramids for the inputs, to be able to load them fast later.")
+      ("tile-cache-size",   po::value(&global.tile_cache_size)->default_value(64),
+       "The memory to use for the rendered tiles of each image view, in MB. More is used if needed to cover the view.")
       ;
   }
 
@@ -336,7 +350,9 @@ namespace asp {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("disable-correct-velocity-aberration", po::bool_switch(&global.disable_correct_velocity_aberration)->default_value(false)->implicit_value(true),
-       "Apply the velocity aberration correction for Digital Globe cameras.");
+       "Apply the velocity aberration correction for Digital Globe cameras.")
+      ("camera-cache-dir", po::value(&global.camera_cache_dir)->default_value(""),
+       "Save the DG, SPOT5, ASTER, and RPC cameras in binary form in this directory when first loaded from their files, and load them from there subsequently, which is much faster than parsing XML files. A cached camera is ignored if the original file changed.");
   }
 
   UndocOptsDescription::UndocOptsDescription() : po::options_description("Undocumented Options") {
@@ -344,7 +360,9 @@ namespace asp {
     (*this).add_options()
       ("trans-crop-win", po::value(&global.trans_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"), "Left image crop window in respect to L.tif. This is an internal option. [default: use the entire image].")
       ("attach-georeference-to-lowres-disparity", po::bool_switch(&global.attach_georeference_to_lowres_disparity)->default_value(false)->implicit_value(true),
-       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.");
+       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.")
+      ("tile-worker", po::bool_switch(&global.tile_worker)->default_value(false)->implicit_value(true),
+       "Keep running and process the tiles read from standard input, one per line, as: <output prefix> xoff yoff xsize ysize. This is an internal option used by parallel_stereo.");
   }
 
   po::options_description
@@ -102,6 +102,9 @@ namespace asp {
     double nodata_optimal_threshold_factor; ///< Pixels with values less than this factor times the optimal Otsu threshold are treated as no-data
     bool   skip_image_normalization;        ///< Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.
     bool   part_of_multiview_run;           ///< If the current run is part of a larger multiview run
+    std::string image_pyramid_dir;          ///< Where to keep the pyramids of the preprocessed images
+    bool   image_pyramid_hash_contents;     ///< Look up the pyramids by image contents
+    bool   subsample_with_masks;            ///< Make L_sub and R_sub while writing the masks
 
     // Correlation Options
     float slogW;                      ///< Preprocessing filter width
@@ -117,6 +120,7 @@ namespace asp {
                                       //     (in development)
 
     float seed_percent_pad;           ///< Pad amound towards the IP found
+    int   lowres_corr_levels;         ///< Coarse-to-fine levels for the low-res disparity
     vw::uint16 cost_mode;             // 0 = absolute difference
                                       // 1 = squared difference
                                       // 2 = normalized cross correlation
@@ -138,6 +142,7 @@ namespace asp {
     int    corr_blob_filter_area;     // Use blob filtering in pyramidal correlation
     int    corr_tile_size_ovr;        // Override the default tile size used for processing.
     int    sgm_collar_size;           // Extra tile padding used for SGM calculation.
+    int    corr_subtile_min_size;     // Split tiles down to this size to narrow the search range.
 
     // Subpixel Options
     vw::uint16 subpixel_mode;         // 0 = none
@@ -197,6 +202,7 @@ namespace asp {
     bool   use_least_squares;                 // Use a more rigorous triangulation
     bool   save_double_precision_point_cloud; // Save final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at 2x the storage).
     double point_cloud_rounding_error;        // How much to round the output point cloud values
+    std::string point_cloud_format;           // Save the point cloud as tif or apc (columnar)
     bool   compute_point_cloud_center_only;   // Only compute the center of triangulated point cloud and exit.
     bool   skip_point_cloud_center_comp;
 
@@ -210,13 +216,16 @@ namespace asp {
     std::string match_file, gcp_file;
     bool delete_temporary_files_on_exit;
     bool create_image_pyramids_only;
+    double tile_cache_size;   // The memory for rendered tiles, in MB, per image view
 
     // DG Options
     bool disable_correct_velocity_aberration;
+    std::string camera_cache_dir;     // Where to cache cameras loaded from XML files
 
     // Undocumented options. We don't want these exposed to the user.
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
     bool attach_georeference_to_lowres_disparity;
+    bool tile_worker;                 // Process tiles read from standard input.
 
     // Internal variable, to ensure we always initialize this class before using it
     bool initialized_stereo_settings;
@@ -0,0 +1,132 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/PointUtils.h>
+#include <asp/Core/ColumnarPointCloud.h>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+TEST( ColumnarPointCloud, RoundTrip ) {
+
+  // A 5x3 cloud with xyz near the Earth's surface, an error channel,
+  // and one invalid point.
+  Vector3 offset(-2.5e+6, -4.6e+6, 3.5e+6);
+  ImageView< Vector<double, 4> > cloud(5, 3);
+  for (int col = 0; col < cloud.cols(); col++) {
+    for (int row = 0; row < cloud.rows(); row++) {
+      for (int i = 0; i < 3; i++)
+        cloud(col, row)[i] = offset[i] + 10.0*col - 7.3*row + 0.123*i;
+      cloud(col, row)[3] = 0.5*col + row;
+    }
+  }
+  cloud(2, 1) = Vector<double, 4>();
+
+  double rounding_error = 1.0/1024.0;
+  UnlinkName file("cloud.apc");
+  write_columnar_point_cloud(file, offset, rounding_error, cloud,
+                             2, 2, ProgressCallback::dummy_instance());
+
+  EXPECT_TRUE(is_columnar_point_cloud(file));
+  EXPECT_EQ(4, get_point_cloud_num_channels(file));
+  EXPECT_EQ(Vector2i(5, 3), get_point_cloud_size(file));
+
+  ImageView< Vector<double, 4> > out = read_asp_point_cloud<4>(file);
+  ASSERT_EQ(cloud.cols(), out.cols());
+  ASSERT_EQ(cloud.rows(), out.rows());
+  BBox3 bbox;
+  for (int col = 0; col < cloud.cols(); col++) {
+    for (int row = 0; row < cloud.rows(); row++) {
+      for (int i = 0; i < 4; i++)
+        EXPECT_NEAR(cloud(col, row)[i], out(col, row)[i], rounding_error);
+      if (col != 2 || row != 1)
+        bbox.grow(subvector(cloud(col, row), 0, 3));
+    }
+  }
+  EXPECT_EQ(Vector<double, 4>(), out(2, 1));
+
+  // The bounding box comes from the header
+  BBox3 file_bbox = columnar_point_cloud_bbox(file);
+  EXPECT_VECTOR_NEAR(bbox.min(), file_bbox.min(), 1e-8);
+  EXPECT_VECTOR_NEAR(bbox.max(), file_bbox.max(), 1e-8);
+  EXPECT_EQ(14u, ColumnarPointCloudReader(file).num_points());
+
+  // Read fewer channels, from a window straddling several blocks
+  ImageView<Vector3> xyz = crop(read_asp_point_cloud<3>(file), BBox2i(1, 1, 3, 2));
+  EXPECT_VECTOR_NEAR(subvector(cloud(3, 2), 0, 3), xyz(2, 1), rounding_error);
+}
+
+TEST( ColumnarPointCloud, Georef ) {
+
+  ImageView<Vector3> cloud(3, 2);
+  cloud(1, 1) = Vector3(1737400, 10, 20);
+
+  cartography::GeoReference georef;
+  georef.set_datum(cartography::Datum("D_MOON"));
+  UnlinkName file("cloud_georef.apc");
+  write_columnar_point_cloud(file, Vector3(), 0.0, cloud, 2, 1,
+                             ProgressCallback::dummy_instance(), georef.get_wkt());
+
+  cartography::GeoReference out_georef;
+  ASSERT_TRUE(read_point_cloud_georef(file, out_georef));
+  EXPECT_NEAR(georef.datum().semi_major_axis(), out_georef.datum().semi_major_axis(), 1e-6);
+  EXPECT_NEAR(georef.datum().semi_minor_axis(), out_georef.datum().semi_minor_axis(), 1e-6);
+
+  // Without a georeference
+  UnlinkName file2("cloud_no_georef.apc");
+  write_columnar_point_cloud(file2, Vector3(), 0.0, cloud, 2, 1,
+                             ProgressCallback::dummy_instance());
+  EXPECT_FALSE(read_point_cloud_georef(file2, out_georef));
+}
+
+TEST( ColumnarPointCloud, BlockCache ) {
+
+  ImageView< Vector<double, 4> > cloud(7, 5);
+  for (int col = 0; col < cloud.cols(); col++) {
+    for (int row = 0; row < cloud.rows(); row++) {
+      for (int i = 0; i < 4; i++)
+        cloud(col, row)[i] = 100.0*col + 10.0*row + i + 1;
+    }
+  }
+  UnlinkName file("cloud_cache.apc");
+  write_columnar_point_cloud(file, Vector3(), 0.0, cloud, 3, 2,
+                             ProgressCallback::dummy_instance());
+  EXPECT_EQ(Vector2i(3, 3), get_point_cloud_block_size(file));
+
+  // With a cache that holds a single block, blocks are evicted all the
+  // time. With a large one, they are reused, including for reading
+  // fewer channels than were decoded.
+  double cache_sizes[] = {0.0, 256.0};
+  for (int s = 0; s < 2; s++) {
+    boost::shared_ptr<ColumnarPointCloudReader>
+      reader(new ColumnarPointCloudReader(file, cache_sizes[s]));
+    ColumnarPointCloudView<4> view4(reader);
+    ColumnarPointCloudView<3> view3(reader);
+    EXPECT_EQ(3, view4.block_size());
+    for (int row = 0; row < cloud.rows(); row++) {
+      for (int col = 0; col < cloud.cols(); col++) {
+        EXPECT_EQ(cloud(col, row), view4(col, row));
+        EXPECT_VECTOR_NEAR(subvector(cloud(col, row), 0, 3), view3(col, row), 1e-12);
+      }
+    }
+    ImageView<Vector3> xyz = crop(view3, BBox2i(2, 1, 4, 3));
+    EXPECT_VECTOR_NEAR(subvector(cloud(5, 3), 0, 3), xyz(3, 2), 1e-12);
+  }
+}
@@ -0,0 +1,122 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ImagePyramid.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+TEST( ImagePyramid, BuildAndReuse ) {
+
+  // A 100x60 ramp, with the left half of row 10 invalid
+  double nodata = -1000;
+  ImageView<float> img(100, 60);
+  for (int col = 0; col < img.cols(); col++)
+    for (int row = 0; row < img.rows(); row++)
+      img(col, row) = col + 0.5*row;
+  for (int col = 0; col < 50; col++)
+    img(col, 10) = nodata;
+
+  bool has_nodata = true, has_georef = false;
+  cartography::GeoReference georef;
+  TerminalProgressCallback tpc("asp", ": ");
+  vw::cartography::GdalWriteOptions opt;
+  UnlinkName file("pyramid_input.tif");
+  vw::cartography::block_write_gdal_image(file, img, has_georef, georef,
+                                          has_nodata, nodata, opt, tpc);
+
+  std::string cache_dir = "pyramid_test_cache";
+  boost::filesystem::remove_all(cache_dir);
+
+  // Levels halve in size down to 16 pixels
+  bool hash_contents = false;
+  ImagePyramid pyramid(file, "", cache_dir, 16, hash_contents, opt);
+  ASSERT_EQ(4, pyramid.num_levels());
+  EXPECT_EQ(Vector2i(50, 30), pyramid.level_size(1));
+  EXPECT_EQ(Vector2i(25, 15), pyramid.level_size(2));
+  EXPECT_EQ(1, pyramid.level_for_scale(0.4));
+  EXPECT_EQ(0, pyramid.level_for_scale(0.6));
+
+  // Averaging preserves the ramp away from the edges and invalid pixels
+  ImagePyramid::MaskedImageType level1 = pyramid.masked_level(1);
+  EXPECT_TRUE(is_valid(level1(30, 20)));
+  EXPECT_NEAR(2*30 + 0.5 + 0.5*(2*20 + 0.5), level1(30, 20).child().v(), 1.0);
+
+  // The same image is found again in the cache, without rebuilding
+  std::time_t build_time = boost::filesystem::last_write_time(pyramid.level_file(1));
+  ImagePyramid reused(file, "", cache_dir, 16, hash_contents, opt);
+  EXPECT_EQ(pyramid.dir(), reused.dir());
+  EXPECT_EQ(4, reused.num_levels());
+  EXPECT_EQ(build_time, boost::filesystem::last_write_time(reused.level_file(1)));
+
+  // No temporary directories are left behind
+  int num_dirs = 0;
+  for (boost::filesystem::directory_iterator it(cache_dir);
+       it != boost::filesystem::directory_iterator(); it++)
+    num_dirs++;
+  EXPECT_EQ(1, num_dirs);
+
+  // A different image gets a different pyramid. Make sure its
+  // timestamp differs even if written within the same second.
+  img(0, 0) = 5;
+  vw::cartography::block_write_gdal_image(file, img, has_georef, georef,
+                                          has_nodata, nodata, opt, tpc);
+  boost::filesystem::last_write_time(file, build_time + 1);
+  ImagePyramid other(file, "", cache_dir, 16, hash_contents, opt);
+  EXPECT_NE(pyramid.dir(), other.dir());
+
+  // With the content hash, a copy of the image under another name
+  // finds the same pyramid.
+  hash_contents = true;
+  UnlinkName copy("pyramid_input_copy.tif");
+  boost::filesystem::copy_file(file, copy, boost::filesystem::copy_option::overwrite_if_exists);
+  ImagePyramid by_content(file, "", cache_dir, 16, hash_contents, opt);
+  ImagePyramid copy_by_content(copy, "", cache_dir, 16, hash_contents, opt);
+  EXPECT_EQ(by_content.dir(), copy_by_content.dir());
+  EXPECT_NE(other.dir(), by_content.dir());
+
+  boost::filesystem::remove_all(cache_dir);
+}
+
+TEST( ImagePyramid, ContentHash ) {
+
+  // Files of the same size differing in one byte far from the start
+  // and the end must hash differently.
+  std::string data(3*(1<<20) + 5, 'a');
+  UnlinkName file1("hash1.bin"), file2("hash2.bin");
+  {
+    std::ofstream ofs(file1.c_str(), std::ios::binary);
+    ofs << data;
+  }
+  data[data.size()/4] = 'b';
+  {
+    std::ofstream ofs(file2.c_str(), std::ios::binary);
+    ofs << data;
+  }
+  EXPECT_EQ(file_content_hash(file1), file_content_hash(file1));
+  EXPECT_NE(file_content_hash(file1), file_content_hash(file2));
+
+  // The stamp hash tells apart the files by name only
+  EXPECT_EQ(file_stamp_hash(file1), file_stamp_hash(file1));
+  EXPECT_NE(file_stamp_hash(file1), file_stamp_hash(file2));
+}
@@ -0,0 +1,66 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/PixelQuantiles.h>
+#include <algorithm>
+#include <random>
+
+using namespace asp;
+
+TEST( PixelQuantiles, Exact ) {
+
+  std::vector<double> quantiles;
+  quantiles.push_back(0.5);
+  quantiles.push_back(0.25);
+  PixelQuantiles pq(2, quantiles, 10);
+
+  for (int i = 5; i >= 0; i--)
+    pq.add(1, i);
+
+  EXPECT_EQ(0, pq.count(0));
+  EXPECT_EQ(6, pq.count(1));
+  EXPECT_NEAR(2.5,  pq.quantile(1, 0), 1e-12);
+  EXPECT_NEAR(1.25, pq.quantile(1, 1), 1e-12);
+  EXPECT_NEAR(1.4826*1.5, pq.nmad(1), 1e-12);
+}
+
+TEST( PixelQuantiles, Estimated ) {
+
+  std::vector<double> quantiles;
+  quantiles.push_back(0.5);
+  quantiles.push_back(0.25);
+  quantiles.push_back(0.75);
+  PixelQuantiles pq(1, quantiles, 20);
+
+  // A shuffled uniform sequence, well past the exact storage
+  int num = 1001;
+  std::vector<double> vals;
+  for (int i = 0; i < num; i++)
+    vals.push_back(i);
+  std::mt19937 generator(42);
+  std::shuffle(vals.begin(), vals.end(), generator);
+  for (int i = 0; i < num; i++)
+    pq.add(0, vals[i]);
+
+  EXPECT_EQ(num, pq.count(0));
+  EXPECT_NEAR(500.0, pq.quantile(0, 0), 10.0);
+  EXPECT_NEAR(250.0, pq.quantile(0, 1), 10.0);
+  EXPECT_NEAR(750.0, pq.quantile(0, 2), 10.0);
+  EXPECT_NEAR(0.7413*500.0, pq.nmad(0), 10.0);
+}
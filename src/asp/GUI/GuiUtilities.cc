@@ -30,7 +30,6 @@
 #include <vw/Math/EulerAngles.h>
 #include <vw/Image/Algorithms.h>
 #include <vw/Cartography/GeoTransform.h>
-#include <vw/tools/hillshade.h>
 #include <vw/Core/RunOnce.h>
 #include <asp/GUI/GuiUtilities.h>
 
@@ -108,58 +107,45 @@ QRect bbox2qrect(BBox2 const& B){
                round(B.width()), round(B.height()));
 }
 
-bool write_hillshade(vw::cartography::GdalWriteOptions const& opt,
-                     std::string const& input_file,
-                     std::string      & output_file) {
+void hillshade_clip(ImageView<double> const& dem, double nodata_val,
+                    double pixel_width, double pixel_height,
+                    double azimuth, double elevation,
+                    ImageView<double> & shaded) {
 
-  // Sanity check: Must have a georeference
-  cartography::GeoReference georef;
-  bool has_georef = vw::cartography::read_georeference(georef, input_file);
-  if (!has_georef) {
-    popUp("No georeference present in: " + input_file + ".");
-    return false;
-  }
-
-  // TODO: Expose these to the user
-  int elevation = 20;
-  int azimuth   = 300;
+  // The direction towards the light, in east, north, up coordinates
+  double az = azimuth*M_PI/180.0, el = elevation*M_PI/180.0;
+  Vector3 light(cos(el)*cos(az), cos(el)*sin(az), sin(el));
 
-  double scale       = 0.0;
-  double blur_sigma  = std::numeric_limits<double>::quiet_NaN();
-  double nodata_val  = std::numeric_limits<double>::quiet_NaN();
-  vw::read_nodata_val(input_file, nodata_val);
-  std::string suffix = "_hillshade.tif";
+  int cols = dem.cols(), rows = dem.rows();
+  shaded.set_size(cols, rows);
+  for (int col = 0; col < cols; col++) {
+    for (int row = 0; row < rows; row++) {
 
-  output_file = vw::mosaic::filename_from_suffix1(input_file, suffix);
-  try {
-    DiskImageView<float> input(input_file);
-    try{
-      bool will_write = vw::mosaic::overwrite_if_no_good(input_file, output_file,
-                                             input.cols(), input.rows());
-      if (will_write){
-        vw_out() << "Writing: " << output_file << std::endl;
-        vw::do_multitype_hillshade(input_file, output_file, azimuth, elevation, scale,
-                                   nodata_val, blur_sigma);
-      }
-    }catch(...){
-      // Failed to write, presumably because we have no write access.
-      // Write the file in the current dir.
-      vw_out() << "Failed to write: " << output_file << "\n";
-      output_file = vw::mosaic::filename_from_suffix2(input_file, suffix);
-      bool will_write = vw::mosaic::overwrite_if_no_good(input_file, output_file,
-                                             input.cols(), input.rows());
-      if (will_write){
-        vw_out() << "Writing: " << output_file << std::endl;
-        vw::do_multitype_hillshade(input_file,  output_file, azimuth, elevation, scale,
-                                   nodata_val, blur_sigma);
+      double h = dem(col, row);
+      if (h <= nodata_val || std::isnan(h)) {
+        shaded(col, row) = nodata_val;
+        continue;
       }
+
+      // Use centered differences where possible, and one-sided ones at
+      // the clip boundary and next to nodata.
+      int cl = std::max(col-1, 0), cr = std::min(col+1, cols-1);
+      int rt = std::max(row-1, 0), rb = std::min(row+1, rows-1);
+      if (dem(cl, row) <= nodata_val || std::isnan(dem(cl, row))) cl = col;
+      if (dem(cr, row) <= nodata_val || std::isnan(dem(cr, row))) cr = col;
+      if (dem(col, rt) <= nodata_val || std::isnan(dem(col, rt))) rt = row;
+      if (dem(col, rb) <= nodata_val || std::isnan(dem(col, rb))) rb = row;
+
+      double dzdx = 0, dzdy = 0;
+      if (cr > cl)
+        dzdx = (dem(cr, row) - dem(cl, row))/((cr - cl)*pixel_width);
+      if (rb > rt) // rows go south, and y goes north
+        dzdy = -(dem(col, rb) - dem(col, rt))/((rb - rt)*pixel_height);
+
+      Vector3 normal = normalize(Vector3(-dzdx, -dzdy, 1.0));
+      shaded(col, row) = round(255*std::max(0.0, dot_prod(normal, light)));
     }
-  } catch (const Exception& e) {
-    popUp(e.what());
-    return false;
   }
-
-  return true;
 }
 
 void imageData::read(std::string const& name_in, vw::cartography::GdalWriteOptions const& opt,
@@ -382,6 +368,41 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
   }
 }
 
+void DiskImagePyramidMultiChannel::get_hillshaded_clip(double scale_in, vw::BBox2i region_in,
+                                                       vw::cartography::GeoReference const& georef,
+                                                       double azimuth, double elevation,
+                                                       QImage & qimg, double & scale_out,
+                                                       vw::BBox2i & region_out) const{
+
+  if (m_type != CH1_DOUBLE)
+    vw_throw(ArgumentErr() << "Hill-shading requires single-channel images.\n");
+
+  ImageView<double> clip;
+  m_img_ch1_double.get_image_clip(scale_in, region_in, clip,
+                                  scale_out, region_out);
+
+  // The ground distance between adjacent pixels of the clip. Go
+  // through the datum, so that this works for both projected and
+  // longitude-latitude georeferences.
+  Vector2 pix = (region_out.min() + region_out.max())*scale_out/2.0;
+  vw::cartography::Datum const& datum = georef.datum();
+  Vector2 ll_c = georef.pixel_to_lonlat(pix);
+  Vector2 ll_r = georef.pixel_to_lonlat(pix + Vector2(1, 0));
+  Vector2 ll_b = georef.pixel_to_lonlat(pix + Vector2(0, 1));
+  Vector3 ctr = datum.geodetic_to_cartesian(Vector3(ll_c[0], ll_c[1], 0));
+  Vector3 rt  = datum.geodetic_to_cartesian(Vector3(ll_r[0], ll_r[1], 0));
+  Vector3 bt  = datum.geodetic_to_cartesian(Vector3(ll_b[0], ll_b[1], 0));
+  double pixel_width  = std::max(norm_2(rt - ctr)*scale_out, 1e-8);
+  double pixel_height = std::max(norm_2(bt - ctr)*scale_out, 1e-8);
+
+  double nodata_val = m_img_ch1_double.get_nodata_val();
+  ImageView<double> shaded;
+  hillshade_clip(clip, nodata_val, pixel_width, pixel_height, azimuth, elevation, shaded);
+
+  bool highlight_nodata = false, scale_pixels = false;
+  formQimage(highlight_nodata, scale_pixels, nodata_val, shaded, qimg);
+}
+
 std::string DiskImagePyramidMultiChannel::get_value_as_str(int32 x, int32 y) const {
 
   // Below we cast from Vector<uint8> to Vector<double>, as the former
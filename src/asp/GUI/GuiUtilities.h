@@ -144,10 +144,15 @@ namespace vw { namespace gui {
   /// Convert a BBox2 object to a QRect object.
   QRect bbox2qrect(BBox2 const& B);
 
-  /// ?
-  bool write_hillshade(vw::cartography::GdalWriteOptions const& opt,
-                       std::string const& input_file,
-                       std::string      & output_file);
+  /// Hillshade a DEM clip whose pixels are the given number of meters
+  /// apart. The light comes from the given azimuth (degrees
+  /// counter-clockwise from east) and elevation (degrees above the
+  /// horizon). The output values are between 0 and 255, or nodata_val
+  /// where the DEM has no data.
+  void hillshade_clip(ImageView<double> const& dem, double nodata_val,
+                      double pixel_width, double pixel_height,
+                      double azimuth, double elevation,
+                      ImageView<double> & shaded);
 
   // Given an image, and an input file name, modify the filename using
   // a prefix. Write the image to that filename. If that fails, create
@@ -189,6 +194,15 @@ namespace vw { namespace gui {
     void get_image_clip(double scale_in, vw::BBox2i region_in,
                       bool highlight_nodata,
                       QImage & qimg, double & scale_out, vw::BBox2i & region_out) const;
+
+    // Same as get_image_clip(), but hillshade the clip before
+    // returning it. Only for single-channel georeferenced images.
+    // Shading just the pyramid level being shown, rather than the
+    // full-resolution image, makes this fast enough to do on the fly.
+    void get_hillshaded_clip(double scale_in, vw::BBox2i region_in,
+                             vw::cartography::GeoReference const& georef,
+                             double azimuth, double elevation,
+                             QImage & qimg, double & scale_out, vw::BBox2i & region_out) const;
     double get_nodata_val() const;
     
     int32 cols  () const { return m_cols;  }
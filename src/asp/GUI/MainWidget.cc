@@ -31,8 +31,11 @@
 #include <vw/Math/EulerAngles.h>
 #include <vw/Image/Algorithms.h>
 #include <vw/Core/RunOnce.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/Settings.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Cartography/GeoTransform.h>
+#include <asp/Core/StereoSettings.h>
 #include <asp/GUI/MainWidget.h>
 
 using namespace vw;
@@ -42,6 +45,184 @@ using namespace std;
 
 namespace vw { namespace gui {
 
+  // The size of a tile, in tile pixels, and the most threads rendering tiles.
+  const int    TILE_SIZE      = 256;
+  const int    MAX_NUM_RENDER_THREADS = 4;
+
+  // Before the tiles at the level being shown, render the ones this
+  // many levels coarser, which cover the view with few tiles.
+  const int    COARSE_LEVELS  = 3;
+
+  bool MainWidget::TileKey::operator<(TileKey const& other) const {
+    if (image_index != other.image_index) return image_index < other.image_index;
+    if (mode        != other.mode       ) return mode        < other.mode;
+    if (level       != other.level      ) return level       < other.level;
+    if (col         != other.col        ) return col         < other.col;
+    return row < other.row;
+  }
+
+  // The world region covered by a tile
+  static BBox2 tile_world_box(int level, int col, int row) {
+    double tile_world_size = TILE_SIZE*pow(2.0, level);
+    return BBox2(col*tile_world_size, row*tile_world_size, tile_world_size, tile_world_size);
+  }
+
+  // Renders in background threads the tiles requested by the widget,
+  // most urgent first, and keeps the most recently used ones.
+  class MainWidget::TileRenderer {
+
+    struct CachedTile {
+      QImage image;
+      std::list<TileKey>::iterator lru; // position in m_lru
+    };
+
+    // Runs the rendering loop in a background thread. Each worker has
+    // its own copies of the georeferences and transforms, so that they
+    // are not shared among threads.
+    class Worker: public vw::Task {
+      TileRenderer & m_renderer;
+      std::vector<GeoReference> m_georefs;
+      std::vector<GeoTransform> m_world2image;
+    public:
+      Worker(TileRenderer & renderer, std::vector<GeoReference> const& georefs,
+             std::vector<GeoTransform> const& world2image):
+        m_renderer(renderer), m_georefs(georefs), m_world2image(world2image) {}
+      virtual void operator()() { m_renderer.run(m_georefs, m_world2image); }
+    };
+
+    MainWidget * m_widget;
+
+    Mutex     m_mutex;
+    Condition m_cond;
+    std::list<TileKey>               m_requests;    // most urgent first
+    std::set<TileKey>                m_in_progress; // being rendered
+    std::map<TileKey, CachedTile>    m_tiles;
+    std::list<TileKey>               m_lru;         // most recently used first
+    size_t    m_cache_num_tiles, m_max_num_tiles;
+    bool      m_stop, m_refresh_pending;
+    std::vector< boost::shared_ptr<Thread> > m_threads;
+
+    void run(std::vector<GeoReference> const& georefs,
+             std::vector<GeoTransform> const& world2image) {
+      while (1) {
+        TileKey key;
+        {
+          Mutex::Lock lock(m_mutex);
+          while (!m_stop && m_requests.empty())
+            m_cond.wait(lock);
+          if (m_stop)
+            return;
+          key = m_requests.front();
+          m_requests.pop_front();
+          if (m_tiles.find(key) != m_tiles.end() || !m_in_progress.insert(key).second)
+            continue;
+        }
+
+        // A tile which could not be rendered is kept empty, rather than
+        // being attempted again at each redraw.
+        QImage image;
+        try {
+          image = m_widget->renderTile(key, georefs, world2image);
+        } catch (const std::exception & e) {
+          vw_out(DebugMessage, "asp") << "Could not render tile: " << e.what() << "\n";
+        }
+
+        bool refresh = false;
+        {
+          Mutex::Lock lock(m_mutex);
+          m_in_progress.erase(key);
+          m_lru.push_front(key);
+          CachedTile & tile = m_tiles[key];
+          tile.image = image;
+          tile.lru   = m_lru.begin();
+          while (m_tiles.size() > m_max_num_tiles) {
+            m_tiles.erase(m_lru.back());
+            m_lru.pop_back();
+          }
+          refresh = !m_refresh_pending;
+          m_refresh_pending = true;
+          m_cond.notify_all();
+        }
+
+        // Ask the UI thread to redraw. Several tiles finished before it
+        // gets to it result in a single redraw.
+        if (refresh)
+          QMetaObject::invokeMethod(m_widget, "refreshTiles", Qt::QueuedConnection);
+      }
+    }
+
+  public:
+    /// Keep as many tiles as fit in the given number of megabytes,
+    /// or more if the view needs them.
+    TileRenderer(MainWidget * widget,
+                 std::vector<GeoReference> const& georefs,
+                 std::vector<GeoTransform> const& world2image,
+                 double cache_size_mb):
+      m_widget(widget), m_stop(false), m_refresh_pending(false) {
+      m_cache_num_tiles = std::max(1.0, cache_size_mb*1024.0*1024.0/(4.0*TILE_SIZE*TILE_SIZE));
+      m_max_num_tiles   = m_cache_num_tiles;
+      int num_threads = std::max(1, std::min(MAX_NUM_RENDER_THREADS,
+                                             int(vw_settings().default_num_threads())));
+      for (int i = 0; i < num_threads; i++) {
+        boost::shared_ptr<Worker> worker(new Worker(*this, georefs, world2image));
+        m_threads.push_back(boost::shared_ptr<Thread>(new Thread(worker)));
+      }
+    }
+
+    ~TileRenderer() { stop(); }
+
+    /// Wait for the tiles being rendered and stop the threads.
+    void stop() {
+      {
+        Mutex::Lock lock(m_mutex);
+        if (m_stop)
+          return;
+        m_stop = true;
+        m_requests.clear();
+        m_cond.notify_all();
+      }
+      for (size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i]->join();
+    }
+
+    /// Get a rendered tile. Return false if not available yet.
+    bool get(TileKey const& key, QImage & image) {
+      Mutex::Lock lock(m_mutex);
+      std::map<TileKey, CachedTile>::iterator it = m_tiles.find(key);
+      if (it == m_tiles.end())
+        return false;
+      m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+      image = it->second.image;
+      return true;
+    }
+
+    /// Replace the pending requests. Keep at least twice as many
+    /// tiles as are needed for the current view.
+    void request(std::list<TileKey> const& keys, size_t num_tiles_in_view) {
+      Mutex::Lock lock(m_mutex);
+      m_requests = keys;
+      m_max_num_tiles = std::max(m_cache_num_tiles, 2*num_tiles_in_view);
+      m_cond.notify_all();
+    }
+
+    /// The UI thread redrew after the last notification.
+    void refresh_done() {
+      Mutex::Lock lock(m_mutex);
+      m_refresh_pending = false;
+    }
+
+    /// Drop all tiles, when the images they are rendered from change.
+    /// Waits for the tiles being rendered, if any.
+    void clear() {
+      Mutex::Lock lock(m_mutex);
+      m_requests.clear();
+      while (!m_in_progress.empty())
+        m_cond.wait(lock);
+      m_tiles.clear();
+      m_lru.clear();
+    }
+  };
+
   // --------------------------------------------------------------
   //               MainWidget Public Methods
   // --------------------------------------------------------------
@@ -151,6 +332,9 @@ namespace vw { namespace gui {
     
     // Each image can be hillshaded independently of the other ones
     MainWidget::setHillshadeMode(hillshade);
+    // TODO: Expose these to the user
+    m_hillshade_azimuth   = 300;
+    m_hillshade_elevation = 20;
     
     installEventFilter(this);
 
@@ -221,6 +405,13 @@ namespace vw { namespace gui {
     m_shadow_thresh_calc_mode = false;
     m_shadow_thresh_view_mode = false;
 
+    // Start rendering tiles in the background
+    std::vector<GeoReference> georefs(num_images);
+    for (int i = 0; i < num_images; i++)
+      georefs[i] = m_images[i].georef;
+    m_tile_renderer.reset(new TileRenderer(this, georefs, m_world2image_geotransforms,
+                                           asp::stereo_settings().tile_cache_size));
+
     // To do: Warn the user if some images have georef
     // while others don't.
 
@@ -261,12 +452,14 @@ namespace vw { namespace gui {
     connect(m_allowMultipleSelections_action, SIGNAL(triggered()), this,
             SLOT(allowMultipleSelections()));
 
-    MainWidget::maybeGenHillshade();
+    MainWidget::validateHillshadeMode();
 
   } // End constructor
 
 
   MainWidget::~MainWidget() {
+    // The rendering thread reads the images, so stop it first
+    m_tile_renderer->stop();
   }
 
   bool MainWidget::eventFilter(QObject *obj, QEvent *E){
@@ -462,6 +655,10 @@ namespace vw { namespace gui {
       return;
     }
 
+    // The tiles are rendered from the thresholded images, which are
+    // about to change.
+    m_tile_renderer->clear();
+
     int num_images = m_images.size();
     m_shadow_thresh_images.clear(); // wipe the old copy
     m_shadow_thresh_images.resize(num_images);
@@ -504,14 +701,11 @@ namespace vw { namespace gui {
     refreshPixmap();
   }
 
-  void MainWidget::maybeGenHillshade(){
+  // Hill-shading is done on the fly when drawing, at the resolution
+  // being shown. Here just turn it off for images it does not apply to.
+  void MainWidget::validateHillshadeMode(){
 
     int num_images = m_images.size();
-    m_hillshaded_images.clear(); // wipe the old copy
-    m_hillshaded_images.resize(num_images);
-
-    // Create the hillshaded images and save them to disk. We have to do
-    // it each time as perhaps the hillshade parameters changed.
     for (int image_iter = 0; image_iter < num_images; image_iter++) {
 
       if (!m_hillshade_mode[image_iter]) continue;
@@ -522,24 +716,12 @@ namespace vw { namespace gui {
         return;
       }
 
-      std::string input_file = m_image_files[image_iter];
       int num_channels = m_images[image_iter].img.planes();
       if (num_channels != 1) {
         popUp("Hill-shading makes sense only for single-channel images.");
         m_hillshade_mode[image_iter] = false;
         return;
       }
-
-      // Save the hillshaded images to disk
-      std::string hillshaded_file;
-      bool success = write_hillshade(m_opt, input_file, hillshaded_file);
-      if (!success) {
-        m_hillshade_mode[image_iter] = false;
-        return;
-      }
-
-      m_hillshaded_images[image_iter].read(hillshaded_file, m_opt, m_use_georef);
-      temporary_files().files.insert(hillshaded_file);
     }
   }
 
@@ -571,7 +753,7 @@ namespace vw { namespace gui {
 
     m_shadow_thresh_calc_mode = false;
     m_shadow_thresh_view_mode = false;
-    MainWidget::maybeGenHillshade();
+    MainWidget::validateHillshadeMode();
 
     m_indicesWithAction.clear();
     refreshPixmap();
@@ -706,12 +888,168 @@ namespace vw { namespace gui {
   //             MainWidget Private Methods
   // --------------------------------------------------------------
 
+  // Given a pixel in the full-resolution image, find the pixel in the
+  // sub-sampled clip of it that was fetched for display. Return false
+  // if out of range.
+  static bool image_pix_to_clip_pix(Vector2 p, int image_cols, int image_rows,
+                                    double scale_out, BBox2i const& region_out,
+                                    QImage const& clip, int & px, int & py) {
+    if (!(p[0] >= 0 && p[0] <= image_cols-1 && p[1] >= 0 && p[1] <= image_rows-1))
+      return false;
+
+    // Convert to scaled image pixels and snap to integer value
+    p = round(p/scale_out);
+    if (!region_out.contains(p))
+      return false;
+
+    px = p.x() - region_out.min().x();
+    py = p.y() - region_out.min().y();
+    return (px >= 0 && py >= 0 && px < clip.width() && py < clip.height());
+  }
+
+  void MainWidget::refreshTiles() {
+    if (m_tile_renderer)
+      m_tile_renderer->refresh_done();
+    refreshPixmap();
+  }
+
+  // The image pixel at the center of a given pixel of a tile
+  static Vector2 tile2image(bool use_georef, GeoTransform const& world2image,
+                            BBox2 const& tile_box, double tile_pixel_size,
+                            double col, double row) {
+    Vector2 world_pt = tile_box.min() + tile_pixel_size*Vector2(col + 0.5, row + 0.5);
+    if (!use_georef)
+      return world_pt;
+    return world2image.point_to_pixel(flip_in_y(world_pt));
+  }
+
+  // Find exactly where the nodes of a coarse grid over the tile project
+  // in the image, and interpolate in between. Pixels in cells having
+  // nodes which failed to project are computed exactly.
+  QImage MainWidget::renderTile(TileKey const& key,
+                                std::vector<GeoReference> const& georefs,
+                                std::vector<GeoTransform> const& world2image) const {
+
+    int i = key.image_index;
+    double tile_pixel_size = pow(2.0, key.level); // in world units
+    BBox2 world_box = tile_world_box(key.level, key.col, key.row);
+
+    // Initialize all pixels to transparent
+    QImage tile(TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32_Premultiplied);
+    tile.fill(QColor(0, 0, 0, 0).rgba());
+
+    // Go from world coordinates to pixels in the image
+    BBox2 image_box = world_box;
+    if (m_use_georef)
+      image_box = world2image[i].point_to_pixel_bbox(flip_in_y(world_box));
+
+    // Since the image portion contained in image_box could be huge,
+    // but the tile small, render a sub-sampled version of the image.
+    // Convert to double before multiplication, to avoid overflow
+    // when multiplying large integers.
+    double scale = sqrt((1.0*image_box.width()) * image_box.height())/TILE_SIZE;
+
+    // The tile may extend past the image
+    image_box.crop(m_images[i].image_bbox);
+    if (image_box.empty())
+      return tile;
+
+    // Grow a bit to integer, as otherwise we get strange results
+    // if zooming too close.
+    image_box.min() = floor(image_box.min());
+    image_box.max() = ceil(image_box.max());
+
+    QImage qimg;
+    double scale_out;
+    BBox2i region_out;
+    bool   highlight_nodata = (key.mode == RenderThreshold);
+    if (key.mode == RenderThreshold){
+      m_shadow_thresh_images[i].img.get_image_clip(scale, image_box,
+                                                   highlight_nodata,
+                                                   qimg, scale_out, region_out);
+    }else if (key.mode == RenderHillshade){
+      // Shade on the fly only the portion being shown
+      m_images[i].img.get_hillshaded_clip(scale, image_box, georefs[i],
+                                          m_hillshade_azimuth, m_hillshade_elevation,
+                                          qimg, scale_out, region_out);
+    }else{
+      // Original images
+      m_images[i].img.get_image_clip(scale, image_box,
+                                     highlight_nodata,
+                                     qimg, scale_out, region_out);
+    }
+
+    int image_cols = m_images[i].img.cols(), image_rows = m_images[i].img.rows();
+
+    // The grid has a node past the last pixel, so that every pixel is
+    // in a cell having four nodes.
+    const int grid_step = 16;
+    int grid_size = TILE_SIZE/grid_step + 1;
+    std::vector<Vector2> grid_pix(grid_size*grid_size);
+    std::vector<char>    grid_valid(grid_size*grid_size, 0);
+    for (int gy = 0; gy < grid_size; gy++) {
+      for (int gx = 0; gx < grid_size; gx++) {
+        try {
+          grid_pix[gy*grid_size + gx] = tile2image(m_use_georef, world2image[i], world_box,
+                                                  tile_pixel_size, gx*grid_step, gy*grid_step);
+          grid_valid[gy*grid_size + gx] = 1;
+        }catch ( const std::exception & e ) {}
+      }
+    }
+
+    uchar * bits = tile.bits();
+    int bytes_per_line = tile.bytesPerLine();
+    for (int row = 0; row < TILE_SIZE; row++) {
+      QRgb * line = reinterpret_cast<QRgb*>(bits + row*bytes_per_line);
+      int gy = row/grid_step;
+      double ty = double(row - gy*grid_step)/grid_step;
+      for (int col = 0; col < TILE_SIZE; col++) {
+        int gx = col/grid_step;
+        double tx = double(col - gx*grid_step)/grid_step;
+        int i00 = gy*grid_size + gx, i10 = i00 + 1;
+        int i01 = i00 + grid_size,   i11 = i01 + 1;
+        Vector2 p;
+        if (grid_valid[i00] && grid_valid[i10] && grid_valid[i01] && grid_valid[i11]) {
+          p = (1-ty)*((1-tx)*grid_pix[i00] + tx*grid_pix[i10])
+            +     ty*((1-tx)*grid_pix[i01] + tx*grid_pix[i11]);
+        }else{
+          // Near where the projection failed, typically at the image boundary
+          try {
+            p = tile2image(m_use_georef, world2image[i], world_box, tile_pixel_size, col, row);
+          }catch ( const std::exception & e ) {
+            continue;
+          }
+        }
+        int px, py;
+        if (image_pix_to_clip_pix(p, image_cols, image_rows, scale_out,
+                                  region_out, qimg, px, py))
+          line[col] = qimg.pixel(px, py);
+      }
+    }
+
+    return tile;
+  }
+
   void MainWidget::drawImage(QPainter* paint) {
 
     // Sometimes we arrive here prematurely, before the window geometry was
     // determined. Then, there is nothing to do.
     if (m_current_view.empty()) return;
 
+    Stopwatch sw;
+    sw.start();
+
+    // Draw the tiles whose pixels are the largest power of two of
+    // the world units not exceeding the size of a screen pixel.
+    double screen_pixel_size
+      = std::min(m_current_view.width() /(m_border_factor*m_window_width),
+                 m_current_view.height()/(m_border_factor*m_window_height));
+    if (screen_pixel_size <= 0) return;
+    int level = (int)floor(log(screen_pixel_size)/log(2.0));
+    std::list<TileKey> fine_requests, coarse_requests;
+    std::set<TileKey>  coarse_requested;
+    size_t num_tiles_in_view = 0;
+
     std::list<BBox2i> screen_box_list; // List of regions the images are drawn in
     // Loop through input images
     // - These images get drawn in the same
@@ -744,108 +1082,88 @@ namespace vw { namespace gui {
         screen_box.max().y() = screen_box.min().y() + 1;
       screen_box_list.push_back(screen_box);
 
-      // Go from world coordinates to pixels in the second image.
-      BBox2 image_box = MainWidget::world2image(world_box, i);
-
-      // Grow a bit to integer, as otherwise we get strange results
-      // if zooming too close.
-      image_box.min() = floor(image_box.min());
-      image_box.max() = ceil(image_box.max());
-
-      QImage qimg;
-      // Since the image portion contained in image_box could be huge,
-      // but the screen area small, render a sub-sampled version of
-      // the image for speed.
-      // Convert to double before multiplication, to avoid overflow
-      // when multiplying large integers.
-      double scale = sqrt((1.0*image_box.width()) * image_box.height())/
-        std::max(1.0, sqrt((1.0*screen_box.width()) * screen_box.height()));
-      double scale_out;
-      BBox2i region_out;
-      bool   highlight_nodata = m_shadow_thresh_view_mode;
-      if (m_shadow_thresh_view_mode){
-        m_shadow_thresh_images[i].img.get_image_clip(scale, image_box,
-                                                     highlight_nodata,
-                                                     qimg, scale_out, region_out);
-      }else if (m_hillshade_mode[i]){
-        m_hillshaded_images[i].img.get_image_clip(scale, image_box,
-                                                  highlight_nodata,
-                                                  qimg, scale_out, region_out);
-      }else{
-        // Original images
-        m_images[i].img.get_image_clip(scale, image_box,
-                                       highlight_nodata,
-                                       qimg, scale_out, region_out);
-      }
-
-      // Draw on image screen
-      if (!m_use_georef){
-        // This is a regular image, no georeference, just pass it to the QT painter
-        QRect rect(screen_box.min().x(), screen_box.min().y(),
-                   screen_box.width(), screen_box.height());
-        paint->drawImage (rect, qimg);
-      }else{
-        // We fetched a bunch of pixels at some scale.
-        // Need to place them on the screen at given projected position.
-        // - To do that we will fill up this QImage object with interpolated data, then paint it.
-        QImage qimg2 = QImage(screen_box.width(), screen_box.height(),
-                              QImage::Format_ARGB32_Premultiplied);
-
-        // Initialize all pixels to transparent
-        for (int col = 0; col < qimg2.width(); col++) {
-          for (int row = 0; row < qimg2.height(); row++) {
-            qimg2.setPixel(col, row,  QColor(0, 0, 0, 0).rgba());
+      // The mode in which this image is shown
+      RenderMode mode = RenderOriginal;
+      if (m_shadow_thresh_view_mode)
+        mode = RenderThreshold;
+      else if (m_hillshade_mode[i])
+        mode = RenderHillshade;
+
+      // The tiles at the current level which cover the visible part
+      // of the image
+      double tile_world_size = TILE_SIZE*pow(2.0, level);
+      int beg_col = (int)floor(world_box.min().x()/tile_world_size);
+      int end_col = (int)ceil (world_box.max().x()/tile_world_size);
+      int beg_row = (int)floor(world_box.min().y()/tile_world_size);
+      int end_row = (int)ceil (world_box.max().y()/tile_world_size);
+      for (int row = beg_row; row < end_row; row++) {
+        for (int col = beg_col; col < end_col; col++) {
+
+          TileKey key;
+          key.image_index = i;
+          key.mode        = mode;
+          key.level       = level;
+          key.col         = col;
+          key.row         = row;
+          num_tiles_in_view++;
+
+          BBox2 tile_box = tile_world_box(level, col, row);
+          BBox2 screen_tile_box = world2screen(tile_box);
+          QRectF target(screen_tile_box.min().x(), screen_tile_box.min().y(),
+                        screen_tile_box.width(),   screen_tile_box.height());
+          QImage tile;
+          if (m_tile_renderer->get(key, tile)) {
+            if (!tile.isNull())
+              paint->drawImage(target, tile);
+            continue;
           }
-        }
-
-        // Loop through pixels
-        for (int x = screen_box.min().x(); x < screen_box.max().x(); x++){
-          for (int y = screen_box.min().y(); y < screen_box.max().y(); y++){
-
-            // Convert from a pixel as seen on screen to the world coordinate system.
-            Vector2 world_pt = screen2world(Vector2(x, y));
-
-            // p is in pixel coordinates of m_images[i]
-            Vector2 p;
-            try {
-              p = MainWidget::world2image(world_pt, i);
-              bool is_in = (p[0] >= 0 && p[0] <= m_images[i].img.cols()-1 &&
-                            p[1] >= 0 && p[1] <= m_images[i].img.rows()-1 );
-              if (!is_in) continue; // out of range
-            }catch ( const std::exception & e ) {
+          fine_requests.push_back(key);
+
+          // Meanwhile, show the part of a coarser tile covering this one
+          for (int coarse_level = level + 1; coarse_level <= level + COARSE_LEVELS;
+               coarse_level++) {
+            double ratio = pow(2.0, coarse_level - level);
+            TileKey coarse_key = key;
+            coarse_key.level = coarse_level;
+            coarse_key.col   = (int)floor(col/ratio);
+            coarse_key.row   = (int)floor(row/ratio);
+
+            // Request the coarsest one, as that is fast to render
+            if (coarse_level == level + COARSE_LEVELS &&
+                coarse_requested.insert(coarse_key).second)
+              coarse_requests.push_back(coarse_key);
+
+            if (!m_tile_renderer->get(coarse_key, tile))
               continue;
+            if (!tile.isNull()) {
+              BBox2 coarse_box = tile_world_box(coarse_level, coarse_key.col, coarse_key.row);
+              double coarse_pixel_size = pow(2.0, coarse_level);
+              QRectF source((tile_box.min().x() - coarse_box.min().x())/coarse_pixel_size,
+                            (tile_box.min().y() - coarse_box.min().y())/coarse_pixel_size,
+                            tile_box.width()/coarse_pixel_size,
+                            tile_box.height()/coarse_pixel_size);
+              paint->drawImage(target, tile, source);
             }
-                        
-            // Convert to scaled image pixels and snap to integer value
-            p = round(p/scale_out);
-
-            if (!region_out.contains(p)) continue; // out of range again
-
-            int px = p.x() - region_out.min().x();
-            int py = p.y() - region_out.min().y();
-            if (px < 0 || py < 0 || px >= qimg.width() || py >= qimg.height() ){
-              vw_out() << "Book-keeping failure!";
-              vw_throw(ArgumentErr() << "Book-keeping failure.\n");
-            }
-	    qimg2.setPixel(x-screen_box.min().x(), // Fill the temp QImage object
-                           y-screen_box.min().y(),
-                           qimg.pixel(px, py));
+            break;
           }
-        } // End loop through pixels
-
-        // Send the temp QImage object to the painter
-        QRect rect(screen_box.min().x(), screen_box.min().y(),
-                   screen_box.width(), screen_box.height());
-        paint->drawImage (rect, qimg2);
+        }
       }
 
     } // End loop through input images
 
+    // Render what is missing, the coarse tiles first, as they cover
+    // the view quickly
+    coarse_requests.splice(coarse_requests.end(), fine_requests);
+    m_tile_renderer->request(coarse_requests, num_tiles_in_view);
+
     // Call another function to handle drawing the interest points
     if ((static_cast<size_t>(m_image_id) < m_matches.size()) && m_view_matches) {
       drawInterestPoints(paint, screen_box_list);
     }
 
+    sw.stop();
+    vw_out(DebugMessage, "asp") << "Frame time: " << sw.elapsed_seconds() << " seconds.\n";
+
     return;
   } // End function drawImage()
 
@@ -35,6 +35,7 @@
 // Qt
 #include <QWidget>
 #include <QPoint>
+#include <QImage>
 
 // Qwt
 #include <qwt_plot.h>
@@ -157,6 +158,7 @@ public slots:
     void allowMultipleSelections(); ///< Allow the user to select multiple regions
     void toggleProfileMode(bool profile_mode); ///< Turn on and off the 1D profile tool
     void saveScreenshot();          ///< Save a screenshot of the current imagery
+    void refreshTiles();            ///< Redraw once more tiles got rendered
 
   protected:
 
@@ -298,7 +300,8 @@ public slots:
     bool   m_shadow_thresh_view_mode;
     std::vector<imageData> m_shadow_thresh_images;
 
-    std::vector<imageData> m_hillshaded_images;
+    // The light direction for hill-shading, in degrees
+    double m_hillshade_azimuth, m_hillshade_elevation;
     std::set<int> m_indicesWithAction;
     
     bool m_view_matches; ///< Control if IP's are drawn
@@ -307,8 +310,29 @@ public slots:
     bool & m_allowMultipleSelections; // alias, this is controlled from MainWindow for all widgets
     bool m_can_emit_zoom_all_signal; 
 
+    // The images are drawn from tiles covering fixed regions of the
+    // world, at resolutions which are powers of two of the world
+    // units, so panning and zooming reuse the tiles rendered before.
+    // The tiles are rendered in a background thread. Until a tile is
+    // ready, the part of a coarser tile covering it is drawn instead.
+    enum RenderMode { RenderOriginal, RenderHillshade, RenderThreshold };
+    struct TileKey {
+      int        image_index;
+      RenderMode mode;
+      int        level;    // a tile pixel is 2^level world units wide
+      int        col, row; // position of the tile in the grid at this level
+      bool operator<(TileKey const& other) const;
+    };
+    class TileRenderer; // Defined in MainWidget.cc
+    boost::shared_ptr<TileRenderer> m_tile_renderer;
+
     // Drawing is driven by QPaintEvent, which calls out to drawImage()
     void drawImage(QPainter* paint);
+    /// Render a tile. Called from the background thread, with
+    /// the georeferences and transforms owned by that thread.
+    QImage renderTile(TileKey const& key,
+                      std::vector<vw::cartography::GeoReference> const& georefs,
+                      std::vector<vw::cartography::GeoTransform> const& world2image) const;
     /// Add all the interest points to the provided canvas
     /// - Called internally by drawImage
     void drawInterestPoints(QPainter* paint, std::list<BBox2i> const& valid_regions);
@@ -325,7 +349,7 @@ public slots:
     void updateCurrentMousePosition();
     void updateRubberBand(QRect & R);
     void refreshPixmap();
-    void maybeGenHillshade();
+    void validateHillshadeMode();
     void putImageOnTop(int image_index);
   };
 
@@ -38,6 +38,9 @@
 #include <asp/Sessions/CameraModelLoader.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/RPC_XML.h>
+#include <asp/Camera/SPOT_XML.h>
+#include <asp/Camera/ASTER_XML.h>
+#include <asp/Camera/CameraCache.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <map>
@@ -67,6 +70,11 @@ boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_pinhole_camer
 // - TODO: Move to another file
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_rpc_camera_model(std::string const& path) const
 {
+  std::string cache_dir = stereo_settings().camera_cache_dir;
+  boost::shared_ptr<asp::RPCModel> cached_model;
+  if (cache_dir != "" && read_cached_camera(cache_dir, path, cached_model))
+    return cached_model;
+  
   // Try the default loading method
   RPCModel* rpc_model = NULL;
   try {
@@ -81,6 +89,8 @@ boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_rpc_camera_mo
 
   // We don't catch an error here because the user will need to
   // know of a failure at this point.
+  if (cache_dir != "")
+    write_cached_camera(cache_dir, path, *rpc_model);
   return boost::shared_ptr<asp::RPCModel>(rpc_model);
 }
 
@@ -88,15 +98,32 @@ boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_rpc_camera_mo
 // Load a DG camera file
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_dg_camera_model(std::string const& path) const
 {
+  // Parsing the XML file is slow, so cache what the model is built from
+  std::string cache_dir = stereo_settings().camera_cache_dir;
+  DGCameraParams params;
+  if (cache_dir == "" || !read_cached_camera(cache_dir, path, params)) {
+    params = load_dg_camera_params_from_xml(path);
+    if (cache_dir != "")
+      write_cached_camera(cache_dir, path, params);
+  }
+  
   // Redirect to the call from LinescanDGModel.h file
-  return CameraModelPtr(load_dg_camera_model_from_xml(path));
+  return CameraModelPtr(build_dg_camera_model(params));
 }
 
 // Load a spot5 camera file
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_spot5_camera_model(std::string const& path) const
 {
+  std::string cache_dir = stereo_settings().camera_cache_dir;
+  SpotXML xml_reader;
+  if (cache_dir == "" || !read_cached_camera(cache_dir, path, xml_reader)) {
+    xml_reader.read_xml(path);
+    if (cache_dir != "")
+      write_cached_camera(cache_dir, path, xml_reader);
+  }
+  
   // Redirect to the call from LinescanSpotModel.h file
-  return CameraModelPtr(load_spot5_camera_model_from_xml(path));
+  return CameraModelPtr(load_spot5_camera_model(xml_reader));
 }
 
 // Load a ASTER camera file
@@ -105,8 +132,16 @@ boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_ASTER_camera_
   // This model file also needs the RPC model as an initial guess
   boost::shared_ptr<vw::camera::CameraModel> rpc_model = load_rpc_camera_model(path);
   
+  std::string cache_dir = stereo_settings().camera_cache_dir;
+  ASTERXML xml_reader;
+  if (cache_dir == "" || !read_cached_camera(cache_dir, path, xml_reader)) {
+    xml_reader.read_xml(path);
+    if (cache_dir != "")
+      write_cached_camera(cache_dir, path, xml_reader);
+  }
+  
   // Redirect to the call from LinescanASTERModel.h file
-  return CameraModelPtr(load_ASTER_camera_model_from_xml(path, rpc_model));
+  return CameraModelPtr(load_ASTER_camera_model(xml_reader, rpc_model));
 }
 
 // Load an ISIS camera model
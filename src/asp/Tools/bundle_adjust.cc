@@ -20,6 +20,7 @@
 ///
 
 #include <asp/Core/Macros.h>
+#include <asp/Core/Common.h>
 #include <asp/Sessions/ResourceLoader.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -27,6 +28,8 @@
 #include <asp/Core/PointUtils.h>
 #include <asp/Tools/bundle_adjust.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 
@@ -70,12 +73,13 @@ Mutex g_ba_mutex;
 struct Options : public vw::cartography::GdalWriteOptions {
   std::vector<std::string> image_files, camera_files, gcp_files;
   std::string cnet_file, out_prefix, stereo_session_string,
-    cost_function, ba_type, mapprojected_data, gcp_data;
+    cost_function, ba_type, mapprojected_data, gcp_data, linear_solver, preconditioner;
   int    ip_per_tile;
   double min_triangulation_angle, lambda, camera_weight, robust_threshold;
-  int    report_level, min_matches, max_iterations, overlap_limit;
+  int    report_level, min_matches, max_iterations, overlap_limit, linearized_passes;
 
-  bool   save_iteration, local_pinhole_input, fix_gcp_xyz, solve_intrinsics;
+  bool   save_iteration, local_pinhole_input, fix_gcp_xyz, solve_intrinsics,
+    cache_control_network;
   std::string datum_str, camera_position_file, csv_format_str, csv_proj4_str, intrinsics_to_float_str;
   double semi_major, semi_minor, position_filter_dist;
 
@@ -92,8 +96,9 @@ struct Options : public vw::cartography::GdalWriteOptions {
   // over-written later.
   Options(): ip_per_tile(0), min_triangulation_angle(0), lambda(-1.0), camera_weight(-1),
              robust_threshold(0), report_level(0), min_matches(0),
-             max_iterations(0), overlap_limit(0), save_iteration(false),
+             max_iterations(0), overlap_limit(0), linearized_passes(0), save_iteration(false),
              local_pinhole_input(false), fix_gcp_xyz(false), solve_intrinsics(false),
+             cache_control_network(false),
              semi_major(0), semi_minor(0),
              datum(cartography::Datum(UNSPECIFIED_DATUM, "User Specified Spheroid",
                                       "Reference Meridian", 1, 1, 0)),
@@ -242,6 +247,202 @@ struct BaReprojectionError {
   size_t m_icam, m_ipt;
 };
 
+/// A first-order approximation of BaReprojectionError around given
+/// camera and point parameters. Its value and Jacobians are found
+/// without calling the camera model, which for linescan cameras needs
+/// an iterative solve for each projection. The projection and its
+/// derivatives are computed once in linearize(), which must be called
+/// again as the solution moves away from the linearization point.
+template<class ModelT>
+class BaLinearizedReprojectionError:
+  public ceres::SizedCostFunction<2, ModelT::camera_params_n, ModelT::point_params_n> {
+public:
+  typedef typename ModelT::camera_vector_t CamVecT;
+  typedef typename ModelT::point_vector_t  PtVecT;
+
+  BaLinearizedReprojectionError(Vector2 const& observation, Vector2 const& pixel_sigma,
+                                ModelT * const ba_model, size_t icam, size_t ipt):
+    m_observation(observation), m_pixel_sigma(pixel_sigma),
+    m_ba_model(ba_model), m_icam(icam), m_ipt(ipt), m_valid(false){}
+
+  size_t camera_index() const { return m_icam; }
+  size_t point_index () const { return m_ipt;  }
+
+  bool is_valid() const { return m_valid; }
+
+  /// The exact residual at the linearization point.
+  Vector2 linearization_residual() const {
+    return elem_quot(m_pixel0 - m_observation, m_pixel_sigma);
+  }
+
+  /// Project with the exact camera model.
+  Vector2 exact_pixel(const double* camera, const double* point) const {
+    CamVecT cam_vec;
+    PtVecT  point_vec;
+    for (size_t c = 0; c < cam_vec.size(); c++)
+      cam_vec[c] = camera[c];
+    for (size_t p = 0; p < point_vec.size(); p++)
+      point_vec[p] = point[p];
+    return m_ba_model->cam_pixel(m_ipt, m_icam, cam_vec, point_vec);
+  }
+
+  /// The exact residual at the given parameters, normalized by sigma.
+  Vector2 exact_residual(const double* camera, const double* point) const {
+    return elem_quot(exact_pixel(camera, point) - m_observation, m_pixel_sigma);
+  }
+
+  /// Linearize the projection around the given camera and point. The
+  /// derivatives are found with central differences, using the same
+  /// steps as ceres::NumericDiffCostFunction.
+  void linearize(const double* camera, const double* point) {
+
+    m_valid = false;
+    try {
+      for (size_t c = 0; c < m_cam0.size(); c++)
+        m_cam0[c] = camera[c];
+      for (size_t p = 0; p < m_point0.size(); p++)
+        m_point0[p] = point[p];
+      m_pixel0 = exact_pixel(&m_cam0[0], &m_point0[0]);
+
+      const double relative_step = 1e-6;
+      for (size_t c = 0; c < m_cam0.size(); c++) {
+        CamVecT cam_plus = m_cam0, cam_minus = m_cam0;
+        double step = relative_step * (m_cam0[c] == 0 ? 1.0 : std::abs(m_cam0[c]));
+        cam_plus[c] += step; cam_minus[c] -= step;
+        Vector2 diff = exact_pixel(&cam_plus[0], &m_point0[0])
+                     - exact_pixel(&cam_minus[0], &m_point0[0]);
+        for (int r = 0; r < 2; r++)
+          m_cam_jac(r, c) = diff[r]/(2*step);
+      }
+      for (size_t p = 0; p < m_point0.size(); p++) {
+        PtVecT point_plus = m_point0, point_minus = m_point0;
+        double step = relative_step * (m_point0[p] == 0 ? 1.0 : std::abs(m_point0[p]));
+        point_plus[p] += step; point_minus[p] -= step;
+        Vector2 diff = exact_pixel(&m_cam0[0], &point_plus[0])
+                     - exact_pixel(&m_cam0[0], &point_minus[0]);
+        for (int r = 0; r < 2; r++)
+          m_point_jac(r, p) = diff[r]/(2*step);
+      }
+      m_valid = true;
+    } catch (std::exception const& e) {
+      Mutex::Lock lock( g_ba_mutex );
+      g_ba_num_errors++;
+      if (g_ba_num_errors < 100)
+        vw_out(ErrorMessage) << e.what() << std::endl;
+    }
+  }
+
+  /// Residual of the first-order approximation, with analytic Jacobians.
+  virtual bool Evaluate(double const* const* parameters,
+                        double* residuals, double** jacobians) const {
+
+    if (!m_valid) {
+      residuals[0] = 1e+20;
+      residuals[1] = 1e+20;
+      return false;
+    }
+
+    const double* camera = parameters[0];
+    const double* point  = parameters[1];
+    int nc = m_cam0.size(), np = m_point0.size();
+    for (int r = 0; r < 2; r++) {
+      double pixel = m_pixel0[r];
+      for (int c = 0; c < nc; c++)
+        pixel += m_cam_jac(r, c) * (camera[c] - m_cam0[c]);
+      for (int p = 0; p < np; p++)
+        pixel += m_point_jac(r, p) * (point[p] - m_point0[p]);
+      residuals[r] = (pixel - m_observation[r])/m_pixel_sigma[r];
+    }
+
+    if (jacobians == NULL)
+      return true;
+
+    // Row-major storage, one row per residual
+    for (int r = 0; r < 2; r++) {
+      if (jacobians[0] != NULL)
+        for (int c = 0; c < nc; c++)
+          jacobians[0][r*nc + c] = m_cam_jac(r, c)/m_pixel_sigma[r];
+      if (jacobians[1] != NULL)
+        for (int p = 0; p < np; p++)
+          jacobians[1][r*np + p] = m_point_jac(r, p)/m_pixel_sigma[r];
+    }
+
+    return true;
+  }
+
+private:
+  Vector2 m_observation;
+  Vector2 m_pixel_sigma;
+  ModelT * const m_ba_model;
+  size_t m_icam, m_ipt;
+
+  // The linearization point, and the projection and its derivatives there
+  bool    m_valid;
+  CamVecT m_cam0;
+  PtVecT  m_point0;
+  Vector2 m_pixel0;
+  Matrix<double, 2, ModelT::camera_params_n> m_cam_jac;
+  Matrix<double, 2, ModelT::point_params_n>  m_point_jac;
+};
+
+/// The exact reprojection error for the observation of a linearized
+/// cost function, used only to evaluate the cost, never to solve. An
+/// observation which fails to project contributes nothing and is
+/// flagged, so that the failures can be counted.
+template<class ModelT>
+class BaExactReprojectionError:
+  public ceres::SizedCostFunction<2, ModelT::camera_params_n, ModelT::point_params_n> {
+public:
+  BaExactReprojectionError(BaLinearizedReprojectionError<ModelT> const* lin):
+    m_lin(lin), m_failed(false){}
+
+  bool failed() const { return m_failed; }
+
+  virtual bool Evaluate(double const* const* parameters,
+                        double* residuals, double** jacobians) const {
+    if (jacobians != NULL)
+      return false; // Not meant for solving
+    m_failed = false;
+    try {
+      Vector2 residual = m_lin->exact_residual(parameters[0], parameters[1]);
+      residuals[0] = residual[0];
+      residuals[1] = residual[1];
+    } catch (std::exception const& e) {
+      m_failed = true;
+      residuals[0] = 0.0;
+      residuals[1] = 0.0;
+    }
+    return true;
+  }
+
+private:
+  BaLinearizedReprojectionError<ModelT> const* m_lin;
+  mutable bool m_failed;
+};
+
+/// Linearize a range of the linearized cost functions at the current
+/// solution, so that the camera projections are done in parallel.
+template<class ModelT>
+class LinearizeTask: public vw::Task {
+  std::vector<BaLinearizedReprojectionError<ModelT>*> const& m_linearized;
+  double const* m_cameras;
+  double const* m_points;
+  size_t m_begin, m_end;
+public:
+  LinearizeTask(std::vector<BaLinearizedReprojectionError<ModelT>*> const& linearized,
+                double const* cameras, double const* points, size_t begin, size_t end):
+    m_linearized(linearized), m_cameras(cameras), m_points(points),
+    m_begin(begin), m_end(end){}
+
+  void operator()() {
+    for (size_t it = m_begin; it < m_end; it++) {
+      BaLinearizedReprojectionError<ModelT> * lin = m_linearized[it];
+      lin->linearize(m_cameras + lin->camera_index() * ModelT::camera_params_n,
+                     m_points  + lin->point_index()  * ModelT::point_params_n);
+    }
+  }
+};
+
 /// A ceres cost function. Here we float a pinhole camera's intrinsic
 /// and extrinsic parameters. The result is the residual, the
 /// difference in the observation and the projection of the point into
@@ -484,11 +685,21 @@ void add_residual_block(ModelT & ba_model,
                         double * camera, double * point, double * intrinsics,
                         std::set<std::string> const& intrinsics_to_float,
                         ceres::LossFunction* loss_function,
-                        ceres::Problem & problem){
-
-  ceres::CostFunction* cost_function =
-    BaReprojectionError<ModelT>::Create(observation, pixel_sigma,
-                                        &ba_model, icam, ipt);
+                        ceres::Problem & problem,
+                        std::vector<BaLinearizedReprojectionError<ModelT>*> * linearized){
+
+  ceres::CostFunction* cost_function = NULL;
+  if (linearized != NULL) {
+    // Will be linearized before solving
+    BaLinearizedReprojectionError<ModelT> * lin_cost_function =
+      new BaLinearizedReprojectionError<ModelT>(observation, pixel_sigma,
+                                                &ba_model, icam, ipt);
+    linearized->push_back(lin_cost_function);
+    cost_function = lin_cost_function;
+  }else{
+    cost_function = BaReprojectionError<ModelT>::Create(observation, pixel_sigma,
+                                                        &ba_model, icam, ipt);
+  }
   problem.AddResidualBlock(cost_function, loss_function, camera, point);
 }
 
@@ -501,12 +712,21 @@ void add_residual_block<BAPinholeModel>
                    double * camera, double * point, double * intrinsics,
                    std::set<std::string> const& intrinsics_to_float,
                    ceres::LossFunction* loss_function,
-                   ceres::Problem & problem){
+                   ceres::Problem & problem,
+                   std::vector<BaLinearizedReprojectionError<BAPinholeModel>*> * linearized){
   // If the intrinsics are constant use the default method above
   if (ba_model.are_intrinsics_constant()) {
-    ceres::CostFunction* cost_function =
-      BaReprojectionError<BAPinholeModel>::Create(observation, pixel_sigma,
-                                                  &ba_model, icam, ipt);
+    ceres::CostFunction* cost_function = NULL;
+    if (linearized != NULL) {
+      BaLinearizedReprojectionError<BAPinholeModel> * lin_cost_function =
+        new BaLinearizedReprojectionError<BAPinholeModel>(observation, pixel_sigma,
+                                                          &ba_model, icam, ipt);
+      linearized->push_back(lin_cost_function);
+      cost_function = lin_cost_function;
+    }else{
+      cost_function = BaReprojectionError<BAPinholeModel>::Create(observation, pixel_sigma,
+                                                                  &ba_model, icam, ipt);
+    }
     problem.AddResidualBlock(cost_function, loss_function, camera, point);
   }
   else {
@@ -565,6 +785,120 @@ void add_residual_block<BAPinholeModel>
 }
 
 
+/// Print the time spent in the linear solver and the memory used at
+/// each iteration, to help choose the linear solver.
+class BaCallback: public ceres::IterationCallback {
+public:
+  virtual ceres::CallbackReturnType operator()
+    (const ceres::IterationSummary& summary) {
+    vw_out() << "Iteration " << summary.iteration << ": linear solver time: "
+             << summary.linear_solver_time_in_seconds << " seconds ("
+             << summary.linear_solver_iterations << " linear iterations), "
+             << "iteration time: " << summary.iteration_time_in_seconds << " seconds, "
+             << "peak memory: " << asp::peak_memory_mb() << " MB." << std::endl;
+    return ceres::SOLVER_CONTINUE;
+  }
+};
+
+/// Set the linear solver and preconditioner, picking them based on the
+/// number of cameras if set to "auto". Dense Schur is fastest for
+/// a handful of cameras. The sparse factorization of the reduced
+/// camera matrix can run out of memory for thousands of cameras, and
+/// then an iterative solver is preferable.
+void set_linear_solver(Options const& opt, int num_cameras,
+                       ceres::Solver::Options & options){
+
+  const int MAX_DENSE_CAMERAS  = 20;
+  const int MIN_ITERATIVE_CAMERAS = 1000;
+
+  std::string solver = opt.linear_solver;
+  if (solver == "auto") {
+    if (num_cameras <= MAX_DENSE_CAMERAS)
+      solver = "dense_schur";
+    else if (num_cameras >= MIN_ITERATIVE_CAMERAS)
+      solver = "iterative_schur";
+    else
+      solver = "sparse_schur";
+  }
+
+  if (solver == "dense_schur")
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+  else if (solver == "sparse_schur")
+    options.linear_solver_type = ceres::SPARSE_SCHUR;
+  else if (solver == "iterative_schur")
+    options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+  else
+    vw_throw( ArgumentErr() << "Unknown linear solver: " << opt.linear_solver << ".\n" );
+
+  if (opt.preconditioner == "schur_jacobi")
+    options.preconditioner_type = ceres::SCHUR_JACOBI;
+  else if (opt.preconditioner == "cluster_jacobi")
+    options.preconditioner_type = ceres::CLUSTER_JACOBI;
+  else
+    vw_throw( ArgumentErr() << "Unknown preconditioner: " << opt.preconditioner << ".\n" );
+
+  vw_out() << "Using the " << solver << " linear solver";
+  if (options.linear_solver_type == ceres::ITERATIVE_SCHUR)
+    vw_out() << " with the " << opt.preconditioner << " preconditioner";
+  vw_out() << " for " << num_cameras << " cameras." << std::endl;
+}
+
+/// Add the cost functions keeping the ground control points and the
+/// cameras close to their input values. Return the number of GCP.
+template <class ModelT>
+int add_gcp_and_camera_blocks(Options const& opt, ControlNetwork const& cnet,
+                              std::vector<double> const& orig_cameras_vec,
+                              double * cameras, double * points,
+                              ceres::Problem & problem){
+
+  int num_camera_params = ModelT::camera_params_n;
+  int num_point_params  = ModelT::point_params_n;
+  int num_cameras       = orig_cameras_vec.size()/num_camera_params;
+  int num_points        = cnet.size();
+
+  // Add ground control points
+  // - Error goes up as GCP's move from their input positions.
+  int num_gcp = 0;
+  for (int ipt = 0; ipt < num_points; ipt++){
+    if (cnet[ipt].type() != ControlPoint::GroundControlPoint) continue;
+
+    num_gcp++;
+    
+    Vector3 observation = cnet[ipt].position();
+    Vector3 xyz_sigma   = cnet[ipt].sigma();
+
+    ceres::CostFunction* cost_function = XYZError::Create(observation, xyz_sigma);
+
+    ceres::LossFunction* loss_function = get_loss_function(opt);
+
+    double * point  = points  + ipt * num_point_params;
+    problem.AddResidualBlock(cost_function, loss_function, point);
+
+    if (opt.fix_gcp_xyz) 
+      problem.SetParameterBlockConstant(point);
+  }
+
+  // Add camera constraints
+  // - Error goes up as cameras move and rotate from their input positions.
+  if (opt.camera_weight > 0){
+    for (int icam = 0; icam < num_cameras; icam++){
+
+      typename ModelT::camera_vector_t orig_cam;
+      for (int q = 0; q < num_camera_params; q++)
+        orig_cam[q] = orig_cameras_vec[icam * num_camera_params + q];
+
+      ceres::CostFunction* cost_function = CamError<ModelT>::Create(orig_cam, opt.camera_weight);
+
+      ceres::LossFunction* loss_function = get_loss_function(opt);
+
+      double * camera  = cameras  + icam * num_camera_params;
+      problem.AddResidualBlock(cost_function, loss_function, camera);
+    }
+  }
+
+  return num_gcp;
+}
+
 // Use Ceres to do bundle adjustment. The camera and point variables
 // are stored in arrays.  The projection of point into camera is
 // accomplished by interfacing with the bundle adjustment model. In
@@ -621,6 +955,12 @@ void do_ba_ceres(ModelT & ba_model, Options& opt ){
 
   CameraRelationNetwork<JFeature> crn;
   crn.read_controlnetwork(cnet);
+
+  // If to replace the exact reprojection errors with their
+  // linearizations, which are cheaper to differentiate.
+  typedef BaLinearizedReprojectionError<ModelT> LinErrT;
+  std::vector<LinErrT*> linearized;
+  bool use_linearized = (opt.linearized_passes > 0);
   
   // Now add the various cost functions the solver will optimize over.
 
@@ -657,49 +997,20 @@ void do_ba_ceres(ModelT & ba_model, Options& opt ){
       // Call function to select the appropriate Ceres residual block to add.
       add_residual_block(ba_model, observation, pixel_sigma, icam, ipt,
                          camera, point, intrinsics, opt.intrinsics_to_float,
-                         loss_function, problem);
+                         loss_function, problem,
+                         use_linearized ? &linearized : NULL);
     }
   }
 
-  // Add ground control points
-  // - Error goes up as GCP's move from their input positions.
-  int num_gcp = 0;
-  for (int ipt = 0; ipt < num_points; ipt++){
-    if (cnet[ipt].type() != ControlPoint::GroundControlPoint) continue;
-
-    num_gcp++;
-    
-    Vector3 observation = cnet[ipt].position();
-    Vector3 xyz_sigma   = cnet[ipt].sigma();
-
-    ceres::CostFunction* cost_function = XYZError::Create(observation, xyz_sigma);
-
-    ceres::LossFunction* loss_function = get_loss_function(opt);
-
-    double * point  = points  + ipt * num_point_params;
-    problem.AddResidualBlock(cost_function, loss_function, point);
-
-    if (opt.fix_gcp_xyz) 
-      problem.SetParameterBlockConstant(point);
+  if (use_linearized && linearized.empty()) {
+    vw_out() << "Linearized passes are not supported when solving for intrinsics. "
+             << "Will use the exact camera models." << std::endl;
+    use_linearized = false;
   }
 
-  // Add camera constraints
-  // - Error goes up as cameras move and rotate from their input positions.
-  if (opt.camera_weight > 0){
-    for (int icam = 0; icam < num_cameras; icam++){
-
-      typename ModelT::camera_vector_t orig_cam;
-      for (int q = 0; q < num_camera_params; q++)
-        orig_cam[q] = orig_cameras_vec[icam * num_camera_params + q];
-
-      ceres::CostFunction* cost_function = CamError<ModelT>::Create(orig_cam, opt.camera_weight);
-
-      ceres::LossFunction* loss_function = get_loss_function(opt);
-
-      double * camera  = cameras  + icam * num_camera_params;
-      problem.AddResidualBlock(cost_function, loss_function, camera);
-    }
-  }
+  // Add the ground control points and the camera constraints
+  int num_gcp = add_gcp_and_camera_blocks<ModelT>(opt, cnet, orig_cameras_vec,
+                                                  cameras, points, problem);
 
   // Solve the problem
   ceres::Solver::Options options;
@@ -713,24 +1024,120 @@ void do_ba_ceres(ModelT & ba_model, Options& opt ){
     options.num_threads = 1;
   else
     options.num_threads = opt.num_threads;
+  options.num_linear_solver_threads = options.num_threads;
+
+  // Eliminate the points first, then solve for the cameras (and
+  // intrinsics). This is what Ceres would find on its own, but it is
+  // cheaper to say it than to have Ceres search for it.
+  ceres::ParameterBlockOrdering* ordering = new ceres::ParameterBlockOrdering;
+  for (int ipt = 0; ipt < num_points; ipt++) {
+    double * point = points + ipt * num_point_params;
+    if (problem.HasParameterBlock(point))
+      ordering->AddElementToGroup(point, 0);
+  }
+  for (int icam = 0; icam < num_cameras; icam++) {
+    double * camera = cameras + icam * num_camera_params;
+    if (problem.HasParameterBlock(camera))
+      ordering->AddElementToGroup(camera, 1);
+  }
+  int nf = BAPinholeModel::focal_length_params_n;
+  int nc = BAPinholeModel::optical_center_params_n;
+  double * intr_blocks[] = {intrinsics, intrinsics + nf, intrinsics + nf + nc};
+  for (int b = 0; b < 3 && intrinsics != NULL; b++) {
+    if (problem.HasParameterBlock(intr_blocks[b]))
+      ordering->AddElementToGroup(intr_blocks[b], 1);
+  }
+  options.linear_solver_ordering.reset(ordering);
+
+  set_linear_solver(opt, num_cameras, options);
+
+  // Print the linear solver time and memory usage at each iteration
+  BaCallback callback;
+  options.callbacks.push_back(&callback);
+
+  Stopwatch sw;
+  sw.start();
+  if (!use_linearized) {
+    vw_out() << "Starting the Ceres optimizer..." << std::endl;
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    vw_out() << summary.FullReport() << "\n";
+    if (summary.termination_type == ceres::NO_CONVERGENCE){
+      // Print a clarifying message, so the user does not think that the algorithm failed.
+      vw_out() << "Found a valid solution, but did not reach the actual minimum." << std::endl;
+    }
+  }else{
+    // Solve with the linearized reprojection errors, then linearize
+    // again at the new solution and repeat. Before each pass the
+    // exact cost is evaluated, including the GCP and camera terms, and
+    // if it did not decrease, or more observations failed to project,
+    // the previous solution is kept.
+    ceres::Problem exact_problem;
+    typedef BaExactReprojectionError<ModelT> ExactErrT;
+    std::vector<ExactErrT*> exact_errors;
+    for (size_t it = 0; it < linearized.size(); it++) {
+      LinErrT * lin = linearized[it];
+      ExactErrT * exact_error = new ExactErrT(lin);
+      exact_errors.push_back(exact_error);
+      exact_problem.AddResidualBlock(exact_error, get_loss_function(opt),
+                                     cameras + lin->camera_index() * num_camera_params,
+                                     points  + lin->point_index()  * num_point_params);
+    }
+    add_gcp_and_camera_blocks<ModelT>(opt, cnet, orig_cameras_vec,
+                                      cameras, points, exact_problem);
+    ceres::Problem::EvaluateOptions eval_options;
+    eval_options.num_threads = options.num_threads;
+
+    double prev_cost = std::numeric_limits<double>::max();
+    size_t prev_num_failed = std::numeric_limits<size_t>::max();
+    std::vector<double> prev_cameras_vec = cameras_vec, prev_points_vec = points_vec;
+    for (int pass = 0; pass <= opt.linearized_passes; pass++) {
+
+      double cost = 0.0;
+      exact_problem.Evaluate(eval_options, &cost, NULL, NULL, NULL);
+      size_t num_failed = 0;
+      for (size_t it = 0; it < exact_errors.size(); it++)
+        if (exact_errors[it]->failed()) num_failed++;
+      vw_out() << "Exact cost after " << pass << " linearized pass(es): " << cost;
+      if (num_failed > 0)
+        vw_out() << " (" << num_failed << " observations failed to project)";
+      vw_out() << " (elapsed: " << sw.elapsed_seconds() << " seconds)." << std::endl;
+
+      if (num_failed > prev_num_failed || (num_failed == prev_num_failed && cost >= prev_cost)) {
+        vw_out() << "The cost did not decrease. Reverting to the previous solution." << std::endl;
+        cameras_vec = prev_cameras_vec;
+        points_vec  = prev_points_vec;
+        break;
+      }
+      if (pass == opt.linearized_passes)
+        break;
+      prev_cost = cost;
+      prev_num_failed = num_failed;
+      prev_cameras_vec = cameras_vec;
+      prev_points_vec  = points_vec;
+
+      // Linearize at the current solution, in parallel
+      {
+        FifoWorkQueue queue(std::max(options.num_threads, 1));
+        size_t batch_size = 1000;
+        for (size_t begin = 0; begin < linearized.size(); begin += batch_size) {
+          size_t end = std::min(begin + batch_size, linearized.size());
+          boost::shared_ptr<Task> task(new LinearizeTask<ModelT>(linearized, cameras, points,
+                                                                 begin, end));
+          queue.add_task(task);
+        }
+        queue.join_all();
+      }
 
-  options.linear_solver_type = ceres::SPARSE_SCHUR;
-  //options.ordering_type = ceres::SCHUR;
-  //options.eta = 1e-3; // FLAGS_eta;
-  //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
-  //options->use_nonmonotonic_steps = FLAGS_nonmonotonic_steps;
-  //if (FLAGS_line_search) {
-  //  options->minimizer_type = ceres::LINE_SEARCH;
-  //}
-
-  vw_out() << "Starting the Ceres optimizer..." << std::endl;
-  ceres::Solver::Summary summary;
-  ceres::Solve(options, &problem, &summary);
-  vw_out() << summary.FullReport() << "\n";
-  if (summary.termination_type == ceres::NO_CONVERGENCE){
-    // Print a clarifying message, so the user does not think that the algorithm failed.
-    vw_out() << "Found a valid solution, but did not reach the actual minimum." << std::endl;
+      vw_out() << "Starting the Ceres optimizer, linearized pass " << pass + 1
+               << " of " << opt.linearized_passes << "..." << std::endl;
+      ceres::Solver::Summary summary;
+      ceres::Solve(options, &problem, &summary);
+      vw_out() << summary.BriefReport() << "\n";
+    }
   }
+  sw.stop();
+  vw_out() << "Optimization time: " << sw.elapsed_seconds() << " seconds." << std::endl;
 
   // Copy the latest version of the optimized intrinsic variables back
   // into the the separate parameter vectors in ba_model, right after
@@ -827,6 +1234,47 @@ void do_ba_nonceres(typename AdjusterT::model_type & ba_model,
 
 } // end do_ba_nonceres
 
+/// Append the name, size, and modification time of a file, if it exists.
+void describe_file(std::ostream & os, std::string const& label, std::string const& file){
+  os << label << ' ' << file;
+  if (!file.empty() && fs::exists(file))
+    os << ' ' << fs::file_size(file) << ' ' << fs::last_write_time(file);
+  os << "\n";
+}
+
+/// Describe everything the control network is built from, so that a
+/// cached network is reused only if none of it changed. The images
+/// are included even when separate cameras are given, as for ISIS the
+/// camera is stored in the cube.
+std::string control_network_inputs_description(Options const& opt,
+                                               std::map< std::pair<int, int>, std::string>
+                                               const& match_files){
+  std::ostringstream os;
+  os.precision(17);
+  os << "min_matches " << opt.min_matches << "\n";
+  os << "min_triangulation_angle " << opt.min_triangulation_angle << "\n";
+  os << "session " << opt.stereo_session_string << "\n";
+  std::string adjust_prefix = asp::stereo_settings().bundle_adjust_prefix;
+  os << "initial_adjustments " << adjust_prefix << "\n";
+  for (size_t i = 0; i < opt.image_files.size(); i++) {
+    describe_file(os, "image", opt.image_files[i]);
+    if (i < opt.camera_files.size())
+      describe_file(os, "camera", opt.camera_files[i]);
+    if (adjust_prefix != "")
+      describe_file(os, "adjustment",
+                    asp::bundle_adjust_file_name(adjust_prefix, opt.image_files[i],
+                                                 i < opt.camera_files.size() ?
+                                                 opt.camera_files[i] : ""));
+  }
+  typedef std::map< std::pair<int, int>, std::string>::const_iterator MatchIter;
+  for (MatchIter it = match_files.begin(); it != match_files.end(); it++) {
+    std::ostringstream label;
+    label << "match " << it->first.first << ' ' << it->first.second;
+    describe_file(os, label.str(), it->second);
+  }
+  return os.str();
+}
+
 void save_cnet_as_csv(Options& opt, std::string const& cnetFile){
 
   // Save the input control network in the csv file format used by ground
@@ -1611,6 +2059,14 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
                         "Individually normalize the input images instead of using common values.")
     ("max-iterations",   po::value(&opt.max_iterations)->default_value(1000),
                          "Set the maximum number of iterations.")
+    ("linear-solver",    po::value(&opt.linear_solver)->default_value("sparse_schur"),
+                         "The Ceres linear solver. Options: sparse_schur, dense_schur, iterative_schur, auto. With auto, use dense_schur for up to 20 cameras, iterative_schur for 1000 cameras or more, and sparse_schur otherwise. The solver can change the results somewhat.")
+    ("preconditioner",   po::value(&opt.preconditioner)->default_value("schur_jacobi"),
+                         "The preconditioner to use with the iterative_schur linear solver. Options: schur_jacobi, cluster_jacobi.")
+    ("linearized-passes", po::value(&opt.linearized_passes)->default_value(0),
+                         "If positive, replace the camera projections with their linearizations around the current solution, solve, and repeat this many times. Much faster for linescan cameras. Only for the Ceres solver, and not when solving for intrinsics.")
+    ("cache-control-network", po::bool_switch(&opt.cache_control_network)->default_value(false)->implicit_value(true),
+                         "Save the control network to <output prefix>-control.cnet, and reuse it in a later run if the images, cameras, initial adjustments, matches, and triangulation options are unchanged.")
     ("overlap-limit",    po::value(&opt.overlap_limit)->default_value(0),
                          "Limit the number of subsequent images to search for matches to the current image to this value.  By default match all images.")
     ("overlap-list",    po::value(&opt.overlap_list_file)->default_value(""),
@@ -1692,6 +2148,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if ( opt.camera_weight < 0.0 )
     vw_throw( ArgumentErr() << "The camera weight must be non-negative.\n" << usage << general_options );
 
+  if ( opt.linearized_passes < 0 )
+    vw_throw( ArgumentErr() << "The number of linearized passes must be non-negative.\n"
+              << usage << general_options );
+
   if (opt.local_pinhole_input && !asp::has_pinhole_extension(opt.camera_files[0]))
     vw_throw( ArgumentErr() << "Can't use special pinhole handling with non-pinhole input!\n");
 
@@ -1749,6 +2209,18 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   boost::to_lower( opt.stereo_session_string );
   boost::to_lower( opt.ba_type );
   boost::to_lower( opt.cost_function );
+  boost::to_lower( opt.linear_solver );
+  boost::to_lower( opt.preconditioner );
+  if ( !( opt.linear_solver == "auto"        ||
+          opt.linear_solver == "dense_schur" ||
+          opt.linear_solver == "sparse_schur" ||
+          opt.linear_solver == "iterative_schur" ) )
+    vw_throw( ArgumentErr() << "Unknown linear solver: " << opt.linear_solver
+              << ". Options are: [auto, dense_schur, sparse_schur, iterative_schur]\n" );
+  if ( !( opt.preconditioner == "schur_jacobi" ||
+          opt.preconditioner == "cluster_jacobi" ) )
+    vw_throw( ArgumentErr() << "Unknown preconditioner: " << opt.preconditioner
+              << ". Options are: [schur_jacobi, cluster_jacobi]\n" );
   if ( !( opt.ba_type == "ceres"        ||
           opt.ba_type == "robustsparse" ||
           opt.ba_type == "robustref"    ||
@@ -1926,12 +2398,29 @@ int main(int argc, char* argv[]) {
     //   world coordinate estimate for each matched IP.
     opt.cnet.reset( new ControlNetwork("BundleAdjust") );
     if ( opt.cnet_file.empty() ) {
-      bool success = vw::ba::build_control_network( true, // Always have input cameras
-                                                    (*opt.cnet), opt.camera_models,
-                                                    opt.image_files,
-                                                    match_files,
-                                                    opt.min_matches,
-                                                    opt.min_triangulation_angle*(M_PI/180));
+
+      // If asked, reuse the control network from a previous run if
+      // made from the same inputs, as building it for many images is
+      // expensive.
+      std::string inputs_description;
+      bool success = false;
+      if (opt.cache_control_network) {
+        inputs_description = control_network_inputs_description(opt, match_files);
+        success = asp::read_control_network_cache(opt.out_prefix, inputs_description,
+                                                  (*opt.cnet));
+      }
+      if (!success) {
+        int num_threads = opt.num_threads;
+        if (opt.stereo_session_string == "isis")
+          num_threads = 1; // ISIS camera models are not thread-safe
+        success = asp::build_control_network_streaming((*opt.cnet), opt.camera_models,
+                                                       match_files,
+                                                       opt.min_matches,
+                                                       opt.min_triangulation_angle*(M_PI/180),
+                                                       num_threads);
+        if (success && opt.cache_control_network)
+          asp::write_control_network_cache(opt.out_prefix, inputs_description, (*opt.cnet));
+      }
       if (!success) {
         vw_out() << "Failed to build a control network. Consider removing "
                  << "the currently found interest point matches and increasing "
@@ -34,6 +34,7 @@
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <map>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -46,9 +47,12 @@
 #include <vw/Cartography.h>
 #include <vw/Math.h>
 #include <vw/FileIO/DiskImageManager.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/Image/InpaintView.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/PixelQuantiles.h>
 
 
 #include <boost/math/special_functions/fpclassify.hpp>
@@ -234,7 +238,9 @@ struct Options : vw::cartography::GdalWriteOptions {
   double out_nodata_value;
   int    tile_size, tile_index, erode_len, priority_blending_len, extra_crop_len, hole_fill_len, block_size, save_dem_weight;
   double  weights_exp, weights_blur_sigma, dem_blur_sigma;
-  double nodata_threshold;
+  double nodata_threshold, percentile, memory_budget;
+  int    exact_quantile_count;
+  bool   cache_weights, nmad;
   bool   first, last, min, max, block_max, mean, stddev, median, count, save_index_map, use_centerline_weights;
   std::set<int> tile_list;
   BBox2 projwin;
@@ -242,7 +248,8 @@ struct Options : vw::cartography::GdalWriteOptions {
 	     erode_len(0), priority_blending_len(0), extra_crop_len(0),
 	     hole_fill_len(0), block_size(0), save_dem_weight(-1),
 	     weights_exp(0), weights_blur_sigma(0.0), dem_blur_sigma(0.0),
-	     nodata_threshold(std::numeric_limits<double>::quiet_NaN()),
+	     nodata_threshold(std::numeric_limits<double>::quiet_NaN()), percentile(-1.0),
+	     memory_budget(0.0), exact_quantile_count(0), cache_weights(false), nmad(false),
 	     first(false), last(false), min(false), max(false), block_max(false),
 	     mean(false), stddev(false), median(false), count(false), save_index_map(false),
 	     use_centerline_weights(false) {}
@@ -251,7 +258,27 @@ struct Options : vw::cartography::GdalWriteOptions {
 /// Return the number of no-blending options selected.
 int no_blend(Options const& opt){
   return int(opt.first) + int(opt.last) + int(opt.min) + int(opt.max)
-    + int(opt.mean) + int(opt.stddev) + int(opt.median) + int(opt.count) + int(opt.block_max);
+    + int(opt.mean) + int(opt.stddev) + int(opt.median) + int(opt.count) + int(opt.block_max)
+    + int(opt.percentile >= 0) + int(opt.nmad);
+}
+
+/// Return true if the output is an order statistic of the DEM values at each pixel.
+bool order_statistic(Options const& opt){
+  return opt.median || opt.percentile >= 0 || opt.nmad;
+}
+
+/// The quantiles to track at each pixel for the order statistic to output.
+std::vector<double> tracked_quantiles(Options const& opt){
+  std::vector<double> quantiles;
+  if (opt.median)
+    quantiles.push_back(0.5);
+  if (opt.percentile >= 0)
+    quantiles.push_back(opt.percentile/100.0);
+  if (opt.nmad) {
+    quantiles.push_back(0.25);
+    quantiles.push_back(0.75);
+  }
+  return quantiles;
 }
 
 std::string tile_suffix(Options const& opt){
@@ -264,6 +291,8 @@ std::string tile_suffix(Options const& opt){
   if (opt.mean     ) ans = "-mean";
   if (opt.stddev   ) ans = "-stddev";
   if (opt.median   ) ans = "-median";
+  if (opt.percentile >= 0) ans = "-percentile-" + stringify(opt.percentile);
+  if (opt.nmad     ) ans = "-nmad";
   if (opt.count    ) ans = "-count";
   if (opt.save_index_map)       ans += "-index-map";
   if (opt.save_dem_weight >= 0) ans += "-weight-dem-index-" + stringify(opt.save_dem_weight);
@@ -271,6 +300,171 @@ std::string tile_suffix(Options const& opt){
   return ans;
 }
 
+typedef PixelGrayA<double> DoubleGrayA;
+
+/// If the nodata threshold is specified, all values no more than this
+/// will be invalidated, and it becomes the nodata value.
+void apply_nodata_threshold(Options const& opt, ImageView<DoubleGrayA> & dem,
+                            double & nodata_value){
+  if (boost::math::isnan(opt.nodata_threshold))
+    return;
+  
+  nodata_value = opt.nodata_threshold;
+  for (int col = 0; col < dem.cols(); col++) {
+    for (int row = 0; row < dem.rows(); row++) {
+      if (dem(col, row)[0] <= nodata_value) {
+        dem(col, row)[0] = nodata_value;
+      }
+    }
+  }
+}
+
+/// Compute the blending weights of a DEM, or of a crop of it which
+/// extends by 'bias' beyond the region of interest.
+ImageView<double> compute_dem_weights(ImageView<DoubleGrayA> const& dem, double nodata_value,
+                                      int bias, Options const& opt){
+  
+  // Compute linear weights
+  ImageView<double> local_wts = grassfire(notnodata(select_channel(dem, 0), nodata_value));
+  if (opt.use_centerline_weights) {
+    // Erode based on grassfire weights.
+    ImageView<DoubleGrayA> dem2 = copy(dem);
+    for (int col = 0; col < dem2.cols(); col++) {
+      for (int row = 0; row < dem2.rows(); row++) {
+        if (local_wts(col, row) <= opt.erode_len) {
+          dem2(col, row) = DoubleGrayA(nodata_value);
+        }
+      }
+    }
+    centerline_weights
+      (create_mask_less_or_equal(select_channel(dem2, 0), nodata_value),
+       local_wts);
+  }
+
+  // If we don't limit the weights from above, we will have tiling artifacts,
+  // as in different tiles the weights grow to different heights since
+  // they are cropped to different regions. for priority blending length,
+  // we'll do this process later, as the bbox is obtained differently in that case.
+  if (opt.priority_blending_len <= 0) {
+    for (int col = 0; col < local_wts.cols(); col++) {
+      for (int row = 0; row < local_wts.rows(); row++) {
+        local_wts(col, row) = std::min(local_wts(col, row), double(bias));
+      }
+    }
+  }
+      
+  // Erode. We already did that if centerline weights are used.
+  if (!opt.use_centerline_weights){
+    int max_cutoff = max_pixel_value(local_wts);
+    int min_cutoff = opt.erode_len;
+    if (max_cutoff <= min_cutoff)
+      max_cutoff = min_cutoff + 1; // precaution
+    local_wts = clamp(local_wts - min_cutoff, 0.0, max_cutoff - min_cutoff);
+  }
+      
+  // Blur the weights. If priority blending length is on, we'll do the blur later,
+  // after weights from different DEMs are combined.
+  if (opt.weights_blur_sigma > 0 && opt.priority_blending_len <= 0)
+    blur_weights(local_wts, opt.weights_blur_sigma);
+
+  // Raise to the power. Note that when priority blending length is positive, we
+  // delay this process.
+  if (opt.weights_exp != 1 && opt.priority_blending_len <= 0) {
+    for (int col = 0; col < dem.cols(); col++){
+      for (int row = 0; row < dem.rows(); row++){
+        local_wts(col, row) = pow(local_wts(col, row), opt.weights_exp);
+      }
+    }
+  }
+
+  return local_wts;
+}
+
+/// The weights of each input DEM, computed once for the whole DEM
+/// before mosaicking, rather than for each tile, and saved to disk.
+struct WeightCache {
+  std::string dir;                // owned by this process only
+  std::vector<std::string> files; // one per loaded DEM, empty if not in use
+  double compute_time;            // seconds spent computing them, over all threads
+  double num_computed_pixels;     // how many weights were computed
+  double num_tile_pixels;         // how many weights the tiles would have computed
+  vw::Mutex mutex;
+  WeightCache(): compute_time(0), num_computed_pixels(0), num_tile_pixels(0){}
+  bool in_use() const { return !files.empty(); }
+};
+
+/// Compute the weights of one DEM and save them to the cache.
+class ComputeWeightsTask: public vw::Task, private boost::noncopyable {
+  Options      const& m_opt;
+  std::string         m_dem_file, m_weight_file;
+  GeoReference        m_georef;
+  double              m_nodata_value;
+  int                 m_bias;
+  WeightCache       & m_weight_cache;
+public:
+  ComputeWeightsTask(Options const& opt, std::string const& dem_file,
+                     std::string const& weight_file, GeoReference const& georef,
+                     double nodata_value, int bias, WeightCache & weight_cache):
+    m_opt(opt), m_dem_file(dem_file), m_weight_file(weight_file), m_georef(georef),
+    m_nodata_value(nodata_value), m_bias(bias), m_weight_cache(weight_cache){}
+
+  virtual void operator()(){
+    Stopwatch sw;
+    sw.start();
+    
+    ImageViewRef<double> disk_dem = pixel_cast<double>(DiskImageView<RealT>(m_dem_file));
+    ImageView<DoubleGrayA> dem = disk_dem;
+    double nodata_value = m_nodata_value;
+    apply_nodata_threshold(m_opt, dem, nodata_value);
+    ImageView<double> weights = compute_dem_weights(dem, nodata_value, m_bias, m_opt);
+
+    // Many of these run in parallel, so write each with one thread.
+    vw::cartography::write_gdal_image(m_weight_file, pixel_cast<RealT>(weights),
+                                      m_georef, m_opt, ProgressCallback::dummy_instance());
+    sw.stop();
+    
+    Mutex::Lock lock(m_weight_cache.mutex);
+    m_weight_cache.compute_time        += sw.elapsed_seconds();
+    m_weight_cache.num_computed_pixels += double(weights.cols())*weights.rows();
+    vw_out() << "Computed the weights of " << m_dem_file << " in "
+             << sw.elapsed_seconds() << " seconds.\n";
+  }
+};
+
+/// Compute the weights of all DEMs in parallel and save them to disk.
+void populate_weight_cache(Options const& opt, std::vector<std::string> const& dem_files,
+                           std::vector<GeoReference> const& georefs,
+                           std::vector<double> const& nodata_values,
+                           int bias, WeightCache & weight_cache){
+
+  // Several processes may mosaic different tiles with the same
+  // output prefix, so each gets its own directory, which it removes
+  // when done.
+  weight_cache.dir = fs::unique_path(opt.out_prefix + "-weights-cache"
+                                     + tile_suffix(opt) + "-%%%%%%%%").string();
+  fs::create_directories(weight_cache.dir);
+  
+  vw_out() << "Computing the weights of each DEM in: " << weight_cache.dir << "\n";
+  weight_cache.files.resize(dem_files.size());
+  std::map<std::string, int> name_count;
+  vw::FifoWorkQueue queue(opt.num_threads);
+  for (size_t dem_iter = 0; dem_iter < dem_files.size(); dem_iter++) {
+    // Name the weights after the DEM, telling apart DEMs with the same
+    // name in different directories.
+    std::string name = fs::path(dem_files[dem_iter]).stem().string();
+    int count = name_count[name]++;
+    if (count > 0)
+      name += "-" + stringify(count);
+    weight_cache.files[dem_iter] = weight_cache.dir + "/" + name + "-weights.tif";
+    boost::shared_ptr<ComputeWeightsTask>
+      task(new ComputeWeightsTask(opt, dem_files[dem_iter], weight_cache.files[dem_iter],
+                                  georefs[dem_iter], nodata_values[dem_iter], bias,
+                                  weight_cache));
+    queue.add_task(task);
+  }
+  queue.join_all();
+}
+
 /// Class that does the actual image processing work
 class DemMosaicView: public ImageViewBase<DemMosaicView>{
   int m_cols, m_rows, m_bias;
@@ -282,6 +476,7 @@ class DemMosaicView: public ImageViewBase<DemMosaicView>{
   vector<BBox2i>          const& m_dem_pixel_bboxes; // alias
   long long int                & m_num_valid_pixels; // alias, to populate on output
   vw::Mutex                    & m_count_mutex;      // alias, a lock for m_num_valid_pixels
+  WeightCache                  & m_weight_cache;     // alias
 
 public:
   DemMosaicView(int cols, int rows, int bias,
@@ -292,19 +487,21 @@ public:
 		vector<double>         const& nodata_values,
                 vector<BBox2i>         const& dem_pixel_bboxes,
                 long long int               & num_valid_pixels,
-                vw::Mutex                   & count_mutex):
+                vw::Mutex                   & count_mutex,
+                WeightCache                 & weight_cache):
     m_cols(cols), m_rows(rows), m_bias(bias), m_opt(opt),
     m_imgMgr(imgMgr), m_georefs(georefs),
     m_out_georef(out_georef), m_nodata_values(nodata_values),
     m_dem_pixel_bboxes(dem_pixel_bboxes), m_num_valid_pixels(num_valid_pixels),
-    m_count_mutex(count_mutex) {
+    m_count_mutex(count_mutex), m_weight_cache(weight_cache) {
 
     // How many valid pixels we will have
     m_num_valid_pixels = 0;
     
     if (imgMgr.size() != georefs.size()       ||
         imgMgr.size() != nodata_values.size() ||
-        imgMgr.size() != dem_pixel_bboxes.size())
+        imgMgr.size() != dem_pixel_bboxes.size() ||
+        (weight_cache.in_use() && imgMgr.size() != weight_cache.files.size()))
       vw_throw(ArgumentErr() << "Inputs expected to have the same size do not.\n");
 
     // Sanity check, see if datums differ, then the tool won't work
@@ -358,7 +555,6 @@ public:
     // We will do all computations in double precision, regardless
     // of the precision of the inputs, for increased accuracy.
     // - The image data buffers are initialized here
-    typedef PixelGrayA<double> DoubleGrayA;
     ImageView<double> tile   (bbox.width(), bbox.height());
     ImageView<double> weights(bbox.width(), bbox.height());
     fill( tile, m_opt.out_nodata_value );
@@ -368,11 +564,18 @@ public:
     bool noblend = (no_blend(m_opt) > 0);
 
     // A vector of images the size of the output tile.
-    // - Used for median and stddev calculation.
+    // - Used for stddev calculation.
     std::vector< ImageView<double> > tile_vec, weight_vec;
     std::vector< std::string > dem_vec;
-    if (m_opt.median) // Store each input separately
-      tile_vec.reserve(m_imgMgr.size());
+
+    // For the median, percentile, and NMAD, accumulate the values at
+    // each pixel as the DEMs are visited. Store them exactly, unless
+    // there are too many, then switch to estimates, to bound the memory.
+    boost::shared_ptr<asp::PixelQuantiles> quantiles;
+    if (order_statistic(m_opt))
+      quantiles = boost::shared_ptr<asp::PixelQuantiles>
+        (new asp::PixelQuantiles(bbox.width()*bbox.height(), tracked_quantiles(m_opt),
+                                 std::min(m_opt.exact_quantile_count, int(m_imgMgr.size()))));
     if (m_opt.stddev) { // Need one working image
       tile_vec.push_back(ImageView<double>(bbox.width(), bbox.height()));
       // Each pixel starts at zero, nodata is handled later
@@ -437,7 +640,7 @@ public:
       if (in_box.width() <= 1 || in_box.height() <= 1)
         continue; // No overlap with this tile, skip to the next DEM.
 
-      if (m_opt.median || m_opt.priority_blending_len > 0 || m_opt.block_max){
+      if (order_statistic(m_opt) || m_opt.priority_blending_len > 0 || m_opt.block_max){
         // Must use a blank tile each time
         fill( tile, m_opt.out_nodata_value );
         fill( weights, 0.0 );
@@ -452,73 +655,23 @@ public:
       // If the nodata_threshold is specified, all values no more than this
       // will be invalidated.
       double nodata_value = m_nodata_values[dem_iter];
-      if (!boost::math::isnan(m_opt.nodata_threshold)) {
-	nodata_value = m_opt.nodata_threshold;
-	for (int col = 0; col < dem.cols(); col++) {
-	  for (int row = 0; row < dem.rows(); row++) {
-	    if (dem(col, row)[0] <= nodata_value) {
-	      dem(col, row)[0] = nodata_value;
-	    }
-	  }
-	}
-      }
+      apply_nodata_threshold(m_opt, dem, nodata_value);
 
       // Mark the handle to the image as not in use, though we still
       // keep that image file open, for increased performance, unless
       // their number becomes too large.
       m_imgMgr.release(dem_iter);
       
-      // Compute linear weights
-      ImageView<double> local_wts = grassfire(notnodata(select_channel(dem, 0), nodata_value));
-      if (m_opt.use_centerline_weights) {
-        // Erode based on grassfire weights.
-        ImageView<DoubleGrayA> dem2 = copy(dem);
-        for (int col = 0; col < dem2.cols(); col++) {
-          for (int row = 0; row < dem2.rows(); row++) {
-            if (local_wts(col, row) <= m_opt.erode_len) {
-              dem2(col, row) = DoubleGrayA(nodata_value);
-            }
-          }
-        }
-        centerline_weights
-                (create_mask_less_or_equal(select_channel(dem2, 0), nodata_value),
-                 local_wts);
-      }
-
-      // If we don't limit the weights from above, we will have tiling artifacts,
-      // as in different tiles the weights grow to different heights since
-      // they are cropped to different regions. for priority blending length,
-      // we'll do this process later, as the bbox is obtained differently in that case.
-      if (m_opt.priority_blending_len <= 0) {
-        for (int col = 0; col < local_wts.cols(); col++) {
-          for (int row = 0; row < local_wts.rows(); row++) {
-            local_wts(col, row) = std::min(local_wts(col, row), double(m_bias));
-          }
-        }
-      }
-      
-      // Erode. We already did that if centerline weights are used.
-      if (!m_opt.use_centerline_weights){
-	int max_cutoff = max_pixel_value(local_wts);
-	int min_cutoff = m_opt.erode_len;
-	if (max_cutoff <= min_cutoff)
-	  max_cutoff = min_cutoff + 1; // precaution
-	local_wts = clamp(local_wts - min_cutoff, 0.0, max_cutoff - min_cutoff);
-      }
-      
-      // Blur the weights. If priority blending length is on, we'll do the blur later,
-      // after weights from different DEMs are combined.
-      if (m_opt.weights_blur_sigma > 0 && m_opt.priority_blending_len <= 0)
-        blur_weights(local_wts, m_opt.weights_blur_sigma);
-
-      // Raise to the power. Note that when priority blending length is positive, we
-      // delay this process.
-      if (m_opt.weights_exp != 1 && m_opt.priority_blending_len <= 0) {
-        for (int col = 0; col < dem.cols(); col++){
-          for (int row = 0; row < dem.rows(); row++){
-            local_wts(col, row) = pow(local_wts(col, row), m_opt.weights_exp);
-          }
-        }
+      // Find the weights, or read them if they were computed before
+      // for the whole DEM.
+      ImageView<double> local_wts;
+      if (m_weight_cache.in_use()) {
+        local_wts = crop(pixel_cast<double>(DiskImageView<RealT>(m_weight_cache.files[dem_iter])),
+                         in_box);
+        Mutex::Lock lock(m_weight_cache.mutex);
+        m_weight_cache.num_tile_pixels += double(in_box.width())*in_box.height();
+      }else{
+        local_wts = compute_dem_weights(dem, nodata_value, m_bias, m_opt);
       }
 
 #if 0
@@ -617,7 +770,7 @@ public:
 
 	  // Initialize the tile if not done already.
 	  // Init to zero not needed with some types.
-	  if (!m_opt.stddev && !m_opt.median && !m_opt.min && !m_opt.max &&
+	  if (!m_opt.stddev && !order_statistic(m_opt) && !m_opt.min && !m_opt.max &&
 	      m_opt.priority_blending_len <= 0){
 	    if ( is_nodata ){
 	      tile   (c, r) = 0;
@@ -630,7 +783,7 @@ public:
 	       m_opt.last                                         ||
 	       ( m_opt.min && ( val < tile(c, r) || is_nodata ) ) ||
 	       ( m_opt.max && ( val > tile(c, r) || is_nodata ) ) ||
-	       m_opt.median || m_opt.priority_blending_len > 0    ||
+	       order_statistic(m_opt) || m_opt.priority_blending_len > 0 ||
                m_opt.block_max){
 	    // --> Conditions where we replace the current value
 	    tile   (c, r) = val;
@@ -676,10 +829,19 @@ public:
 	} // End col loop
       } // End row loop
 
-      // For the median option, keep a copy of the output tile for each input DEM!
-      // Also do it for max per block.
+      // Add the values from this DEM to the order statistics
+      if (order_statistic(m_opt)) {
+        for (int c = 0; c < bbox.width(); c++){
+          for (int r = 0; r < bbox.height(); r++){
+            if (tile(c, r) != m_opt.out_nodata_value)
+              quantiles->add(r*bbox.width() + c, tile(c, r));
+          }
+        }
+      }
+      
+      // For max per block, keep a copy of the output tile for each input DEM!
       // - This will be memory intensive. 
-      if (m_opt.median || m_opt.block_max) {
+      if (m_opt.block_max) {
 	tile_vec.push_back(copy(tile));
         dem_vec.push_back(dem_name);
       }
@@ -722,28 +884,22 @@ public:
       } // End col loop
     } // End stddev case
 
-    // For the median operation
-    if (m_opt.median){
+    // For the median, percentile, and NMAD
+    if (order_statistic(m_opt)){
       // Init output pixels to nodata
       fill( tile, m_opt.out_nodata_value );
-      vector<double> vals(tile_vec.size());
-      // Iterate through all pixels
       for (int c = 0; c < bbox.width(); c++){
 	for (int r = 0; r < bbox.height(); r++){
-	  // Compute the median for this pixel
-	  vals.clear();
-	  for (int i = 0; i < (int)tile_vec.size(); i++){
-	    ImageView<double> & tile_ref = tile_vec[i];
-	    if ( tile_ref(c, r) == m_opt.out_nodata_value )
-	      continue;
-	    vals.push_back(tile_ref(c, r));
-	  }
-	  if (!vals.empty()){
-	    tile(c, r) = math::destructive_median(vals);
-	  }
+          int pixel = r*bbox.width() + c;
+          if (quantiles->count(pixel) == 0)
+            continue;
+          if (m_opt.nmad)
+            tile(c, r) = quantiles->nmad(pixel);
+          else
+            tile(c, r) = quantiles->quantile(pixel, 0);
 	}// End row loop
       } // End col loop
-    } // End median case
+    } // End order statistic case
 
     // For max per block, find the sum of values in each DEM
     if (m_opt.block_max) {
@@ -1057,7 +1213,15 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("stddev",    po::bool_switch(&opt.stddev)->default_value(false),
 	   "Find the standard deviation of the DEM values.")
     ("median",  po::bool_switch(&opt.median)->default_value(false),
-	   "Find the median DEM value (this can be memory-intensive, fewer threads are suggested).")
+	   "Find the median DEM value. See also --exact-quantile-count.")
+    ("percentile", po::value(&opt.percentile)->default_value(-1.0),
+     "Find this percentile (between 0 and 100) of the DEM values. See also --exact-quantile-count.")
+    ("nmad",    po::bool_switch(&opt.nmad)->default_value(false),
+     "Find the normalized median absolute deviation of the DEM values. See also --exact-quantile-count.")
+    ("exact-quantile-count", po::value(&opt.exact_quantile_count)->default_value(50),
+     "With --median, --percentile, or --nmad, keep up to this many DEM values at each pixel and find the result exactly. Beyond that, estimate it in constant memory per pixel (the NMAD is then estimated from the interquartile range).")
+    ("memory-budget", po::value(&opt.memory_budget)->default_value(0.0),
+     "If positive, shrink the blocks processed in parallel so that the estimated memory usage stays within this many megabytes.")
     ("count",   po::bool_switch(&opt.count)->default_value(false),
      "Each pixel is set to the number of valid DEM heights at that pixel.")
     ("block-max", po::bool_switch(&opt.block_max)->default_value(false),
@@ -1076,6 +1240,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "Blur the final DEM using a Gaussian with this value of sigma. Default: No blur.")
     ("nodata-threshold", po::value(&opt.nodata_threshold)->default_value(std::numeric_limits<double>::quiet_NaN()),
      "Values no larger than this number will be interpreted as no-data.")
+    ("cache-weights",   po::bool_switch(&opt.cache_weights)->default_value(false),
+     "Compute the blending weights of each input DEM only once, for the whole DEM, and keep them on disk while mosaicking, rather than recomputing them for each output tile the DEM overlaps. Faster with many tiles, but each DEM is loaded fully in memory. Not used with --priority-blending-length.")
     ("extra-crop-length", po::value<int>(&opt.extra_crop_len)->default_value(200),
      "Crop the DEMs this far from the current tile (measured in pixels) before blending them (a small value may result in artifacts).")
     ("block-size",      po::value<int>(&opt.block_size)->default_value(0),
@@ -1130,9 +1296,24 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   int noblend = no_blend(opt);
   if (noblend > 1)
     vw_throw(ArgumentErr() << "At most one of the options --first, --last, "
-	     << "--min, --max, -mean, --stddev, --median, --count can be specified.\n"
+	     << "--min, --max, -mean, --stddev, --median, --percentile, --nmad, --count "
+	     << "can be specified.\n"
 	     << usage << general_options );
 
+  // A negative percentile other than the default of -1 is a mistake,
+  // rather than a request to not compute it
+  if (opt.percentile > 100 || (opt.percentile < 0 && opt.percentile != -1.0))
+    vw_throw(ArgumentErr() << "The percentile must be between 0 and 100.\n"
+			   << usage << general_options );
+
+  if (opt.exact_quantile_count < 0)
+    vw_throw(ArgumentErr() << "The exact quantile count must not be negative.\n"
+			   << usage << general_options );
+
+  if (opt.memory_budget < 0)
+    vw_throw(ArgumentErr() << "The memory budget must not be negative.\n"
+			   << usage << general_options );
+
   if (opt.geo_tile_size < 0)
     vw_throw(ArgumentErr() << "The size of a tile in georeferenced units must not be negative.\n"
 			   << usage << general_options );
@@ -1143,6 +1324,12 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 	     << usage << general_options );
   }
 
+  if (opt.priority_blending_len > 0 && opt.cache_weights) {
+    vw_out(WarningMessage) << "Cannot use --cache-weights with --priority-blending-length. "
+                           << "Ignoring it.\n";
+    opt.cache_weights = false;
+  }
+
   if (opt.priority_blending_len > 0 && opt.weights_exp == 2) {
     vw_out() << "Increasing --weights-exponent to 3 for smoother blending.\n";
     opt.weights_exp = 3;
@@ -1239,6 +1426,48 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   
 } // End function handle_arguments
 
+/// Shrink the block size until the estimated memory used by the
+/// blocks processed in parallel fits in the memory budget.
+int memory_bounded_block_size(Options const& opt, int bias, int num_dems, int block_size){
+
+  // Bytes per pixel of the output block
+  double block_bytes = 2*sizeof(double); // the tile and the weights
+  if (opt.save_dem_weight >= 0 || opt.save_index_map)
+    block_bytes += sizeof(double);
+  if (order_statistic(opt))
+    block_bytes += asp::PixelQuantiles::bytes_per_pixel(tracked_quantiles(opt).size(),
+                                                        std::min(opt.exact_quantile_count,
+                                                                 num_dems));
+  if (opt.block_max)
+    block_bytes += num_dems*sizeof(double);
+  if (opt.priority_blending_len > 0)
+    block_bytes += (2*num_dems + 1)*sizeof(double);
+
+  // Bytes per pixel of the expanded crop of each input DEM, with its
+  // weights, in double precision.
+  double dem_bytes = 4*sizeof(double);
+
+  double budget = opt.memory_budget*1024.0*1024.0;
+  int granularity = 16; // tiles of GeoTiff files are multiples of this
+  int size = block_size;
+  while (size > granularity) {
+    double crop = size + 2.0*(bias + BilinearInterpolation::pixel_buffer + 1);
+    double usage = opt.num_threads*(block_bytes*size*size + dem_bytes*crop*crop);
+    if (usage <= budget)
+      break;
+    size = granularity*((size - 1)/granularity);
+  }
+
+  if (size < block_size)
+    vw_out() << "Reducing the block size from " << block_size << " to " << size
+             << " to fit in the memory budget.\n";
+  if (size < 2*bias)
+    vw_out(WarningMessage) << "The block size is small compared to the distance "
+                           << "the DEMs are read beyond each block, which is slow. "
+                           << "Consider a larger memory budget or fewer threads.\n";
+  return size;
+}
+
 int main( int argc, char *argv[] ) {
 
   Options opt;
@@ -1497,6 +1726,15 @@ int main( int argc, char *argv[] ) {
       loaded_dem_pixel_bboxes.push_back(dem_pixel_box);
     } // End loop through DEM files
 
+    if (opt.memory_budget > 0)
+      block_size = memory_bounded_block_size(opt, bias, loaded_dems.size(), block_size);
+    
+    // Compute the weights of each DEM only once, rather than for each tile
+    // it overlaps with.
+    WeightCache weight_cache;
+    if (opt.cache_weights)
+      populate_weight_cache(opt, loaded_dems, georefs, nodata_values, bias, weight_cache);
+    
     // If there are 17 tiles, let them be tile-00, ..., tile-16.
     int num_digits = 1;
     int tens = 10;
@@ -1529,7 +1767,7 @@ int main( int argc, char *argv[] ) {
                              imgMgr, georefs,
                              mosaic_georef, nodata_values,
                              loaded_dem_pixel_bboxes,
-                             num_valid_pixels, count_mutex),
+                             num_valid_pixels, count_mutex, weight_cache),
                tile_box);
       GeoReference crop_georef = crop(mosaic_georef, tile_box.min().x(),
 				      tile_box.min().y());
@@ -1549,6 +1787,22 @@ int main( int argc, char *argv[] ) {
       
     } // End loop through tiles
 
+    if (weight_cache.in_use()) {
+      // Estimate how long the tiles would have taken to compute the
+      // weights, assuming the time is proportional to the number of pixels.
+      double tile_time = 0;
+      if (weight_cache.num_computed_pixels > 0)
+        tile_time = weight_cache.compute_time * weight_cache.num_tile_pixels
+          / weight_cache.num_computed_pixels;
+      vw_out() << "Computing the weights of the DEMs took " << weight_cache.compute_time
+               << " seconds (summed over threads). Computing them per tile would have "
+               << "taken an estimated " << tile_time << " seconds, so the estimated "
+               << "time saved by the cache is " << tile_time - weight_cache.compute_time
+               << " seconds.\n";
+
+      fs::remove_all(weight_cache.dir);
+    }
+
     // Write the name of each DEM file that was used together with its index
     if (opt.save_index_map) {
       std::string index_map = opt.out_prefix + "-index-map.txt";
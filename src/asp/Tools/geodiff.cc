@@ -17,6 +17,7 @@
 
 
 #include <asp/Core/PointUtils.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/FileIO.h>
 #include <vw/Image.h>
 #include <vw/Cartography.h>
@@ -47,6 +48,7 @@ public:
 struct Options : vw::cartography::GdalWriteOptions {
   string dem1_file, dem2_file, output_prefix, csv_format_str, csv_proj4_str;
   double nodata_value;
+  int    csv_chunk_size;
 
   bool use_float, use_absolute;
 };
@@ -64,7 +66,9 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Output the absolute difference as opposed to just the difference.")
     ("csv-format",     po::value(&opt.csv_format_str)->default_value(""),
      asp::csv_opt_caption().c_str())
-    ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV file. If not specified, it will be borrowed from the DEM.");
+    ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV file. If not specified, it will be borrowed from the DEM.")
+    ("csv-chunk-size", po::value(&opt.csv_chunk_size)->default_value(1000000),
+     "Difference the CSV file this many points at a time, to limit the memory usage.");
   general_options.add(vw::cartography::GdalWriteOptionsDescription(opt));
 
   po::options_description positional("");
@@ -92,6 +96,9 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     opt.output_prefix = fs::basename(opt.dem1_file) + "__" + fs::basename(opt.dem2_file);
   }
 
+  if (opt.csv_chunk_size <= 0)
+    vw_throw(ArgumentErr() << "The CSV chunk size must be positive.\n");
+
   vw::create_out_dir(opt.output_prefix);
 }
 
@@ -198,6 +205,64 @@ void dem2dem_diff(Options& opt){
   }
 }
 
+/// Remove a file when going out of scope.
+struct ScopedFileRemover {
+  std::string m_file;
+  ScopedFileRemover(std::string const& file): m_file(file){}
+  ~ScopedFileRemover(){
+    boost::system::error_code ec;
+    fs::remove(m_file, ec);
+  }
+};
+
+/// A CSV point which falls in the DEM, and its difference to it.
+struct CsvDiffPoint {
+  Vector3 llh;
+  Vector2 pix;   // in the DEM
+  double  diff;
+  bool    valid; // if the DEM height was valid
+};
+
+/// Find the differences for the points of a chunk which fall in one
+/// tile of the DEM. The tile is read once, grown by a pixel so that
+/// bilinear interpolation does not go out of it.
+class TileDiffTask: public Task, private boost::noncopyable {
+  ImageViewRef< PixelMask<double> > m_dem;
+  BBox2i                     m_tile;
+  std::vector<size_t>        m_indices;
+  std::vector<CsvDiffPoint> & m_points;
+  bool m_reverse, m_absolute;
+public:
+  TileDiffTask(ImageViewRef< PixelMask<double> > dem, BBox2i const& tile,
+               std::vector<size_t> const& indices, std::vector<CsvDiffPoint> & points,
+               bool reverse, bool absolute):
+    m_dem(dem), m_tile(tile), m_indices(indices), m_points(points),
+    m_reverse(reverse), m_absolute(absolute){}
+
+  virtual void operator()(){
+    BBox2i box = m_tile;
+    box.expand(1);
+    box.crop(bounding_box(m_dem));
+    ImageView< PixelMask<double> > dem_tile = crop(m_dem, box);
+    ImageViewRef< PixelMask<double> > interp_dem
+      = interpolate(dem_tile, BilinearInterpolation(), ConstantEdgeExtension());
+
+    for (size_t it = 0; it < m_indices.size(); it++) {
+      CsvDiffPoint & point = m_points[m_indices[it]];
+      Vector2 pix = point.pix - box.min();
+      PixelMask<double> dem_ht = interp_dem(pix[0], pix[1]);
+      point.valid = is_valid(dem_ht);
+      if (!point.valid)
+        continue;
+      point.diff = dem_ht.child() - point.llh[2];
+      if (m_reverse)
+        point.diff *= -1;
+      if (m_absolute)
+        point.diff = std::abs(point.diff);
+    }
+  }
+};
+
 // From a DEM, subtract a csv file. Reverse the sign is 'reverse' is true.
 void dem2csv_diff(Options & opt, std::string const& dem_file,
                   std::string const & csv_file, bool reverse){
@@ -242,60 +307,104 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
   GeoReference csv_georef = dem_georef;
   csv_conv.parse_georef(csv_georef);
 
-  std::list<asp::CsvConv::CsvRecord> csv_records;
-  typedef std::list<asp::CsvConv::CsvRecord>::const_iterator RecordIter;
-  csv_conv.read_csv_file(csv_file, csv_records);
-  
-  std::vector<Vector3> csv_llh;
-  for (RecordIter iter = csv_records.begin(); iter != csv_records.end(); iter++) {
-    Vector3 xyz = csv_conv.csv_to_cartesian(*iter, csv_georef);
-    if (xyz == Vector3() || xyz != xyz)
-      continue; // invalid point
-    Vector3 llh = dem_georef.datum().cartesian_to_geodetic(xyz); // use the dem's datum
-    csv_llh.push_back(llh);
-  }
-
   // We will interpolate into the DEM to find the difference
-  ImageViewRef< PixelMask<double> > interp_dem
-    = interpolate(create_mask(dem, dem_nodata),
-		  BilinearInterpolation(), ConstantEdgeExtension());
-
+  ImageViewRef< PixelMask<double> > masked_dem = create_mask(dem, dem_nodata);
+
+  // Points are read in chunks. Those in a chunk are grouped by the DEM
+  // tile they fall in, and the tiles are done in parallel. Tiles are
+  // aligned to the blocks of the DEM on disk, so each block is read
+  // once. Thin blocks, such as the rows of a striped DEM, are grouped.
+  const int min_tile_size = 256;
+  Vector2i tile_size = dem.resource()->block_read_size();
+  for (int i = 0; i < 2; i++)
+    tile_size[i] *= (min_tile_size + tile_size[i] - 1)/tile_size[i];
+  int num_tile_cols = (dem.cols() + tile_size[0] - 1)/tile_size[0];
+
+  std::ifstream infile(csv_file.c_str());
+  if (!infile)
+    vw_throw(IOErr() << "Unable to open file: " << csv_file << "\n");
+
+  // The statistics go at the top of the output, so the differences
+  // are streamed to a temporary file first.
+  std::string output_file = opt.output_prefix + "-diff.csv";
+  std::string tmp_file    = output_file + ".tmp";
+  ScopedFileRemover tmp_remover(tmp_file); // also on failure
+  std::ofstream tmpfile(tmp_file.c_str());
+  if (!tmpfile)
+    vw_throw(IOErr() << "Unable to open file: " << tmp_file << "\n");
+  tmpfile.precision(16);
 
   // Save the diffs
-  int    count     = 0;
+  size_t count     = 0;
   double diff_min  = std::numeric_limits<double>::max();
   double diff_max  = -diff_min;
   double diff_mean = 0.0;
   double diff_std  = 0.0;
-  
-  std::vector<Vector3> csv_diff;
-  for (size_t it = 0; it < csv_llh.size(); it++) {
 
-    Vector3 llh = csv_llh[it];
-    Vector2 ll  = subvector(llh, 0, 2);
-    Vector2 pix = dem_georef.lonlat_to_pixel(ll);
-    
-    // Check for out of range
-    if (pix[0] < 0 || pix[0] > dem.cols() - 1) continue;
-    if (pix[1] < 0 || pix[1] > dem.rows() - 1) continue;
-    PixelMask<double> dem_ht = interp_dem(pix[0], pix[1]);
-    if (!is_valid(dem_ht))
-      continue;
-
-    double diff = dem_ht.child() - llh[2];
-    if (reverse) 
-      diff *= -1;
-    if (opt.use_absolute)
-      diff = std::abs(diff);
-
-    if (diff > diff_max) diff_max = diff;
-    if (diff < diff_min) diff_min = diff;
-
-    diff_mean += diff;
-    diff_std  += diff*diff;
-    count     += 1;
-    csv_diff.push_back(Vector3(ll[0], ll[1], diff));
+  bool first_line = true;
+  std::string line;
+  std::vector<CsvDiffPoint> points;
+  while (infile) {
+
+    // Read a chunk, keeping the points which fall in the DEM
+    points.clear();
+    while (int(points.size()) < opt.csv_chunk_size && std::getline(infile, line, '\n')) {
+      bool success;
+      asp::CsvConv::CsvRecord record = csv_conv.parse_csv_line(first_line, success, line);
+      first_line = false;
+      if (!success)
+        continue;
+      Vector3 xyz = csv_conv.csv_to_cartesian(record, csv_georef);
+      if (xyz == Vector3() || xyz != xyz)
+        continue; // invalid point
+
+      CsvDiffPoint point;
+      point.llh   = dem_georef.datum().cartesian_to_geodetic(xyz); // use the dem's datum
+      point.pix   = dem_georef.lonlat_to_pixel(subvector(point.llh, 0, 2));
+      point.diff  = 0;
+      point.valid = false;
+
+      // Check for out of range
+      if (point.pix[0] < 0 || point.pix[0] > dem.cols() - 1) continue;
+      if (point.pix[1] < 0 || point.pix[1] > dem.rows() - 1) continue;
+      points.push_back(point);
+    }
+
+    std::map< int, std::vector<size_t> > tiles;
+    for (size_t it = 0; it < points.size(); it++) {
+      int tile_col = int(points[it].pix[0])/tile_size[0];
+      int tile_row = int(points[it].pix[1])/tile_size[1];
+      tiles[tile_row*num_tile_cols + tile_col].push_back(it);
+    }
+
+    FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (std::map< int, std::vector<size_t> >::const_iterator it = tiles.begin();
+         it != tiles.end(); it++) {
+      BBox2i tile((it->first % num_tile_cols)*tile_size[0],
+                  (it->first / num_tile_cols)*tile_size[1],
+                  tile_size[0], tile_size[1]);
+      boost::shared_ptr<TileDiffTask>
+        task(new TileDiffTask(masked_dem, tile, it->second, points,
+                              reverse, opt.use_absolute));
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    // Write the chunk in the order of the input file
+    for (size_t it = 0; it < points.size(); it++) {
+      if (!points[it].valid)
+        continue;
+      double diff = points[it].diff;
+      if (diff > diff_max) diff_max = diff;
+      if (diff < diff_min) diff_min = diff;
+
+      diff_mean += diff;
+      diff_std  += diff*diff;
+      count     += 1;
+      tmpfile << points[it].llh[0] << "," << points[it].llh[1] << "," << diff << "\n";
+    }
   }
+  tmpfile.close();
 
   if (count > 0) {
     diff_mean /= count;
@@ -310,7 +419,6 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
   vw_out() << "Mean difference:      " << diff_mean << std::endl;
   vw_out() << "StdDev of difference: " << diff_std  << std::endl;
 
-  std::string output_file = opt.output_prefix + "-diff.csv";
   vw_out() << "Writing difference file: " << output_file << "\n";
   std::ofstream outfile( output_file.c_str() );
   outfile.precision(16);
@@ -320,10 +428,12 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
   outfile << "# Min difference:       " << diff_min  << std::endl;
   outfile << "# Mean difference:      " << diff_mean << std::endl;
   outfile << "# StdDev of difference: " << diff_std  << std::endl;
-  for (size_t it = 0; it < csv_diff.size(); it++) {
-    Vector3 diff = csv_diff[it];
-    outfile << diff[0] << "," << diff[1] << "," << diff[2] << std::endl;
+  {
+    std::ifstream diffs(tmp_file.c_str());
+    if (count > 0)
+      outfile << diffs.rdbuf();
   }
+  outfile.close();
 }
 
 // Subtract from the first dem the second. One of them can be a CSV file.
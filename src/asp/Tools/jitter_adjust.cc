@@ -194,11 +194,16 @@ struct PiecewiseReprojectionError {
 
     try{
 
-      int num_cameras = m_cameras_vec.size();
-      std::vector<double> local_cameras_vec = m_cameras_vec;
+      int num_cameras = m_cameras_vec.size()/NUM_CAMERA_PARAMS;
 
-	// Copy the camera adjustments to local storage.  Update them
-	// with the latest value for the current camera being floated.
+      // Copy to local storage only the adjustments of the current
+      // camera, as there can be very many adjustments for all cameras
+      // combined. Update them with the latest value for the
+      // adjustments being floated.
+      VW_ASSERT(0 <= m_start_index && m_start_index < m_end_index && m_end_index <= num_cameras,
+                ArgumentErr() << "Book-keeping failure in camera indicies");
+      std::vector<double> local_cameras_vec(m_cameras_vec.begin() + NUM_CAMERA_PARAMS*m_start_index,
+                                            m_cameras_vec.begin() + NUM_CAMERA_PARAMS*m_end_index);
 
       for (int i = 1; i <= 4; i++) {
 
@@ -220,15 +225,11 @@ struct PiecewiseReprojectionError {
 
 	if (camera == NULL) continue;
 
-	VW_ASSERT(0 <= camera_index && camera_index < num_cameras,
-		  ArgumentErr() << "Out of bounds in the number of cameras");
-
-	VW_ASSERT(0 <= m_start_index && m_start_index <= camera_index
-		  && camera_index < m_end_index && m_end_index <= num_cameras,
+	VW_ASSERT(m_start_index <= camera_index && camera_index < m_end_index,
 		  ArgumentErr() << "Book-keeping failure in camera indicies");
 
 	for (int p = 0; p < NUM_CAMERA_PARAMS; p++) {
-	  local_cameras_vec[NUM_CAMERA_PARAMS*camera_index + p] = camera[p];
+	  local_cameras_vec[NUM_CAMERA_PARAMS*(camera_index - m_start_index) + p] = camera[p];
 	}
       }
 
@@ -236,7 +237,7 @@ struct PiecewiseReprojectionError {
       std::vector<vw::Vector3> position_adjustments;
       std::vector<vw::Quat>   pose_adjustments;
       populate_adjustements(local_cameras_vec,
-			    m_start_index, m_end_index,
+			    0, m_end_index - m_start_index,
 			    position_adjustments, pose_adjustments);
 
       // The adjusted camera has just the adjustments, it does not create a full
@@ -452,22 +453,20 @@ public:
   }
 };
 
-// Given a set of interest points, find their y values, and return the bounds
+// Given the y values of a set of interest points, return the bounds
 // corresponding to the given percentiles.
-vw::Vector2 find_bounds_from_percentiles(std::vector<ip::InterestPoint> const& ip,
+vw::Vector2 find_bounds_from_percentiles(std::vector<double> Y,
                                          vw::Vector2 const& percentiles){
 
   if (percentiles[0] < 0 || percentiles[0] >= percentiles[1] || percentiles[1] > 100)
     vw_throw( ArgumentErr() << "Percentiles must be between 0 and 100, "
               << "with the second larger than the first.\n" );
 
-  int len = ip.size();
+  int len = Y.size();
   if (len <= 0)
     vw_throw( ArgumentErr() << "No interest points found. Cannot compute "
               << "piecewise adjustments for jitter correction.\n" );
 
-  std::vector<double> Y(len);
-  for (int ip_iter = 0; ip_iter < len; ip_iter++) Y[ip_iter] = ip[ip_iter].y;
   std::sort(Y.begin(), Y.end());
 
   int beg = round(percentiles[0]*len/100.0); beg = std::min(beg, len - 1);
@@ -484,7 +483,7 @@ void jitter_adjust(std::vector<std::string> const& image_files,
                    const& input_camera_models,
                    std::string const& out_prefix,
                    std::string const& session,
-                   std::string const& match_file,
+                   std::map< std::pair<int, int>, std::string> const& match_files,
                    int num_threads){
 
   vw_out() << "Performing piecewise adjustments to correct for jitter.\n";
@@ -493,11 +492,10 @@ void jitter_adjust(std::vector<std::string> const& image_files,
     vw_throw( ArgumentErr() << "Expecting as many images as cameras.\n" );
 
   int num_cameras = input_camera_models.size();
-  if (num_cameras != 2)
-    vw_throw( ArgumentErr() << "Can solve for jitter only for two cameras.\n" );
-
-  std::map< std::pair<int, int>, std::string> match_files;
-  match_files[std::pair<int, int>(0, 1)] = match_file;
+  if (num_cameras < 2)
+    vw_throw( ArgumentErr() << "Can solve for jitter only for at least two cameras.\n" );
+  if (match_files.empty())
+    vw_throw( ArgumentErr() << "No match files were provided to solve for jitter.\n" );
 
   int min_matches = 30;   // TODO: Think more here
   double min_angle = 0.1; // in degrees
@@ -514,15 +512,28 @@ void jitter_adjust(std::vector<std::string> const& image_files,
 
   int num_points = cnet.size();
 
-  // Create the adjustment bounds based on percentiles of interest points.
-  std::vector<Vector2> adjustment_bounds;
-  adjustment_bounds.resize(num_cameras);
-  std::vector<ip::InterestPoint> ip0, ip1;
-  ip::read_binary_match_file(match_file, ip0, ip1);
-  adjustment_bounds[0]
-    = find_bounds_from_percentiles(ip0, stereo_settings().piecewise_adjustment_percentiles);
-  adjustment_bounds[1]
-    = find_bounds_from_percentiles(ip1, stereo_settings().piecewise_adjustment_percentiles);
+  // Create the adjustment bounds based on percentiles of interest
+  // points. An image can be in several match files, so gather its
+  // interest points from all of them.
+  std::vector< std::vector<double> > ip_rows(num_cameras);
+  typedef std::map< std::pair<int, int>, std::string>::const_iterator match_iter;
+  for (match_iter it = match_files.begin(); it != match_files.end(); it++) {
+    int left_index = it->first.first, right_index = it->first.second;
+    VW_ASSERT(0 <= left_index && left_index < num_cameras &&
+              0 <= right_index && right_index < num_cameras,
+              ArgumentErr() << "Out of bounds image index in match file: " << it->second);
+    std::vector<ip::InterestPoint> left_ip, right_ip;
+    ip::read_binary_match_file(it->second, left_ip, right_ip);
+    for (size_t ip_iter = 0; ip_iter < left_ip.size(); ip_iter++) {
+      ip_rows[left_index ].push_back(left_ip [ip_iter].y);
+      ip_rows[right_index].push_back(right_ip[ip_iter].y);
+    }
+  }
+  std::vector<Vector2> adjustment_bounds(num_cameras);
+  for (int icam = 0; icam < num_cameras; icam++)
+    adjustment_bounds[icam]
+      = find_bounds_from_percentiles(ip_rows[icam],
+                                     stereo_settings().piecewise_adjustment_percentiles);
 
   for (int icam = 0; icam < num_cameras; icam++)
     vw_out() << "Placing first and last adjustment for image "
@@ -742,6 +753,15 @@ void jitter_adjust(std::vector<std::string> const& image_files,
 
   }
 
+  // Let the Schur complement eliminate the points first. The
+  // remaining reduced system couples only the adjustments which
+  // observe common points, so it stays sparse even with many images.
+  ceres::ParameterBlockOrdering* ordering = new ceres::ParameterBlockOrdering;
+  for (int ipt = 0; ipt < num_points; ipt++)
+    ordering->AddElementToGroup(points + ipt * NUM_POINT_PARAMS, 0);
+  for (int cam_index = 0; cam_index < num_total_adj; cam_index++)
+    ordering->AddElementToGroup(cameras + cam_index * NUM_CAMERA_PARAMS, 1);
+
   // Add camera constraints
   double camera_weight = stereo_settings().piecewise_adjustment_camera_weight;
   for (int cam_index = 0; cam_index < num_total_adj; cam_index++){
@@ -758,7 +778,8 @@ void jitter_adjust(std::vector<std::string> const& image_files,
     problem.AddResidualBlock(cost_function, loss_function, camera);
   }
 
-  vw::vw_out() << "Solving for jitter" << std::endl;
+  vw::vw_out() << "Solving for jitter using " << num_cameras << " images, "
+               << num_total_adj << " adjustments, and " << num_points << " points.\n";
   Stopwatch sw;
   sw.start();
   // Solve the problem
@@ -770,8 +791,10 @@ void jitter_adjust(std::vector<std::string> const& image_files,
   options.minimizer_progress_to_stdout = true;
 
   options.num_threads = num_threads;
+  options.num_linear_solver_threads = num_threads;
 
   options.linear_solver_type = ceres::SPARSE_SCHUR;
+  options.linear_solver_ordering.reset(ordering);
   //options.ordering_type = ceres::SCHUR;
   //options.eta = 1e-3; // FLAGS_eta;
   //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
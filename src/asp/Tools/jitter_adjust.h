@@ -20,15 +20,19 @@
 #define __ASP_TOOLS_JITTERADJUST_H__
 
 #include <vw/Camera/CameraModel.h>
+#include <map>
 
 namespace asp{
 
+  /// Solve jointly for piecewise adjustments of all given cameras
+  /// using the matches among them. The key in match_files is the pair
+  /// of image indices the matches are for.
   void jitter_adjust(std::vector<std::string> const& image_files,
                      std::vector<std::string> const& camera_files,
                      std::vector< boost::shared_ptr<vw::camera::CameraModel> > const& camera_models,
                      std::string const& out_prefix,
 		     std::string const& session,
-                     std::string const& match_file,
+                     std::map< std::pair<int, int>, std::string> const& match_files,
                      int num_threads);
 }
 
@@ -30,6 +30,9 @@
 #include <asp/Sessions/ResourceLoader.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Camera/RPCModel.h>
+
+#include <boost/thread/tss.hpp>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -38,6 +41,9 @@ namespace fs = boost::filesystem;
 
 
 /// Variant of Map2CamTrans that accepts a constant elevation instead of a DEM.
+/// - For RPC cameras, the camera pixels of a whole tile are found
+///   with one batched call when the tile's bounding box is requested,
+///   and kept for the thread rasterizing the tile.
 /// - TODO: Move to vision workbench!
 class Datum2CamTrans : public vw::TransformBase<Map2CamTrans> {
   vw::camera::CameraModel const* m_cam;
@@ -47,6 +53,52 @@ class Datum2CamTrans : public vw::TransformBase<Map2CamTrans> {
   bool         m_call_from_mapproject;
   Vector2      m_invalid_pix;
 
+  // The camera pixels of the last tile each thread worked on
+  struct PixelGrid {
+    vw::BBox2i           box;
+    std::vector<Vector2> pixels;
+  };
+  asp::RPCModel const* m_rpc;
+  boost::shared_ptr< boost::thread_specific_ptr<PixelGrid> > m_grid;
+
+  /// Larger boxes are not tiles, and are done one pixel at a time
+  static const int MAX_GRID_PIXELS = 4096*4096;
+
+  /// Flag the pixels outside the image, as when calling reverse().
+  Vector2 check_pixel(Vector2 const& pt) const {
+    int b = BicubicInterpolation::pixel_buffer;  
+    if ( m_call_from_mapproject &&
+         (pt[0] < b - 1 || pt[0] >= m_image_size[0] - b ||
+          pt[1] < b - 1 || pt[1] >= m_image_size[1] - b)
+         ){
+      // Won't be able to interpolate into image in transform(...)
+      return m_invalid_pix;
+    }
+    return pt;
+  }
+
+  /// Project all pixels in the box with the batched RPC model, and
+  /// keep the result for this thread.
+  PixelGrid const& compute_grid(vw::BBox2i const& bbox) const {
+    if (m_grid->get() == NULL)
+      m_grid->reset(new PixelGrid);
+    PixelGrid & grid = *m_grid->get();
+    grid.box = bbox;
+    std::vector<Vector3> xyz;
+    xyz.reserve(bbox.width()*bbox.height());
+    for( int32 y=bbox.min().y(); y<bbox.max().y(); ++y ){
+      for( int32 x=bbox.min().x(); x<bbox.max().x(); ++x ){
+        Vector2 lonlat = m_image_georef.pixel_to_lonlat(Vector2(x, y));
+        Vector3 lonlatAlt(lonlat[0], lonlat[1], m_dem_height);
+        xyz.push_back(m_dem_georef.datum().geodetic_to_cartesian(lonlatAlt));
+      }
+    }
+    m_rpc->point_to_pixel(xyz, grid.pixels);
+    for (size_t i = 0; i < grid.pixels.size(); i++)
+      grid.pixels[i] = check_pixel(grid.pixels[i]);
+    return grid;
+  }
+
 public:
   Datum2CamTrans( vw::camera::CameraModel const* cam,
                 GeoReference const& image_georef,
@@ -57,7 +109,9 @@ public:
                 ):
     m_cam(cam), m_image_georef(image_georef), m_dem_georef(dem_georef),
     m_dem_height(dem_height), m_image_size(image_size),
-    m_call_from_mapproject(call_from_mapproject){
+    m_call_from_mapproject(call_from_mapproject),
+    m_rpc(dynamic_cast<asp::RPCModel const*>(cam)),
+    m_grid(new boost::thread_specific_ptr<PixelGrid>){
 
     m_invalid_pix = vw::camera::CameraModel::invalid_pixel();
   }
@@ -65,21 +119,22 @@ public:
   /// Convert Map Projected pixel to camera pixel
   vw::Vector2 reverse(const vw::Vector2 &p) const{
 
+    // Use the pixels of the current tile if available
+    PixelGrid const* grid = m_grid->get();
+    if (grid != NULL && p[0] == floor(p[0]) && p[1] == floor(p[1])) {
+      vw::Vector2i q(p[0], p[1]);
+      if (grid->box.contains(q))
+        return grid->pixels[(q[1] - grid->box.min().y())*grid->box.width()
+                            + q[0] - grid->box.min().x()];
+    }
+
     Vector2 lonlat = m_image_georef.pixel_to_lonlat(p);
     Vector3 lonlatAlt(lonlat[0], lonlat[1], m_dem_height);
     Vector3 xyz = m_dem_georef.datum().geodetic_to_cartesian(lonlatAlt);
     
-    int b = BicubicInterpolation::pixel_buffer;  
     Vector2 pt;
     try{
-      pt = m_cam->point_to_pixel(xyz);
-      if ( m_call_from_mapproject &&
-           (pt[0] < b - 1 || pt[0] >= m_image_size[0] - b ||
-            pt[1] < b - 1 || pt[1] >= m_image_size[1] - b)
-           ){
-        // Won't be able to interpolate into image in transform(...)
-        return m_invalid_pix;
-      }
+      pt = check_pixel(m_cam->point_to_pixel(xyz));
     }catch(...){ // If a point failed to project
       return m_invalid_pix;
     }
@@ -90,13 +145,23 @@ public:
   vw::BBox2i reverse_bbox( vw::BBox2i const& bbox ) const {
 
     vw::BBox2 out_box;      
-    for( int32 y=bbox.min().y(); y<bbox.max().y(); ++y ){
-      for( int32 x=bbox.min().x(); x<bbox.max().x(); ++x ){
-      
-        Vector2 p = reverse( Vector2(x,y) );
-        if (p == m_invalid_pix) 
+    if (m_rpc != NULL && !bbox.empty() &&
+        double(bbox.width())*bbox.height() <= MAX_GRID_PIXELS) {
+      PixelGrid const& grid = compute_grid(bbox);
+      for (size_t i = 0; i < grid.pixels.size(); i++) {
+        if (grid.pixels[i] == m_invalid_pix) 
           continue;
-        out_box.grow( p );
+        out_box.grow( grid.pixels[i] );
+      }
+    }else{
+      for( int32 y=bbox.min().y(); y<bbox.max().y(); ++y ){
+        for( int32 x=bbox.min().x(); x<bbox.max().x(); ++x ){
+        
+          Vector2 p = reverse( Vector2(x,y) );
+          if (p == m_invalid_pix) 
+            continue;
+          out_box.grow( p );
+        }
       }
     }
     out_box = grow_bbox_to_int( out_box );
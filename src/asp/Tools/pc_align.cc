@@ -312,7 +312,7 @@ void read_georef(Options& opt, asp::CsvConv& csv_conv, GeoReference& geo){
   string pc_file = "";
   if ( get_file_type(opt.reference) == "PC" ){
     GeoReference local_geo;
-    if (cartography::read_georeference(local_geo, opt.reference)){
+    if (asp::read_point_cloud_georef(opt.reference, local_geo)){
       pc_file = opt.reference;
       geo = local_geo;
       vw_out() << "Detected datum from " << pc_file << ":\n" << geo.datum() << std::endl;
@@ -321,7 +321,7 @@ void read_georef(Options& opt, asp::CsvConv& csv_conv, GeoReference& geo){
   }
   if ( get_file_type(opt.source) == "PC" ){
     GeoReference local_geo;
-    if (cartography::read_georeference(local_geo, opt.source)){
+    if (asp::read_point_cloud_georef(opt.source, local_geo)){
       pc_file = opt.source;
       geo = local_geo;
       vw_out() << "Detected datum from " << pc_file << ":\n" << geo.datum() << std::endl;
@@ -291,7 +291,7 @@ void save_trans_point_cloud_n(vw::cartography::GdalWriteOptions const& opt,
   // We will try to save the transformed cloud with a georef. Try to get it from
   // the input cloud, or otherwise from the "global" georef.
   vw::cartography::GeoReference curr_geo;
-  bool has_georef = vw::cartography::read_georeference(curr_geo, input_file);
+  bool has_georef = asp::read_point_cloud_georef(input_file, curr_geo);
   if (!has_georef && geo.datum().name() != UNSPECIFIED_DATUM){
     has_georef = true;
     curr_geo = geo;
@@ -55,6 +55,8 @@ std::string get_file_type(std::string const& file_name){
     return "CSV";
   if (asp::is_las(file_name))
     return "LAS";
+  if (asp::is_columnar_point_cloud(file_name))
+    return "PC";
 
   // Note that any tif, ntf, and cub file with one channel with georeference be
   // interpreted as a DEM.
@@ -1063,7 +1065,7 @@ void save_trans_point_cloud(vw::cartography::GdalWriteOptions const& opt,
 
     // Need this logic because we cannot open an image
     // with n channels without knowing n beforehand.
-    int nc = vw::get_num_channels(input_file);
+    int nc = asp::get_point_cloud_num_channels(input_file);
     switch(nc){
     case 3:  save_trans_point_cloud_n<3>(opt, geo, input_file, output_file, T);  break;
     case 4:  save_trans_point_cloud_n<4>(opt, geo, input_file, output_file, T);  break;
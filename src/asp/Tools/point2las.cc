@@ -21,7 +21,10 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <map>
+#include <cstdio>
 #include <boost/program_options.hpp>
 #include <liblas/liblas.hpp>
 
@@ -29,6 +32,8 @@
 #include <asp/Core/Common.h>
 #include <asp/Core/PointUtils.h>
 
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/FileIO.h>
 #include <vw/Image.h>
 #include <vw/Math.h>
@@ -53,7 +58,8 @@ struct Options : vw::cartography::GdalWriteOptions {
   bool compressed;
   // Output
   std::string out_prefix;
-  Options() : compressed(false){}
+  double las_tile_size;
+  Options() : compressed(false), las_tile_size(0){}
 };
 
 void handle_arguments( int argc, char *argv[], Options& opt ) {
@@ -69,7 +75,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
           "This is identical to the datum option.")
 
     ("t_srs", po::value(&opt.target_srs_string)->default_value(""),
-     "Specify a custom projection (PROJ.4 string).");
+     "Specify a custom projection (PROJ.4 string).")
+    ("las-tile-size", po::value(&opt.las_tile_size)->default_value(0),
+     "Write a separate LAS file for each square tile of this size in the output x and y, named <output-prefix>_<col>_<row>.las. Set to 0 to write a single file.");
 
   general_options.add( vw::cartography::GdalWriteOptionsDescription(opt) );
 
@@ -96,6 +104,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     opt.out_prefix =
       vw::prefix_from_filename( opt.pointcloud_file );
 
+  if ( opt.las_tile_size < 0 )
+    vw_throw( ArgumentErr() << "The LAS tile size must be non-negative.\n" );
+
   // reference_spheroid and datum are aliases.
   boost::to_lower(opt.reference_spheroid);
   boost::to_lower(opt.datum);
@@ -112,10 +123,277 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 
 }
 
-int main( int argc, char *argv[] ) {
+// Skip no-data points
+inline bool is_valid_point(Vector3 const& point, bool is_geodetic) {
+  return ( (!is_geodetic && point != vw::Vector3()) ||
+           (is_geodetic  && !boost::math::isnan(point.z())) );
+}
+
+/// Split the cloud into tiles that are converted independently.
+/// Tiles are aligned to the blocks of the cloud on disk, so each
+/// block is read once. Thin blocks, such as the rows of a striped
+/// tif, are grouped together.
+std::vector<BBox2i> point_cloud_tiles(std::string const& pointcloud_file,
+                                      int cols, int rows) {
+  const int min_tile_size = 256;
+  Vector2i block_size = asp::get_point_cloud_block_size(pointcloud_file);
+  for (int i = 0; i < 2; i++)
+    block_size[i] *= (min_tile_size + block_size[i] - 1)/block_size[i];
+  return subdivide_bbox(BBox2i(0, 0, cols, rows), block_size[0], block_size[1]);
+}
+
+/// Grow a shared bounding box by the valid points of a tile.
+class TileBBoxTask : public vw::Task, private boost::noncopyable {
+  ImageViewRef<Vector3> m_image;
+  BBox2i m_box;
+  bool   m_is_geodetic;
+  BBox3 & m_bbox;
+  Mutex & m_mutex;
+public:
+  TileBBoxTask(ImageViewRef<Vector3> image, BBox2i const& box, bool is_geodetic,
+               BBox3 & bbox, Mutex & mutex):
+    m_image(image), m_box(box), m_is_geodetic(is_geodetic), m_bbox(bbox), m_mutex(mutex){}
+
+  virtual void operator()(){
+    ImageView<Vector3> tile = crop(m_image, m_box);
+    BBox3 bbox;
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++) {
+        if (is_valid_point(tile(col, row), m_is_geodetic))
+          bbox.grow(tile(col, row));
+      }
+    }
+    Mutex::Lock lock(m_mutex);
+    m_bbox.grow(bbox);
+  }
+};
+
+/// The bounding box of the valid points, found one tile per thread.
+BBox3 parallel_pointcloud_bbox(ImageViewRef<Vector3> const& point_image, bool is_geodetic,
+                               std::vector<BBox2i> const& tiles) {
+  vw_out() << "Computing the point cloud bounding box.\n";
+  BBox3 bbox;
+  Mutex mutex;
+  FifoWorkQueue queue(vw_settings().default_num_threads());
+  for (size_t it = 0; it < tiles.size(); it++) {
+    boost::shared_ptr<TileBBoxTask>
+      task(new TileBBoxTask(point_image, tiles[it], is_geodetic, bbox, mutex));
+    queue.add_task(task);
+  }
+  queue.join_all();
+  return bbox;
+}
+
+/// The valid points of one tile, quantized the way LAS stores them,
+/// and the output file each goes to.
+struct LasBatch {
+  std::vector<boost::int32_t> raw;     // x, y, z of each point
+  std::vector<Vector2i>       las_tile; // only when writing several files
+  std::string                 error;
+};
+
+/// Batches handed from the conversion threads to the writer, which
+/// takes them in tile order. A thread waits while its tile is too far
+/// ahead of the one being written, which bounds the memory in use.
+class OrderedBatchQueue {
+  std::map<int, boost::shared_ptr<LasBatch> > m_batches;
+  int       m_next, m_capacity;
+  Mutex     m_mutex;
+  Condition m_cond;
+public:
+  OrderedBatchQueue(int capacity): m_next(0), m_capacity(capacity){}
+
+  void put(int index, boost::shared_ptr<LasBatch> batch) {
+    Mutex::Lock lock(m_mutex);
+    while (index >= m_next + m_capacity)
+      m_cond.wait(lock);
+    m_batches[index] = batch;
+    m_cond.notify_all();
+  }
+
+  /// Wait for the next batch in order.
+  boost::shared_ptr<LasBatch> take() {
+    Mutex::Lock lock(m_mutex);
+    while (m_batches.find(m_next) == m_batches.end())
+      m_cond.wait(lock);
+    boost::shared_ptr<LasBatch> batch = m_batches[m_next];
+    m_batches.erase(m_next);
+    m_next++;
+    m_cond.notify_all();
+    return batch;
+  }
+
+  /// Stop making the conversion threads wait, when the writer gives up.
+  void cancel() {
+    Mutex::Lock lock(m_mutex);
+    m_capacity = std::numeric_limits<int>::max()/2;
+    m_cond.notify_all();
+  }
+};
+
+/// Round to the nearest integer, halfway cases away from zero, the
+/// same way liblas does.
+inline boost::int32_t las_round(double r) {
+  return boost::int32_t(r > 0 ? floor(r + 0.5) : ceil(r - 0.5));
+}
+
+/// Reproject and quantize the valid points of a tile.
+class ConvertTileTask : public vw::Task, private boost::noncopyable {
+  ImageViewRef<Vector3> m_image;
+  BBox2i  m_box;
+  int     m_index;
+  bool    m_is_geodetic;
+  Vector3 m_offset, m_scale;
+  Vector2 m_las_tile_origin;
+  double  m_las_tile_size;
+  OrderedBatchQueue & m_queue;
+public:
+  ConvertTileTask(ImageViewRef<Vector3> image, BBox2i const& box, int index, bool is_geodetic,
+                  Vector3 const& offset, Vector3 const& scale,
+                  Vector2 const& las_tile_origin, double las_tile_size,
+                  OrderedBatchQueue & queue):
+    m_image(image), m_box(box), m_index(index), m_is_geodetic(is_geodetic),
+    m_offset(offset), m_scale(scale), m_las_tile_origin(las_tile_origin),
+    m_las_tile_size(las_tile_size), m_queue(queue){}
+
+  virtual void operator()(){
+    boost::shared_ptr<LasBatch> batch(new LasBatch);
+    try {
+      ImageView<Vector3> tile = crop(m_image, m_box);
+      for (int row = 0; row < tile.rows(); row++) {
+        for (int col = 0; col < tile.cols(); col++) {
+          Vector3 const& point = tile(col, row);
+          if (!is_valid_point(point, m_is_geodetic))
+            continue;
+          for (int i = 0; i < 3; i++)
+            batch->raw.push_back(las_round((point[i] - m_offset[i])/m_scale[i]));
+          if (m_las_tile_size > 0)
+            batch->las_tile.push_back(Vector2i(floor((point[0] - m_las_tile_origin[0])/m_las_tile_size),
+                                               floor((point[1] - m_las_tile_origin[1])/m_las_tile_size)));
+        }
+      }
+    } catch (const std::exception& e) {
+      batch->raw.clear();
+      batch->las_tile.clear();
+      batch->error = e.what();
+    }
+    // Always hand over a batch, or the writer would wait forever.
+    m_queue.put(m_index, batch);
+  }
+};
 
-  // To do: need to understand what is the optimal strategy for
-  // traversing the input point cloud file to minimize the reading time.
+/// An open LAS file. The writer refers to the stream, so they live together.
+struct LasOutput {
+  std::ofstream ofs;
+  boost::shared_ptr<liblas::Writer> writer;
+  boost::shared_ptr<liblas::Header> header;
+
+  void write(boost::int32_t const* raw) {
+    liblas::Point las_point(header.get());
+    las_point.SetRawX(raw[0]);
+    las_point.SetRawY(raw[1]);
+    las_point.SetRawZ(raw[2]);
+    writer->WritePoint(las_point);
+  }
+};
+
+/// Open the LAS file for the given output tile. With no tiling there
+/// is a single file.
+boost::shared_ptr<LasOutput> open_las_output(Options const& opt, liblas::Header const& header,
+                                             BBox3 const& cloud_bbox, Vector2i const& las_tile) {
+
+  boost::shared_ptr<LasOutput> out(new LasOutput);
+  out->header = boost::shared_ptr<liblas::Header>(new liblas::Header(header));
+  std::string ext = opt.compressed ? ".laz" : ".las";
+  std::string lasFile = opt.out_prefix + ext;
+  if (opt.las_tile_size > 0) {
+    // This file's part of the bounding box
+    Vector2 tile_min = Vector2(cloud_bbox.min().x(), cloud_bbox.min().y())
+      + opt.las_tile_size*Vector2(las_tile);
+    Vector2 tile_max = tile_min + Vector2(opt.las_tile_size, opt.las_tile_size);
+    out->header->SetMin(std::max(tile_min.x(), cloud_bbox.min().x()),
+                        std::max(tile_min.y(), cloud_bbox.min().y()),
+                        cloud_bbox.min().z());
+    out->header->SetMax(std::min(tile_max.x(), cloud_bbox.max().x()),
+                        std::min(tile_max.y(), cloud_bbox.max().y()),
+                        cloud_bbox.max().z());
+    std::ostringstream os;
+    os << opt.out_prefix << "_" << las_tile.x() << "_" << las_tile.y() << ext;
+    lasFile = os.str();
+  }
+  out->ofs.open(lasFile.c_str(), std::ios::out | std::ios::binary);
+  if (!out->ofs)
+    vw_throw( IOErr() << "Could not open for writing: " << lasFile << "\n" );
+  out->writer = boost::shared_ptr<liblas::Writer>(new liblas::Writer(out->ofs, *out->header));
+  return out;
+}
+
+/// With several output files, there can be too many of them to keep
+/// open at once. The quantized points of each are instead appended to
+/// a temporary file, which is opened only while being written to.
+/// The LAS files are made from these at the end, one at a time.
+class LasTileSpool {
+  typedef std::map<std::pair<int, int>, std::string> FileMap;
+  FileMap m_files;
+  std::string m_prefix;
+public:
+  LasTileSpool(std::string const& prefix): m_prefix(prefix){}
+  ~LasTileSpool() { remove_all(); }
+
+  /// Append the points of a batch to the files of their tiles.
+  void append(LasBatch const& batch) {
+    std::map<std::pair<int, int>, std::vector<boost::int32_t> > groups;
+    for (size_t p = 0; p < batch.las_tile.size(); p++) {
+      std::vector<boost::int32_t> & group
+        = groups[std::make_pair(batch.las_tile[p].x(), batch.las_tile[p].y())];
+      group.insert(group.end(), batch.raw.begin() + 3*p, batch.raw.begin() + 3*p + 3);
+    }
+    for (std::map<std::pair<int, int>, std::vector<boost::int32_t> >::iterator it
+           = groups.begin(); it != groups.end(); it++) {
+      std::string & file = m_files[it->first];
+      if (file.empty()) {
+        std::ostringstream os;
+        os << m_prefix << "_" << it->first.first << "_" << it->first.second << "-points.tmp";
+        file = os.str();
+        std::remove(file.c_str());
+      }
+      std::ofstream ofs(file.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+      ofs.write((char const*)&it->second[0], it->second.size()*sizeof(boost::int32_t));
+      if (!ofs)
+        vw_throw( IOErr() << "Could not write: " << file << "\n" );
+    }
+  }
+
+  /// Write the LAS file of each tile from its temporary file.
+  void write_las_files(Options const& opt, liblas::Header const& header,
+                       BBox3 const& cloud_bbox) {
+    std::vector<boost::int32_t> raw(3*65536);
+    for (FileMap::iterator it = m_files.begin(); it != m_files.end(); it++) {
+      boost::shared_ptr<LasOutput> out
+        = open_las_output(opt, header, cloud_bbox, Vector2i(it->first.first, it->first.second));
+      std::ifstream ifs(it->second.c_str(), std::ios::binary);
+      while (ifs) {
+        ifs.read((char*)&raw[0], raw.size()*sizeof(boost::int32_t));
+        size_t num_points = ifs.gcount()/(3*sizeof(boost::int32_t));
+        for (size_t p = 0; p < num_points; p++)
+          out->write(&raw[3*p]);
+      }
+      out->writer.reset(); // finish the file before the stream closes
+      ifs.close();
+      std::remove(it->second.c_str());
+    }
+    m_files.clear();
+  }
+
+  void remove_all() {
+    for (FileMap::iterator it = m_files.begin(); it != m_files.end(); it++)
+      std::remove(it->second.c_str());
+    m_files.clear();
+  }
+};
+
+
+int main( int argc, char *argv[] ) {
 
   Options opt;
   try {
@@ -128,7 +406,7 @@ int main( int argc, char *argv[] ) {
     bool has_user_datum = asp::read_user_datum(0, 0, opt.datum, datum);
 
     cartography::GeoReference georef;
-    bool has_georef = vw::cartography::read_georeference(georef, opt.pointcloud_file);
+    bool has_georef = asp::read_point_cloud_georef(opt.pointcloud_file, georef);
     if (has_georef && opt.target_srs_string.empty()) {
       opt.target_srs_string = georef.overall_proj4_str();
     }
@@ -158,7 +436,15 @@ int main( int argc, char *argv[] ) {
       point_image = geodetic_to_point(asp::recenter_longitude(point_image, avg_lon), georef);
     }
 
-    BBox3 cloud_bbox = asp::pointcloud_bbox(point_image, is_geodetic);
+    std::vector<BBox2i> tiles = point_cloud_tiles(opt.pointcloud_file,
+                                                  point_image.cols(), point_image.rows());
+
+    // The columnar format knows the bounding box of its xyz points
+    BBox3 cloud_bbox;
+    if (asp::is_columnar_point_cloud(opt.pointcloud_file) && !is_geodetic)
+      cloud_bbox = asp::columnar_point_cloud_bbox(opt.pointcloud_file);
+    else
+      cloud_bbox = parallel_pointcloud_bbox(point_image, is_geodetic, tiles);
 
     // The las format stores the values as 32 bit integers. So, for a
     // given point, we store round((point-offset)/scale), as well as
@@ -181,46 +467,62 @@ int main( int argc, char *argv[] ) {
     // Populate the min and max fields of the LAS header
     header.SetMax(cloud_bbox.max().x(),cloud_bbox.max().y(),cloud_bbox.max().z());
     header.SetMin(cloud_bbox.min().x(),cloud_bbox.min().y(),cloud_bbox.min().z());
-
-    std::string lasFile;
     header.SetCompressed(opt.compressed);
-    if (opt.compressed)
-      lasFile = opt.out_prefix + ".laz";
-    else
-      lasFile = opt.out_prefix + ".las";
+    std::string ext = opt.compressed ? ".laz" : ".las";
+
+    // The tiles are converted in parallel, while this thread writes
+    // them in order. Output files are opened as points reach them.
+    int num_threads = vw_settings().default_num_threads();
+    OrderedBatchQueue batches(2*num_threads);
+    FifoWorkQueue queue(num_threads);
+    Vector2 las_tile_origin(cloud_bbox.min().x(), cloud_bbox.min().y());
+    for (size_t it = 0; it < tiles.size(); it++) {
+      boost::shared_ptr<ConvertTileTask>
+        task(new ConvertTileTask(point_image, tiles[it], it, is_geodetic, offset, scale,
+                                 las_tile_origin, opt.las_tile_size, batches));
+      queue.add_task(task);
+    }
 
-    vw_out() << "Writing LAS file: " << lasFile + "\n";
-    std::ofstream ofs;
-    ofs.open(lasFile.c_str(), std::ios::out | std::ios::binary);
-    liblas::Writer writer(ofs, header);
+    boost::shared_ptr<LasOutput> single_output;
+    LasTileSpool spool(opt.out_prefix);
+    if (opt.las_tile_size <= 0) {
+      vw_out() << "Writing LAS file: " << opt.out_prefix + ext + "\n";
+      single_output = open_las_output(opt, header, cloud_bbox, Vector2i());
+    } else {
+      vw_out() << "Writing LAS files: " << opt.out_prefix + "_*" + ext + "\n";
+    }
 
     TerminalProgressCallback tpc("asp", "\t--> ");
-    for (int row = 0; row < point_image.rows(); row++){
-      tpc.report_fractional_progress(row, point_image.rows());
-      for (int col = 0; col < point_image.cols(); col++){
-
-        Vector3 point = point_image(col, row);
-
-        // Skip no-data points
-        bool is_good = ( (!is_geodetic && point != vw::Vector3()) ||
-                         (is_geodetic  && !boost::math::isnan(point.z())) );
-        if (!is_good) continue;
-
-#if 0
-        // For comparison later with las2txt.
-        std::cout.precision(16);
-        std::cout << "\npoint " << point[0] << ' ' << point[1] << ' '
-                  << point[2] << std::endl;
-#endif
-
-        liblas::Point las_point(&header);
-        las_point.SetCoordinates(point[0], point[1], point[2]);
-        writer.WritePoint(las_point);
-
+    try {
+      for (size_t it = 0; it < tiles.size(); it++){
+        tpc.report_fractional_progress(it, tiles.size());
+        boost::shared_ptr<LasBatch> batch = batches.take();
+        if (!batch->error.empty())
+          vw_throw( IOErr() << "Failed to convert the points in " << tiles[it] << ": "
+                    << batch->error << "\n" );
+
+        if (single_output) {
+          size_t num_points = batch->raw.size()/3;
+          for (size_t p = 0; p < num_points; p++)
+            single_output->write(&batch->raw[3*p]);
+        } else {
+          spool.append(*batch);
+        }
       }
+    } catch (...) {
+      // Let the conversion threads finish before unwinding
+      batches.cancel();
+      queue.join_all();
+      throw;
     }
+    queue.join_all();
     tpc.report_finished();
 
+    if (single_output)
+      single_output->writer.reset(); // finish the file before the stream closes
+    else
+      spool.write_las_files(opt, header, cloud_bbox);
+
   } ASP_STANDARD_CATCHES;
 
   return 0;
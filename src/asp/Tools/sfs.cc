@@ -44,10 +44,12 @@
 #include <asp/Camera/RPCModelGen.h>
 #include <ceres/ceres.h>
 #include <ceres/loss_function.h>
+#include <boost/thread/tss.hpp>
 #include <iostream>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <set>
 #include<sys/types.h>
 
 #if defined(__GNUC__) || defined(__GNUG__)
@@ -854,9 +856,11 @@ struct Options : public vw::cartography::GdalWriteOptions {
   bool float_albedo, float_exposure, float_cameras, float_all_cameras, model_shadows,
     save_dem_with_nodata, use_approx_camera_models, use_rpc_approximation, crop_input_images,
     use_blending_weights,
-    float_dem_at_boundary, fix_dem, float_reflectance_model, query, save_sparingly;
+    float_dem_at_boundary, fix_dem, float_reflectance_model, query, save_sparingly,
+    report_term_timings;
   double smoothness_weight, init_dem_height, nodata_val, initial_dem_constraint_weight,
-    albedo_constraint_weight, camera_position_step_size, rpc_penalty_weight, unreliable_intensity_threshold;
+    albedo_constraint_weight, camera_position_step_size, rpc_penalty_weight, unreliable_intensity_threshold,
+    projection_cache_height_threshold;
   vw::BBox2 crop_win;
 
   Options():max_iterations(0), max_coarse_iterations(0), reflectance_type(0),
@@ -869,10 +873,12 @@ struct Options : public vw::cartography::GdalWriteOptions {
 	    crop_input_images(false), use_blending_weights(false),
             float_dem_at_boundary(false), fix_dem(false),
             float_reflectance_model(false), query(false), save_sparingly(false),
+            report_term_timings(false),
 	    smoothness_weight(0), initial_dem_constraint_weight(0.0),
 	    albedo_constraint_weight(0.0),
 	    camera_position_step_size(1.0), rpc_penalty_weight(0.0),
             unreliable_intensity_threshold(0.0),
+            projection_cache_height_threshold(0.0),
 	    crop_win(BBox2i(0, 0, 0, 0)){}
 };
 
@@ -1296,6 +1302,22 @@ double ComputeReflectance(Vector3 const& cameraPosition,
   return input_img_reflectance;
 }
 
+// Where a DEM grid point projects into a given image, and the
+// camera center there, as last computed with the exact camera model.
+// The projection is stored together with its derivative in height, so
+// it can be extrapolated linearly while the height stays within a
+// threshold of the one at which it was computed. This saves calling
+// the camera model for every cost function evaluation (and numerical
+// differentiation evaluates each residual many times per iteration).
+struct ProjectionCacheEntry {
+  bool    valid;
+  double  height;
+  Vector2 pix, dpix_dh;
+  Vector3 camera_position;
+  int     num_cached, num_exact; // statistics, reset at each iteration
+  ProjectionCacheEntry(): valid(false), height(0.0), num_cached(0), num_exact(0) {}
+};
+
 bool computeReflectanceAndIntensity(double left_h, double center_h, double right_h,
 				    double bottom_h, double top_h,
 				    int col, int row,
@@ -1313,7 +1335,9 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
 				    PixelMask<double> & reflectance,
 				    PixelMask<double> & intensity,
 				    double            & weight,
-                                    const double * coeffs) {
+                                    const double * coeffs,
+                                    ProjectionCacheEntry * proj_cache = NULL,
+                                    double proj_cache_threshold = 0.0) {
 
   // Set output values
   reflectance = 0.0; reflectance.invalidate();
@@ -1372,11 +1396,38 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
   Vector2 pix;
   Vector3 cameraPosition;
   try {
-    pix = camera->point_to_pixel(base);
-    
-    // Need camera center only for Lunar Lambertian
-    if ( global_params.reflectanceType != LAMBERT ) {
-      cameraPosition = camera->camera_center(pix);
+
+    if (proj_cache != NULL && proj_cache->valid &&
+        std::abs(center_h - proj_cache->height) <= proj_cache_threshold) {
+      // Reuse the last exact projection
+      pix = proj_cache->pix + (center_h - proj_cache->height)*proj_cache->dpix_dh;
+      cameraPosition = proj_cache->camera_position;
+      proj_cache->num_cached++;
+    }else{
+      pix = camera->point_to_pixel(base);
+
+      // Need camera center only for Lunar Lambertian
+      if ( global_params.reflectanceType != LAMBERT ) {
+        cameraPosition = camera->camera_center(pix);
+      }
+
+      if (proj_cache != NULL) {
+        // Find how the projection moves with height, so that it can be
+        // extrapolated. A 1 meter step is small compared to the distance
+        // to the camera and large compared to the numerical noise.
+        proj_cache->num_exact++;
+        proj_cache->valid = false;
+        try {
+          Vector2 lonlat_c = geo.pixel_to_lonlat(Vector2(col, row));
+          Vector3 above = geo.datum().geodetic_to_cartesian
+            (Vector3(lonlat_c[0], lonlat_c[1], center_h + 1.0));
+          proj_cache->dpix_dh         = camera->point_to_pixel(above) - pix;
+          proj_cache->pix             = pix;
+          proj_cache->height          = center_h;
+          proj_cache->camera_position = cameraPosition;
+          proj_cache->valid           = true;
+        } catch(...){} // Will just not use the cache for this point
+      }
     }
     
   } catch(...){
@@ -1546,6 +1597,7 @@ double                                       * g_gridy;
 int                                            g_level = -1;
 bool                                           g_final_iter = false;
 double                                       * g_coeffs; 
+std::vector<ProjectionCacheEntry>            * g_proj_cache = NULL;
 
 // When floating the camera position and orientation, multiply the
 // position variables by this factor times
@@ -1554,6 +1606,64 @@ double                                       * g_coeffs;
 // 1 meter than by a tiny fraction of one millimeter).
 double g_position_scale_factor = 1e+6;
 
+// Each thread evaluating the cost function keeps its own copy of each
+// adjusted camera, to avoid copying the camera and rebuilding its
+// rotation on every evaluation. The copy is updated only when the
+// adjustments passed in by the solver change.
+struct CameraWorkspace {
+  boost::shared_ptr<AdjustedCameraModel> camera;
+  double adjustments[6];
+  bool valid;
+  CameraWorkspace(): valid(false) {}
+};
+
+struct CameraWorkspaces {
+  int generation;
+  std::map<CameraModel const*, CameraWorkspace> workspaces;
+  size_t num_reused, num_updated; // statistics, reset at each iteration
+  CameraWorkspaces(): generation(-1), num_reused(0), num_updated(0) {}
+};
+
+// The workspaces of all threads, so that their statistics can be
+// collected after each iteration. The counts of threads which exited
+// are folded into the totals below.
+vw::Mutex                    g_camera_workspace_mutex;
+std::set<CameraWorkspaces*>  g_camera_workspace_list;
+size_t                       g_camera_workspace_num_reused  = 0;
+size_t                       g_camera_workspace_num_updated = 0;
+
+void release_camera_workspaces(CameraWorkspaces * local) {
+  vw::Mutex::Lock lock(g_camera_workspace_mutex);
+  g_camera_workspace_num_reused  += local->num_reused;
+  g_camera_workspace_num_updated += local->num_updated;
+  g_camera_workspace_list.erase(local);
+  delete local;
+}
+
+boost::thread_specific_ptr<CameraWorkspaces> g_camera_workspaces(release_camera_workspaces);
+
+// Bump this when the cameras are modified outside of the solver, to
+// invalidate the copies kept by each thread.
+int g_camera_workspace_generation = 0;
+
+// Sum up and reset how many times the camera copies were reused and
+// how many times they had to be updated. Must not be called while
+// the cost function is being evaluated.
+void camera_workspace_stats(size_t & num_reused, size_t & num_updated) {
+  vw::Mutex::Lock lock(g_camera_workspace_mutex);
+  num_reused  = g_camera_workspace_num_reused;
+  num_updated = g_camera_workspace_num_updated;
+  g_camera_workspace_num_reused  = 0;
+  g_camera_workspace_num_updated = 0;
+  for (std::set<CameraWorkspaces*>::iterator it = g_camera_workspace_list.begin();
+       it != g_camera_workspace_list.end(); it++) {
+    num_reused  += (*it)->num_reused;
+    num_updated += (*it)->num_updated;
+    (*it)->num_reused  = 0;
+    (*it)->num_updated = 0;
+  }
+}
+
 class SfsCallback: public ceres::IterationCallback {
 public:
   virtual ceres::CallbackReturnType operator()
@@ -1564,6 +1674,40 @@ public:
     vw_out() << "Finished iteration: " << g_iter << std::endl;
     callTop();
 
+    // Report how expensive the intensity evaluations were, and reset
+    // the counters for the next iteration.
+    if (!g_final_iter) {
+      vw_out() << "Iteration time: " << summary.iteration_time_in_seconds << " seconds.\n";
+      if (g_proj_cache != NULL && !g_proj_cache->empty()) {
+        size_t num_cached = 0, num_exact = 0;
+        for (size_t it = 0; it < g_proj_cache->size(); it++) {
+          num_cached += (*g_proj_cache)[it].num_cached;
+          num_exact  += (*g_proj_cache)[it].num_exact;
+          (*g_proj_cache)[it].num_cached = 0;
+          (*g_proj_cache)[it].num_exact  = 0;
+        }
+        size_t num_evals = num_cached + num_exact;
+        vw_out() << "Intensity evaluations: " << num_evals << ", of which "
+                 << num_exact << " used the camera model and "
+                 << num_cached << " reused a prior projection";
+        if (num_evals > 0)
+          vw_out() << " (" << 100.0*num_cached/num_evals << "%)";
+        vw_out() << ".\n";
+      }
+
+      // The cameras change only when floated
+      if (g_opt->float_cameras) {
+        size_t num_reused = 0, num_updated = 0;
+        camera_workspace_stats(num_reused, num_updated);
+        size_t num_lookups = num_reused + num_updated;
+        if (num_lookups > 0)
+          vw_out() << "Camera lookups: " << num_lookups << ", of which "
+                   << num_updated << " applied new adjustments and "
+                   << num_reused << " reused the thread's camera copy ("
+                   << 100.0*num_reused/num_lookups << "%).\n";
+      }
+    }
+
     std::string exposure_file = exposure_file_name(g_opt->out_prefix);
     vw_out() << "Writing: " << exposure_file << std::endl;
     std::ofstream exf(exposure_file.c_str());
@@ -1834,6 +1978,56 @@ public:
   }
 };
 
+AdjustedCameraModel * get_workspace_camera(CameraModel * camera,
+                                           const double * adjustments,
+                                           double camera_position_step_size){
+
+  if (g_camera_workspaces.get() == NULL) {
+    CameraWorkspaces * workspaces = new CameraWorkspaces;
+    g_camera_workspaces.reset(workspaces);
+    vw::Mutex::Lock lock(g_camera_workspace_mutex);
+    g_camera_workspace_list.insert(workspaces);
+  }
+
+  CameraWorkspaces & local = *g_camera_workspaces;
+  if (local.generation != g_camera_workspace_generation) {
+    local.workspaces.clear();
+    local.generation = g_camera_workspace_generation;
+  }
+
+  CameraWorkspace & ws = local.workspaces[camera];
+  if (ws.camera.get() == NULL) {
+    AdjustedCameraModel * adj_cam = dynamic_cast<AdjustedCameraModel*>(camera);
+    if (adj_cam == NULL)
+      vw_throw( ArgumentErr() << "Expecting adjusted camera.\n");
+
+    // We copy just the adjustment parameters, the pointer to the
+    // underlying camera is shared.
+    ws.camera.reset(new AdjustedCameraModel(*adj_cam));
+  }
+
+  if (ws.valid && std::equal(adjustments, adjustments + 6, ws.adjustments)) {
+    local.num_reused++;
+    return ws.camera.get();
+  }
+  local.num_updated++;
+
+  // Apply current adjustments to the camera
+  Vector3 axis_angle;
+  Vector3 translation;
+  for (int param_iter = 0; param_iter < 3; param_iter++) {
+    translation[param_iter]
+      = (g_position_scale_factor*camera_position_step_size)*adjustments[param_iter];
+    axis_angle[param_iter] = adjustments[3 + param_iter];
+  }
+  ws.camera->set_translation(translation);
+  ws.camera->set_axis_angle_rotation(axis_angle);
+
+  std::copy(adjustments, adjustments + 6, ws.adjustments);
+  ws.valid = true;
+
+  return ws.camera.get();
+}
 
 // Discrepancy between measured and computed intensity.
 // sum_i | I_i - albedo * exposures[i] * reflectance_i |^2
@@ -1850,7 +2044,9 @@ struct IntensityError {
 		 BBox2i const& crop_box,
 		 MaskedImgT const& image,
 		 DoubleImgT const& blend_weight,
-		 boost::shared_ptr<CameraModel> const& camera):
+		 boost::shared_ptr<CameraModel> const& camera,
+		 ProjectionCacheEntry * proj_cache,
+		 double proj_cache_threshold):
     m_col(col), m_row(row), m_dem(dem), m_geo(geo),
     m_model_shadows(model_shadows),
     m_camera_position_step_size(camera_position_step_size),
@@ -1860,7 +2056,8 @@ struct IntensityError {
     m_model_params(model_params),
     m_crop_box(crop_box),
     m_image(image), m_blend_weight(blend_weight),
-    m_camera(camera) {}
+    m_camera(camera), m_proj_cache(proj_cache),
+    m_proj_cache_threshold(proj_cache_threshold) {}
 
   // See SmoothnessError() for the definitions of bottom, top, etc.
   template <typename F>
@@ -1880,26 +2077,10 @@ struct IntensityError {
     residuals[0] = F(0.0);
     try{
 
+      // Use this thread's copy of the camera, with the current
+      // adjustments applied, to avoid issues when using multiple threads.
       AdjustedCameraModel * adj_cam
-	= dynamic_cast<AdjustedCameraModel*>(m_camera.get());
-      if (adj_cam == NULL)
-	vw_throw( ArgumentErr() << "Expecting adjusted camera.\n");
-
-      // We create a copy of this camera to avoid issues when using
-      // multiple threads. We copy just the adjustment parameters,
-      // the pointer to the underlying ISIS camera is shared.
-      AdjustedCameraModel adj_cam_copy = *adj_cam;
-
-      // Apply current adjustments to the camera
-      Vector3 axis_angle;
-      Vector3 translation;
-      for (int param_iter = 0; param_iter < 3; param_iter++) {
-	translation[param_iter]
-	  = (g_position_scale_factor*m_camera_position_step_size)*adjustments[param_iter];
-	axis_angle[param_iter] = adjustments[3 + param_iter];
-      }
-      adj_cam_copy.set_translation(translation);
-      adj_cam_copy.set_axis_angle_rotation(axis_angle);
+        = get_workspace_camera(m_camera.get(), adjustments, m_camera_position_step_size);
 
       PixelMask<double> reflectance, intensity;
       double weight;
@@ -1910,8 +2091,9 @@ struct IntensityError {
 				       m_model_shadows, m_max_dem_height,
 				       m_gridx, m_gridy,
 				       m_model_params,  m_global_params,
-				       m_crop_box, m_image, m_blend_weight, &adj_cam_copy,
-				       reflectance, intensity, weight, coeffs);
+				       m_crop_box, m_image, m_blend_weight, adj_cam,
+				       reflectance, intensity, weight, coeffs,
+				       m_proj_cache, m_proj_cache_threshold);
       
       if (g_opt->unreliable_intensity_threshold > 0){
         if (is_valid(intensity) && intensity.child() <= g_opt->unreliable_intensity_threshold &&
@@ -1949,7 +2131,9 @@ struct IntensityError {
 				     BBox2i const& crop_box,
 				     MaskedImgT const& image,
 				     DoubleImgT const& blend_weight,
-				     boost::shared_ptr<CameraModel> const& camera){
+				     boost::shared_ptr<CameraModel> const& camera,
+				     ProjectionCacheEntry * proj_cache,
+				     double proj_cache_threshold){
     return (new ceres::NumericDiffCostFunction<IntensityError,
 	    ceres::CENTRAL, 1, 1, 1, 1, 1, 1, 1, 1, 6, g_num_model_coeffs>
 	    (new IntensityError(col, row, dem, geo,
@@ -1958,7 +2142,8 @@ struct IntensityError {
 				max_dem_height,
 				gridx, gridy,
 				global_params, model_params,
-				crop_box, image, blend_weight, camera)));
+				crop_box, image, blend_weight, camera,
+				proj_cache, proj_cache_threshold)));
   }
 
   int m_col, m_row;
@@ -1974,6 +2159,8 @@ struct IntensityError {
   MaskedImgT                        const & m_image;          // alias
   DoubleImgT                        const & m_blend_weight;   // alias
   boost::shared_ptr<CameraModel>    const & m_camera;         // alias
+  ProjectionCacheEntry                    * m_proj_cache;     // may be NULL
+  double                                    m_proj_cache_threshold;
 };
 
 
@@ -2005,10 +2192,10 @@ struct SmoothnessError {
 
       // Normalize by grid size seems to make the functional less
       // sensitive to the actual grid size used.
-      residuals[0] = (left[0] + right[0] - 2*center[0])/m_gridx/m_gridx;   // u_xx
+      residuals[0] = (left[0] + right[0] - 2.0*center[0])/m_gridx/m_gridx; // u_xx
       residuals[1] = (br[0] + tl[0] - bl[0] - tr[0] )/4.0/m_gridx/m_gridy; // u_xy
       residuals[2] = residuals[1];                                         // u_yx
-      residuals[3] = (bottom[0] + top[0] - 2*center[0])/m_gridy/m_gridy;   // u_yy
+      residuals[3] = (bottom[0] + top[0] - 2.0*center[0])/m_gridy/m_gridy; // u_yy
 
       for (int i = 0; i < 4; i++)
 	residuals[i] *= m_smoothness_weight;
@@ -2026,11 +2213,12 @@ struct SmoothnessError {
   }
 
   // Factory to hide the construction of the CostFunction object from
-  // the client code.
+  // the client code. This is linear in the heights, so automatic
+  // differentiation gives exact derivatives at little cost.
   static ceres::CostFunction* Create(double smoothness_weight,
 				     double gridx, double gridy){
-    return (new ceres::NumericDiffCostFunction<SmoothnessError,
-	    ceres::CENTRAL, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1>
+    return (new ceres::AutoDiffCostFunction<SmoothnessError,
+	    4, 1, 1, 1, 1, 1, 1, 1, 1, 1>
 	    (new SmoothnessError(smoothness_weight, gridx, gridy)));
   }
 
@@ -2052,8 +2240,7 @@ struct HeightChangeError {
   // the client code.
   static ceres::CostFunction* Create(double orig_height,
 				     double initial_dem_constraint_weight){
-    return (new ceres::NumericDiffCostFunction<HeightChangeError,
-	    ceres::CENTRAL, 1, 1>
+    return (new ceres::AutoDiffCostFunction<HeightChangeError, 1, 1>
 	    (new HeightChangeError(orig_height, initial_dem_constraint_weight)));
   }
 
@@ -2075,8 +2262,7 @@ struct AlbedoChangeError {
   // the client code.
   static ceres::CostFunction* Create(double initial_albedo,
 				     double albedo_constraint_weight){
-    return (new ceres::NumericDiffCostFunction<AlbedoChangeError,
-	    ceres::CENTRAL, 1, 1>
+    return (new ceres::AutoDiffCostFunction<AlbedoChangeError, 1, 1>
 	    (new AlbedoChangeError(initial_albedo, albedo_constraint_weight)));
   }
 
@@ -2243,7 +2429,11 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("save-sparingly",   po::bool_switch(&opt.save_sparingly)->default_value(false)->implicit_value(true),
      "Avoid saving most intermediate results, as that's a lot of files.")
     ("camera-position-step-size", po::value(&opt.camera_position_step_size)->default_value(1.0),
-     "Larger step size will result in more aggressiveness in varying the camera position if it is being floated (which may result in a better solution or in divergence).");
+     "Larger step size will result in more aggressiveness in varying the camera position if it is being floated (which may result in a better solution or in divergence).")
+    ("report-term-timings", po::bool_switch(&opt.report_term_timings)->default_value(false)->implicit_value(true),
+     "At each level, before optimizing, time one evaluation of each kind of term in the cost function. This costs an extra evaluation of the whole problem.")
+    ("projection-cache-height-threshold", po::value(&opt.projection_cache_height_threshold)->default_value(0.0),
+     "Project a DEM grid point into the images with the camera model only if its height changed by more than this many meters since it was last projected, and otherwise extrapolate the last projection. This is an approximation, which changes the results somewhat. A value of 0.5 is a reasonable choice. If 0, always use the camera model. Not used when floating the cameras.");
 
   general_options.add( vw::cartography::GdalWriteOptionsDescription(opt) );
 
@@ -2387,6 +2577,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw_throw(ArgumentErr() << "Expecting a positive value for camera-position-step-size.\n");
   }
 
+  if (opt.projection_cache_height_threshold < 0) {
+    vw_throw(ArgumentErr() << "Expecting a non-negative value for projection-cache-height-threshold.\n");
+  }
+
   if (opt.coarse_levels < 0) {
     vw_throw(ArgumentErr() << "Expecting the number of levels to be non-negative.\n");
   }
@@ -2426,6 +2620,36 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   
 }
 
+// The kinds of terms in the sfs cost function
+enum { INTENSITY_TERM = 0, SMOOTHNESS_TERM, HEIGHT_CHANGE_TERM, ALBEDO_CHANGE_TERM,
+       NUM_TERM_TYPES };
+
+// Time evaluating the residuals and the gradient for each kind of
+// term, to see where the time in each iteration goes. Ceres reports
+// only the total evaluation time.
+void report_term_timings(ceres::Problem & problem,
+                         std::vector< std::vector<ceres::ResidualBlockId> > const& term_blocks,
+                         int num_threads){
+
+  const char * term_names[NUM_TERM_TYPES] = {"intensity", "smoothness",
+                                             "height change", "albedo change"};
+  vw_out() << "Time to evaluate the residuals and gradient once, by term:\n";
+  for (int term = 0; term < NUM_TERM_TYPES; term++) {
+    if (term_blocks[term].empty()) continue;
+    ceres::Problem::EvaluateOptions eval_options;
+    eval_options.residual_blocks = term_blocks[term];
+    eval_options.num_threads     = num_threads;
+    double cost = 0.0;
+    std::vector<double> gradient;
+    Stopwatch sw;
+    sw.start();
+    problem.Evaluate(eval_options, &cost, NULL, &gradient, NULL);
+    sw.stop();
+    vw_out() << "  " << term_names[term] << ": " << sw.elapsed_seconds() << " seconds for "
+             << term_blocks[term].size() << " terms (cost: " << cost << ").\n";
+  }
+}
+
 // Run sfs at a given coarseness level
 void run_sfs_level(// Fixed inputs
 		   int num_iterations, Options & opt,
@@ -2461,6 +2685,10 @@ void run_sfs_level(// Fixed inputs
   g_gridx = &gridx;
   g_gridy = &gridy;
 
+  // The cameras may have been replaced since the last level, so any
+  // per-thread copies of them are stale.
+  g_camera_workspace_generation++;
+
   std::vector<double> max_dem_height(num_dems, -std::numeric_limits<double>::max());
   if (opt.model_shadows) {
     // Find the max DEM height
@@ -2492,6 +2720,24 @@ void run_sfs_level(// Fixed inputs
   }
 
   std::set<int> use_dem, use_albedo; // to avoid a crash in Ceres when a param is fixed but not set
+
+  // The residual blocks of each kind, to be able to time them separately
+  std::vector< std::vector<ceres::ResidualBlockId> > term_blocks(NUM_TERM_TYPES);
+
+  // The projection of each grid point into each image can be reused
+  // across evaluations as long as the cameras do not move. Allocate
+  // it upfront, as the cost functions will keep pointers into it.
+  std::vector<ProjectionCacheEntry> proj_cache;
+  bool use_proj_cache = (opt.projection_cache_height_threshold > 0 && !opt.float_cameras);
+  if (use_proj_cache) {
+    size_t num_entries = 0;
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++)
+      num_entries += size_t(dems[dem_iter].cols()) * dems[dem_iter].rows() * num_images;
+    proj_cache.reserve(num_entries);
+    vw_out() << "Reusing the projections into the images for height changes of up to "
+             << opt.projection_cache_height_threshold << " meters.\n";
+  }
+  g_proj_cache = &proj_cache;
   
   for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
     
@@ -2505,6 +2751,12 @@ void run_sfs_level(// Fixed inputs
           if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end()) {
             continue;
           }
+
+          ProjectionCacheEntry * proj_cache_entry = NULL;
+          if (use_proj_cache) {
+            proj_cache.push_back(ProjectionCacheEntry());
+            proj_cache_entry = &proj_cache.back();
+          }
         
           ceres::CostFunction* cost_function_img =
             IntensityError::Create(col, row, dems[dem_iter], geo[dem_iter],
@@ -2516,9 +2768,12 @@ void run_sfs_level(// Fixed inputs
                                    crop_boxes[dem_iter][image_iter],
                                    masked_images[dem_iter][image_iter],
                                    blend_weights[dem_iter][image_iter],
-                                   cameras[dem_iter][image_iter]);
+                                   cameras[dem_iter][image_iter],
+                                   proj_cache_entry,
+                                   opt.projection_cache_height_threshold);
           ceres::LossFunction* loss_function_img = NULL;
-          problem.AddResidualBlock(cost_function_img, loss_function_img,
+          term_blocks[INTENSITY_TERM].push_back
+            (problem.AddResidualBlock(cost_function_img, loss_function_img,
                                    &exposures[image_iter],      // exposure
                                    &dems[dem_iter](col-1, row),            // left
                                    &dems[dem_iter](col, row),              // center
@@ -2527,7 +2782,7 @@ void run_sfs_level(// Fixed inputs
                                    &dems[dem_iter](col, row-1),            // top
                                    &albedos[dem_iter](col, row),           // albedo
                                    &adjustments[6*image_iter],  // camera
-                                   &coeffs[0]);                 // reflectance model coeffs
+                                   &coeffs[0]));                // reflectance model coeffs
           use_dem.insert(dem_iter); 
           use_albedo.insert(dem_iter);
         } // end iterating over images
@@ -2536,13 +2791,14 @@ void run_sfs_level(// Fixed inputs
         ceres::LossFunction* loss_function_sm = NULL;
         ceres::CostFunction* cost_function_sm =
           SmoothnessError::Create(smoothness_weight, gridx, gridy);
-        problem.AddResidualBlock(cost_function_sm, loss_function_sm,
-                                 &dems[dem_iter](col-1, row+1), &dems[dem_iter](col, row+1),
-                                 &dems[dem_iter](col+1, row+1),
-                                 &dems[dem_iter](col-1, row  ), &dems[dem_iter](col, row  ),
-                                 &dems[dem_iter](col+1, row  ),
-                                 &dems[dem_iter](col-1, row-1), &dems[dem_iter](col, row-1),
-                                 &dems[dem_iter](col+1, row-1));
+        term_blocks[SMOOTHNESS_TERM].push_back
+          (problem.AddResidualBlock(cost_function_sm, loss_function_sm,
+                                    &dems[dem_iter](col-1, row+1), &dems[dem_iter](col, row+1),
+                                    &dems[dem_iter](col+1, row+1),
+                                    &dems[dem_iter](col-1, row  ), &dems[dem_iter](col, row  ),
+                                    &dems[dem_iter](col+1, row  ),
+                                    &dems[dem_iter](col-1, row-1), &dems[dem_iter](col, row-1),
+                                    &dems[dem_iter](col+1, row-1)));
         use_dem.insert(dem_iter); 
         
         // Deviation from prescribed height constraint
@@ -2551,8 +2807,9 @@ void run_sfs_level(// Fixed inputs
           ceres::CostFunction* cost_function_hc =
             HeightChangeError::Create(orig_dems[dem_iter](col, row),
                                       opt.initial_dem_constraint_weight);
-          problem.AddResidualBlock(cost_function_hc, loss_function_hc,
-                                   &dems[dem_iter](col, row));
+          term_blocks[HEIGHT_CHANGE_TERM].push_back
+            (problem.AddResidualBlock(cost_function_hc, loss_function_hc,
+                                      &dems[dem_iter](col, row)));
           use_dem.insert(dem_iter); 
         }
       
@@ -2562,8 +2819,9 @@ void run_sfs_level(// Fixed inputs
 	  ceres::CostFunction* cost_function_hc =
 	    AlbedoChangeError::Create(initial_albedo,
 				      opt.albedo_constraint_weight);
-	  problem.AddResidualBlock(cost_function_hc, loss_function_hc,
-				   &albedos[dem_iter](col, row));
+	  term_blocks[ALBEDO_CHANGE_TERM].push_back
+	    (problem.AddResidualBlock(cost_function_hc, loss_function_hc,
+				      &albedos[dem_iter](col, row)));
 	  use_albedo.insert(dem_iter);
 	}
 	
@@ -2667,6 +2925,9 @@ void run_sfs_level(// Fixed inputs
   options.num_threads = opt.num_threads;
   options.linear_solver_type = ceres::SPARSE_SCHUR;
 
+  if (opt.report_term_timings)
+    report_term_timings(problem, term_blocks, opt.num_threads);
+
   // Use a callback function at every iteration
   SfsCallback callback;
   options.callbacks.push_back(&callback);
@@ -2698,6 +2959,8 @@ void run_sfs_level(// Fixed inputs
   ceres::IterationSummary callback_summary;
   callback(callback_summary);
   
+  g_proj_cache = NULL;
+  
   vw_out() << summary.FullReport() << "\n" << std::endl;
 }
 
@@ -25,6 +25,7 @@
 #include <vw/Stereo/CorrelationView.h>
 #include <vw/Stereo/CostFunctions.h>
 #include <vw/Stereo/DisparityMap.h>
+#include <vw/Core/Stopwatch.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -523,6 +524,12 @@ namespace asp {
       vw_throw(ArgumentErr() << "Invalid value for seed-mode: " << stereo_settings().seed_mode << ".\n");
     }
 
+    if (stereo_settings().point_cloud_format != "tif" &&
+        stereo_settings().point_cloud_format != "apc"){
+      vw_throw(ArgumentErr() << "Invalid value for point-cloud-format: "
+               << stereo_settings().point_cloud_format << ". Use tif or apc.\n");
+    }
+
     // Local homography needs D_sub
     if (stereo_settings().seed_mode == 0 &&
         stereo_settings().use_local_homography){
@@ -928,4 +935,44 @@ namespace asp {
            has_tif_or_ntf_extension(opt.in_file2));
   } // End function skip_image_normalization
 
+  void run_tile_worker(ASPGlobalOptions const& opt,
+                       boost::function<void(ASPGlobalOptions&)> process_tile) {
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+
+      boost::algorithm::trim(line);
+      if (line.empty())
+        continue;
+      if (line == "quit")
+        break;
+
+      std::string out_prefix;
+      int xoff, yoff, xsize, ysize;
+      std::istringstream is(line);
+      if (!(is >> out_prefix >> xoff >> yoff >> xsize >> ysize)) {
+        vw_out(ErrorMessage) << "Could not parse tile: " << line << "\n";
+        std::cout << "tile-worker: failed " << line << std::endl;
+        continue;
+      }
+
+      ASPGlobalOptions tile_opt = opt;
+      tile_opt.out_prefix = out_prefix;
+      stereo_settings().trans_crop_win = BBox2i(xoff, yoff, xsize, ysize);
+
+      Stopwatch sw;
+      sw.start();
+      try {
+        process_tile(tile_opt);
+      } catch (const std::exception& e) {
+        vw_out(ErrorMessage) << e.what() << "\n";
+        std::cout << "tile-worker: failed " << out_prefix << std::endl;
+        continue;
+      }
+      sw.stop();
+      std::cout << "tile-worker: done " << out_prefix << " "
+                << sw.elapsed_seconds() << std::endl;
+    }
+  }
+
 } // end namespace asp
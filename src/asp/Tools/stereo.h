@@ -23,6 +23,7 @@
 #define __ASP_STEREO_H__
 
 #include <boost/algorithm/string.hpp>
+#include <boost/function.hpp>
 
 #include <vw/Core.h>
 #include <vw/Image.h>
@@ -100,6 +101,15 @@ namespace asp {
 
   bool skip_image_normalization(ASPGlobalOptions const& opt);
 
+  /// Run the given stereo stage for each tile read from standard
+  /// input, until "quit" or the end of input. Each line has the tile
+  /// output prefix and its crop window in respect to L.tif. This way
+  /// the stereo session and settings are loaded once for many tiles.
+  /// A status line starting with "tile-worker:" is printed to standard
+  /// output after each tile.
+  void run_tile_worker(ASPGlobalOptions const& opt,
+                       boost::function<void(ASPGlobalOptions&)> process_tile);
+
 } // end namespace vw
 
 #endif//__ASP_STEREO_H__
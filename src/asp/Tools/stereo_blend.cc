@@ -241,32 +241,94 @@ bool get_roi_from_tile(std::string const& tile_path, Position pos,
   return true;
 }
 
+/// The first and last valid pixel in each row and column of a
+/// disparity tile. This is all that is needed to evaluate the
+/// centerline weights of the tile at any pixel, the same way as
+/// centerline_weights() does, without keeping the whole tile or its
+/// weights in memory.
+class CenterlineExtents {
+  std::vector<int> m_row_min, m_row_max, m_col_min, m_col_max;
+
+  // Weight along one line, 1 at the center of its valid pixels,
+  // decreasing linearly to 0 at the first and last valid pixel.
+  static double line_weight(int pos, int min_pos, int max_pos) {
+    double half_width = (max_pos - min_pos)/2.0;
+    if (half_width <= 0)
+      return 0.0;
+    double center = (max_pos + min_pos)/2.0;
+    return std::max(0.0, 1.0 - std::abs(pos - center)/half_width);
+  }
+
+public:
+
+  /// Scan the tile one strip of rows at a time.
+  void compute(DiskImageType const& tile, int strip_rows) {
+    int cols = tile.cols(), rows = tile.rows();
+    m_row_min.assign(rows, cols); m_row_max.assign(rows, -1);
+    m_col_min.assign(cols, rows); m_col_max.assign(cols, -1);
+
+    for (int beg_row = 0; beg_row < rows; beg_row += strip_rows) {
+      BBox2i strip_box(0, beg_row, cols, std::min(strip_rows, rows - beg_row));
+      DispImageType strip = crop(tile, strip_box);
+      for (int row = 0; row < strip.rows(); row++) {
+        int tile_row = beg_row + row;
+        for (int col = 0; col < cols; col++) {
+          if (!is_valid(strip(col, row)))
+            continue;
+          m_row_min[tile_row] = std::min(m_row_min[tile_row], col);
+          m_row_max[tile_row] = std::max(m_row_max[tile_row], col);
+          m_col_min[col]      = std::min(m_col_min[col], tile_row);
+          m_col_max[col]      = std::max(m_col_max[col], tile_row);
+        }
+      }
+    }
+  }
+
+  /// The weight at a given valid pixel of the tile.
+  double weight(int col, int row) const {
+    return line_weight(col, m_row_min[row], m_row_max[row])
+      *    line_weight(row, m_col_min[col], m_col_max[col]);
+  }
+};
+
 /// Load the desired portion of a disparity tile and associated image weights.
-bool load_image_and_weights(std::string const& file_path, BBox2i const& roi,
+/// Invalid pixels get a zero weight.
+bool load_image_and_weights(DiskImageType const& tile, CenterlineExtents const& extents,
+                            BBox2i const& roi,
                             DispImageType & image, WeightsType & weights) {
-  // Verify image exists
-  if (file_path == "")
+  if (roi.empty())
     return false;
-    
-  // Load the image from disk
-  DispImageType full_image = DiskImageType(file_path);
-  
-  // Compute the desired weights
-  centerline_weights(full_image, weights, roi);
-  
-  // Extract the desired portion of the full image
-  image = crop(full_image, roi);
-  
+
+  image = crop(tile, roi);
+  weights.set_size(image.cols(), image.rows());
+  for (int row = 0; row < image.rows(); row++) {
+    for (int col = 0; col < image.cols(); col++) {
+      if (is_valid(image(col, row)))
+        weights(col, row) = extents.weight(col + roi.min().x(), row + roi.min().y());
+      else
+        weights(col, row) = 0.0;
+    }
+  }
+
   return true;
 }
 
-/// Perform the blending of 
-void blend_tile_region(DispImageType      & main_image, WeightsType      & main_weights,     BBox2i const& main_roi,
-                       DispImageType const& neighbor,   WeightsType const& neighbor_weights, BBox2i const& neighbor_roi) {
-
-  // Multiply-accumulate the image values, then accumulate the weights.
-  crop(main_image,   main_roi) += neighbor * neighbor_weights;
-  crop(main_weights, main_roi) += neighbor_weights;
+/// Multiply-accumulate the values of a region of the image being blended
+/// and accumulate the weights. Only valid pixels with a positive weight
+/// contribute.
+void blend_tile_region(ImageView<Vector2> & sums,    WeightsType       & sum_weights,
+                       BBox2i const& sums_roi,
+                       DispImageType const& image,   WeightsType const& weights) {
+  for (int row = 0; row < image.rows(); row++) {
+    for (int col = 0; col < image.cols(); col++) {
+      double wt = weights(col, row);
+      if (!is_valid(image(col, row)) || wt <= 0)
+        continue;
+      int out_col = col + sums_roi.min().x(), out_row = row + sums_roi.min().y();
+      sums       (out_col, out_row) += wt*Vector2(image(col, row).child());
+      sum_weights(out_col, out_row) += wt;
+    }
+  }
 }
 
 struct BlendOptions {
@@ -315,103 +377,125 @@ void check_roi_bounds(BBox2i & input_roi, BBox2i & tile_roi, BBox2i const& outpu
 }
 
 
-/// Blend the borders of an input disparity tile using the adjacent disparity tiles.
-DispImageType
-tile_blend( DispImageType const& input_image,
-            BlendOptions const& opt) {
+/// Blend the borders of an input disparity tile using the adjacent
+/// disparity tiles. Each output block is produced from the matching
+/// part of the main tile and from the parts of the neighbor collars
+/// which overlap it, so only those are read from disk. The blend
+/// weights are evaluated as needed from the valid extents of each tile.
+class StreamingBlendView: public ImageViewBase<StreamingBlendView> {
+  DiskImageType     m_main_image;
+  CenterlineExtents m_main_extents;
+  BBox2i            m_output_bbox; // The main tile with the collar removed
+  boost::shared_ptr<DiskImageType> m_tiles  [NUM_NEIGHBORS];
+  CenterlineExtents                m_extents[NUM_NEIGHBORS];
+  BBox2i m_tile_rois [NUM_NEIGHBORS]; // ROIs in the neighbors
+  BBox2i m_input_rois[NUM_NEIGHBORS]; // ROIs in the output image
+
+public:
+  StreamingBlendView(BlendOptions const& opt, int strip_rows):
+    m_main_image(opt.main_path) {
+
+    // The amount of padding applied to each tile.
+    int buff_size = opt.sgm_collar_size;
+
+    const bool GET_BUFFER   = true;
+    const bool NOT_BUFFER   = false;
+    const bool BUFFERS_GONE = true;
+
+    // Retrieve the output bounding box in the input image
+    get_roi_from_tile(opt.main_path, M, buff_size, NOT_BUFFER, m_output_bbox);
+    m_main_extents.compute(m_main_image, strip_rows);
+
+    BBox2i output_image_bbox(0, 0, m_output_bbox.width(), m_output_bbox.height());
+    for (size_t i=0; i<NUM_NEIGHBORS; ++i) {
+      if (opt.tile_paths[i] == "")
+        continue;
 
-  const bool debug = false;
+      // Get the ROI from the cropped input image, then from the neighboring tile
+      get_roi_from_tile(opt.main_path, Position(i), buff_size, NOT_BUFFER,
+                        m_input_rois[i], BUFFERS_GONE);
+      get_roi_from_tile(opt.tile_paths[i], get_opposed_position(Position(i)),
+                        buff_size, GET_BUFFER, m_tile_rois[i]);
 
-  // The amount of padding applied to each tile.
-  int buff_size = opt.sgm_collar_size;
+      check_roi_bounds(m_input_rois[i], m_tile_rois[i], output_image_bbox);
 
-  const bool GET_BUFFER   = true;
-  const bool NOT_BUFFER   = false;
-  const bool BUFFERS_GONE = true;
+      VW_OUT(DebugMessage,"stereo")  << "For tile " << position_string(i) << ", tile roi = "
+                                     << m_tile_rois[i] << ", input_roi = " << m_input_rois[i]
+                                     << ", path = " << opt.tile_paths[i] << std::endl;
 
-  // Retrieve the output bounding box in the input image
-  BBox2i output_bbox;
-  get_roi_from_tile(opt.main_path, M, buff_size, NOT_BUFFER, output_bbox);
+      m_tiles[i] = boost::shared_ptr<DiskImageType>(new DiskImageType(opt.tile_paths[i]));
+      m_extents[i].compute(*m_tiles[i], strip_rows);
+    }
+  }
 
-  // The bbox of the input image and the bbox that will be written as
-  //  output (with the padding removed)
-  //BBox2i input_bbox  = bounding_box(input_image);  
-  //std::cout << "Input bbox = " << input_bbox << std::endl;
-  //std::cout << "Output bbox = " << output_bbox << std::endl;
+  // Image View interface
+  typedef PixelMask<Vector2f>                         pixel_type;
+  typedef pixel_type                                  result_type;
+  typedef ProceduralPixelAccessor<StreamingBlendView> pixel_accessor;
 
-  // Allocate the output image as a copy of the input image.
-  // - This sets the non-blended portion of the image.
-  DispImageType output_image = crop(input_image, output_bbox);
+  inline int32 cols  () const { return m_output_bbox.width(); }
+  inline int32 rows  () const { return m_output_bbox.height(); }
+  inline int32 planes() const { return 1; }
 
-  // Compute weights for the main tile
-  WeightsType main_weights;
-  centerline_weights(input_image, main_weights, output_bbox);
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
 
-  if (debug) {
-    write_image("main_image.tif", output_image);
-    write_image("main_weights.tif", main_weights);
+  inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "StreamingBlendView::operator()(...) is not implemented");
+    return pixel_type();
   }
 
-  // Load the neighboring eight tiles
-  //Vector2i      tile_sizes [NUM_NEIGHBORS];
-  BBox2i        tile_rois  [NUM_NEIGHBORS]; // ROIs in the neighbors
-  BBox2i        input_rois [NUM_NEIGHBORS]; // ROIs in the main image
-  DispImageType images     [NUM_NEIGHBORS]; // Contains cropped regions
-  WeightsType   weights    [NUM_NEIGHBORS]; // Contains cropped regions
-
-  // Figure out the ROIs, load images, and initialize output blend values.
-  for (size_t i=0; i<NUM_NEIGHBORS; ++i) {
-    if (opt.tile_paths[i] == "")
-      continue;
-
-    // Get the ROI from the cropped input image, then from the neighboring tile
-    get_roi_from_tile(opt.main_path, Position(i), buff_size, NOT_BUFFER, input_rois[i], BUFFERS_GONE);
-    get_roi_from_tile(opt.tile_paths[i], get_opposed_position(Position(i)), 
-                      buff_size, GET_BUFFER, tile_rois[i]);
-    
-    check_roi_bounds(input_rois[i], tile_rois[i], bounding_box(output_image));
-    
-    VW_OUT(DebugMessage,"stereo")  << "For tile " << position_string(i) << ", tile roi = " 
-                                   << tile_rois[i] << ", input_roi = " << input_rois[i] 
-                                   << ", path = " << opt.tile_paths[i] << std::endl;
-    
-    load_image_and_weights(opt.tile_paths[i], tile_rois[i], images[i], weights[i]);
-    
-    if (debug) {
-      write_image("tile_image_"+position_string(i)+".tif", images[i]);
-      write_image("tile_weights_"+position_string(i)+".tif", weights[i]);
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    // Load this block of the main tile. The output keeps its mask.
+    DispImageType output, image;
+    WeightsType   weights;
+    load_image_and_weights(m_main_image, m_main_extents, bbox + m_output_bbox.min(),
+                           output, weights);
+
+    ImageView<Vector2> sums(bbox.width(), bbox.height());
+    WeightsType        sum_weights(bbox.width(), bbox.height());
+    fill(sums, Vector2());
+    fill(sum_weights, 0.0);
+    blend_tile_region(sums, sum_weights, BBox2i(0, 0, bbox.width(), bbox.height()),
+                      output, weights);
+
+    // Blend in the parts of the neighbor collars which overlap this block.
+    for (size_t i=0; i<NUM_NEIGHBORS; ++i) {
+      if (m_tiles[i].get() == NULL)
+        continue;
+      BBox2i input_roi = m_input_rois[i];
+      input_roi.crop(bbox);
+      if (input_roi.empty())
+        continue;
+      BBox2i tile_roi = input_roi - m_input_rois[i].min() + m_tile_rois[i].min();
+      if (!load_image_and_weights(*m_tiles[i], m_extents[i], tile_roi, image, weights))
+        continue;
+      blend_tile_region(sums, sum_weights, input_roi - bbox.min(), image, weights);
     }
-  }
 
-  std::cout << "Premultiply...\n";
-
-//vw_throw( ArgumentErr() << "DEBUG!" );
+    // Normalize to account for the applied weighting. Pixels which
+    // got no weight keep the value of the main tile.
+    for (int row = 0; row < output.rows(); row++) {
+      for (int col = 0; col < output.cols(); col++) {
+        if (!is_valid(output(col, row)) || sum_weights(col, row) <= 0)
+          continue;
+        Vector2 val = sums(col, row)/sum_weights(col, row);
+        output(col, row).child() = Vector2f(val[0], val[1]);
+      }
+    }
 
-  //std::cout << "BBox output = " << bounding_box(output_image) << std::endl;
-  //std::cout << "BBox weights = " << bounding_box(main_weights) << std::endl;
-  
-  // Multiply the main image values by blend weights
-  output_image *= main_weights;
-  
-  std::cout << "Performing blending...\n";
-
-  // Blend in the neighbors one section at a time.
-  for (size_t i=0; i<NUM_NEIGHBORS; ++i) {
-    if (opt.tile_paths[i] == "")
-      continue;
-    std::cout << "Blending tile " << position_string(i) << std::endl;
-    // We discard the neighboring tile mask here because the weights will take 
-    //  care of those pixels and we don't want to OR in the mask of the neighbor.
-    blend_tile_region(output_image,             main_weights, input_rois[i],
-                      validate_mask(images[i]), weights[i],   tile_rois[i]);
+    return prerasterize_type(output, -bbox.min().x(), -bbox.min().y(), cols(), rows());
   }
 
-  std::cout << "Postmultiply...\n";
-  
-  // Normalize the main image values to account for the applied weighting.
-  output_image /= main_weights;
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
 
-  return output_image;
+StreamingBlendView tile_blend(BlendOptions const& opt, int strip_rows) {
+  return StreamingBlendView(opt, strip_rows);
 }
 
 
@@ -519,11 +603,9 @@ void stereo_blending( ASPGlobalOptions const& opt ) {
   // This tool is only intended to run as part of parallel_stereo, which
   //  renames the normal -D.tif file to -Dnosym.tif.
 
-  // Since this tool is only for follow-up processing of SGM results in
-  //  parallel_stereo, it can be safely assumed that the input images are small enough
-  //  to load entirely into memory.
-  DispImageType integer_disp;
-
+  // The tiles are not loaded in memory. The output is written block
+  //  by block, reading only the parts of the main tile and of the
+  //  neighbor collars which are needed for each block.
   try {
 
     // Verify that the input correlation file is float, indicating SGM processing.
@@ -532,7 +614,6 @@ void stereo_blending( ASPGlobalOptions const& opt ) {
     ChannelTypeEnum disp_data_type = rsrc->channel_type();
     if (disp_data_type == VW_CHANNEL_INT32)
       vw_throw( ArgumentErr() << "Error: stereo_blend should only be called after SGM correlation." );
-    integer_disp = DiskImageType(blend_options.main_path);
     
   } catch (IOErr const& e) {
     vw_throw( ArgumentErr() << "\nUnable to start at blending stage -- could not read input files.\n" 
@@ -544,7 +625,10 @@ void stereo_blending( ASPGlobalOptions const& opt ) {
   bool   has_nodata      = false;
   double nodata          = -32768.0;
 
-  DispImageType output = tile_blend(integer_disp, blend_options);
+  // The valid extents of the tiles, which determine the blend weights,
+  //  are found by scanning the tiles in strips as tall as an output block.
+  int strip_rows = opt.raster_tile_size[1];
+  StreamingBlendView output = tile_blend(blend_options, strip_rows);
 
   string rd_file = opt.out_prefix + "-RD.tif";
   vw_out() << "Writing: " << rd_file << "\n";
@@ -552,6 +636,8 @@ void stereo_blending( ASPGlobalOptions const& opt ) {
                                           has_left_georef, left_georef,
                                           has_nodata, nodata, opt,
                                           TerminalProgressCallback("asp", "\t--> Blending :") );
+
+  vw_out() << "Peak memory used by blending: " << asp::peak_memory_mb() << " MB.\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -20,6 +20,8 @@
 ///
 
 #include <vw/InterestPoint.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Image/AntiAliasing.h>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
 #include <vw/Stereo/CorrelationView.h>
@@ -28,6 +30,7 @@
 #include <asp/Tools/stereo.h>
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/ImagePyramid.h>
 #include <asp/Sessions/StereoSession.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
@@ -84,6 +87,176 @@ void read_search_range_from_dsub(ASPGlobalOptions & opt){
 
 
 
+typedef ImageView<PixelMask<PixelGray<float> > > MaskedSubImage;
+typedef ImageView<PixelMask<Vector2f> >            SubDispImage;
+
+/// Remove outliers from a low-resolution disparity the way D_sub is
+/// filtered, with either the threshold or the quantile method.
+SubDispImage filter_lowres_disparity(SubDispImage const& disp) {
+  if (stereo_settings().rm_quantile_multiple <= 0.0)
+    return rm_outliers_using_thresh(disp, 1, 1,
+                                    stereo_settings().rm_threshold*2.0/3.0,
+                                    (stereo_settings().rm_min_matches/100.0)*0.5/0.6);
+  return rm_outliers_using_quantiles(disp, stereo_settings().rm_quantile_percentile,
+                                     stereo_settings().rm_quantile_multiple);
+}
+
+/// Correlate one level of the low-resolution pyramid, using all threads.
+SubDispImage correlate_lowres_level(ASPGlobalOptions const& opt,
+                                    MaskedSubImage const& left, MaskedSubImage const& right,
+                                    BBox2i const& search_range, double blob_area) {
+
+  stereo::CostFunctionType cost_mode = get_cost_mode_value();
+  Vector2i kernel_size  = stereo_settings().corr_kernel;
+  int corr_timeout      = 5*stereo_settings().corr_timeout; // 5x, so try hard
+  ImageView<PixelGray<float> > left_img  = apply_mask(left,  PixelGray<float>(0)),
+                               right_img = apply_mask(right, PixelGray<float>(0));
+  ImageView<vw::uint8> left_mask  = channel_cast_rescale<uint8>(select_channel(left,  1)),
+                       right_mask = channel_cast_rescale<uint8>(select_channel(right, 1));
+  double seconds_per_op = 0.0;
+  if (corr_timeout > 0)
+    seconds_per_op = calc_seconds_per_op(cost_mode, left_img, right_img, kernel_size);
+
+  // If we can process the entire image in one tile, don't use a collar.
+  int collar_size = stereo_settings().sgm_collar_size;
+  if ((opt.raster_tile_size[0] > left.cols()) &&
+      (opt.raster_tile_size[1] > left.rows())   )
+    collar_size = 0;
+  // The quantile filter is not combined with blob filtering.
+  if (stereo_settings().rm_quantile_multiple > 0.0)
+    blob_area = 0;
+
+  SubDispImage disp =
+    block_rasterize(vw::stereo::pyramid_correlate(left_img, right_img, left_mask, right_mask,
+                                                  vw::stereo::PREFILTER_LOG, stereo_settings().slogW,
+                                                  search_range, kernel_size, cost_mode,
+                                                  corr_timeout, seconds_per_op,
+                                                  stereo_settings().xcorr_threshold,
+                                                  stereo_settings().corr_max_levels,
+                                                  static_cast<vw::stereo::CorrelationAlgorithm>
+                                                  (stereo_settings().stereo_algorithm),
+                                                  collar_size, blob_area, SAVE_CORR_DEBUG),
+                    opt.raster_tile_size, vw_settings().default_num_threads());
+  return filter_lowres_disparity(disp);
+}
+
+/// Find D_sub coarse-to-fine. L_sub and R_sub are halved up to
+/// num_levels times, reading the halved images from image pyramids if
+/// --image-pyramid-dir is set. The full search range is correlated at
+/// the coarsest level only, and each level's disparity gives the
+/// search range at the next finer one. D_sub is written from the finest
+/// result, and the time taken by each level is saved to
+/// D_sub-levels.txt. No D_sub_spread is written, as it would widen the
+/// search range of every full-resolution tile.
+void produce_lowres_disparity_pyramid(ASPGlobalOptions const& opt, BBox2i const& search_range,
+                                      double blob_area, int num_levels) {
+
+  // Grow the search range found at a coarser level by this many pixels,
+  // to make up for the disparity error at that level.
+  const int LEVEL_MARGIN = 4;
+  // Don't make levels much smaller than the correlation kernel.
+  const int MIN_LEVEL_SIZE = 8*std::max(stereo_settings().corr_kernel[0],
+                                        stereo_settings().corr_kernel[1]);
+
+  std::vector<MaskedSubImage> left_levels(1), right_levels(1);
+  std::string pyramid_dir = stereo_settings().image_pyramid_dir;
+  if (!pyramid_dir.empty()) {
+    // Read the levels from the pyramids of L_sub and R_sub, building
+    // them if missing, so that later runs need not make them again.
+    bool hash_contents = stereo_settings().image_pyramid_hash_contents;
+    ImagePyramid left_pyramid (opt.out_prefix+"-L_sub.tif", opt.out_prefix+"-lMask_sub.tif",
+                               pyramid_dir, 2*MIN_LEVEL_SIZE - 1, hash_contents, opt);
+    ImagePyramid right_pyramid(opt.out_prefix+"-R_sub.tif", opt.out_prefix+"-rMask_sub.tif",
+                               pyramid_dir, 2*MIN_LEVEL_SIZE - 1, hash_contents, opt);
+    left_levels[0]  = left_pyramid.masked_level(0);
+    right_levels[0] = right_pyramid.masked_level(0);
+    while (int(left_levels.size()) <= num_levels &&
+           int(left_levels.size()) < std::min(left_pyramid.num_levels(),
+                                              right_pyramid.num_levels()) &&
+           std::min(left_levels.back().cols(), left_levels.back().rows()) >= 2*MIN_LEVEL_SIZE) {
+      int level = left_levels.size();
+      left_levels.push_back(left_pyramid.masked_level(level));
+      right_levels.push_back(right_pyramid.masked_level(level));
+    }
+  }else{
+    left_levels[0]  = copy_mask(DiskImageView<PixelGray<float> >(opt.out_prefix+"-L_sub.tif"),
+                                create_mask(DiskImageView<uint8>(opt.out_prefix+"-lMask_sub.tif")));
+    right_levels[0] = copy_mask(DiskImageView<PixelGray<float> >(opt.out_prefix+"-R_sub.tif"),
+                                create_mask(DiskImageView<uint8>(opt.out_prefix+"-rMask_sub.tif")));
+  }
+  while (int(left_levels.size()) <= num_levels &&
+         std::min(left_levels.back().cols(), left_levels.back().rows()) >= 2*MIN_LEVEL_SIZE) {
+    MaskedSubImage left  = resample_aa(left_levels.back(),  0.5);
+    MaskedSubImage right = resample_aa(right_levels.back(), 0.5);
+    left_levels.push_back(left);
+    right_levels.push_back(right);
+  }
+  if (int(left_levels.size()) - 1 < num_levels)
+    vw_out(WarningMessage) << "Using " << left_levels.size() - 1
+                           << " low-resolution disparity levels instead of " << num_levels
+                           << ", as the coarser ones would be smaller than "
+                           << MIN_LEVEL_SIZE << " pixels.\n";
+
+  std::ostringstream timings;
+  timings << "# level cols rows search_range seconds\n";
+  SubDispImage disp;
+  BBox2i level_range;
+  for (int level = int(left_levels.size()) - 1; level >= 0; level--) {
+
+    Vector2 scale(double(left_levels[level].cols()) / left_levels[0].cols(),
+                  double(left_levels[level].rows()) / left_levels[0].rows());
+    BBox2i full_range(floor(elem_prod(scale, search_range.min())),
+                      ceil (elem_prod(scale, search_range.max())));
+
+    // Narrow the range to what was found at the coarser level
+    level_range = full_range;
+    if (disp.cols() > 0) {
+      BBox2f found = stereo::get_disparity_range(disp);
+      if (!found.empty()) {
+        Vector2 ratio(double(left_levels[level].cols()) / disp.cols(),
+                      double(left_levels[level].rows()) / disp.rows());
+        BBox2i narrow(floor(elem_prod(ratio, found.min())),
+                      ceil (elem_prod(ratio, found.max())));
+        narrow.expand(LEVEL_MARGIN);
+        narrow.crop(full_range);
+        if (!narrow.empty())
+          level_range = narrow;
+      }
+    }
+
+    Stopwatch sw;
+    sw.start();
+    disp = correlate_lowres_level(opt, left_levels[level], right_levels[level], level_range,
+                                  blob_area*scale[0]*scale[1]);
+    sw.stop();
+
+    vw_out() << "\t--> Low-resolution disparity level " << level << " ("
+             << disp.cols() << " x " << disp.rows() << "), search range "
+             << level_range << ": " << sw.elapsed_seconds() << " s\n";
+    timings << level << " " << disp.cols() << " " << disp.rows() << " "
+            << level_range.min().x() << " " << level_range.min().y() << " "
+            << level_range.max().x() << " " << level_range.max().y() << " "
+            << sw.elapsed_seconds() << "\n";
+  }
+
+  vw::cartography::block_write_gdal_image(opt.out_prefix + "-D_sub.tif", disp, opt,
+                                          TerminalProgressCallback("asp", "\t--> Low-resolution disparity:"));
+
+  // A D_sub_spread from an earlier run does not go with this D_sub,
+  // and would be used with it in seed mode 1.
+  std::string spread_file = opt.out_prefix + "-D_sub_spread.tif";
+  if (fs::exists(spread_file)) {
+    vw_out() << "\t--> Removing: " << spread_file << "\n";
+    fs::remove(spread_file);
+  }
+
+  std::string timing_file = opt.out_prefix + "-D_sub-levels.txt";
+  std::ofstream ofs(timing_file.c_str());
+  ofs << timings.str();
+  if (!ofs)
+    vw_out(WarningMessage) << "Could not write: " << timing_file << "\n";
+}
+
 /// Produces the low-resolution disparity file D_sub
 void produce_lowres_disparity( ASPGlobalOptions & opt ) {
 
@@ -116,6 +289,15 @@ void produce_lowres_disparity( ASPGlobalOptions & opt ) {
     search_range.max() += expansion;
     //VW_OUT(DebugMessage,"asp") << "D_sub search range: " << search_range << " px\n";
     std::cout << "D_sub search range: " << search_range << " px\n";
+
+    if (stereo_settings().lowres_corr_levels > 0) {
+      produce_lowres_disparity_pyramid(opt, search_range,
+                                       stereo_settings().corr_blob_filter_area*mean_scale,
+                                       stereo_settings().lowres_corr_levels);
+      read_search_range_from_dsub(opt);
+      return;
+    }
+
     stereo::CostFunctionType cost_mode = get_cost_mode_value();
     Vector2i kernel_size  = stereo_settings().corr_kernel;
     int corr_timeout      = 5*stereo_settings().corr_timeout; // 5x, so try hard
@@ -359,8 +541,20 @@ void lowres_correlation( ASPGlobalOptions & opt ) {
 
 
 
+/// Totals of the search volume, that is, the number of pixels times
+/// the number of disparities searched at each, summed over all tiles.
+/// The first is with one search range per tile, the second with the
+/// ranges of the sub-tiles actually correlated.
+struct SearchVolumeStats {
+  vw::Mutex mutex;
+  double    tile_volume, subtile_volume;
+  SearchVolumeStats(): tile_volume(0.0), subtile_volume(0.0){}
+};
+
 /// This correlator takes a low resolution disparity image as an input
 /// so that it may narrow its search range for each tile that is processed.
+/// A tile whose disparities vary a lot, such as one containing a cliff,
+/// is further split into sub-tiles, each searched with its own range.
 class SeededCorrelatorView : public ImageViewBase<SeededCorrelatorView> {
   DiskImageView<PixelGray<float> >   m_left_image;
   DiskImageView<PixelGray<float> >   m_right_image;
@@ -378,6 +572,9 @@ class SeededCorrelatorView : public ImageViewBase<SeededCorrelatorView> {
   int      m_corr_timeout;
   double   m_seconds_per_op;
 
+  // Shared among the copies of this view made for each thread
+  boost::shared_ptr<SearchVolumeStats> m_search_stats;
+
 public:
 
   // Set these input types here instead of making them template arguments
@@ -402,7 +599,8 @@ public:
     m_sub_disp(sub_disp.impl()), m_sub_disp_spread(sub_disp_spread.impl()),
     m_local_hom(local_hom),
     m_kernel_size(kernel_size),  m_cost_mode(cost_mode),
-    m_corr_timeout(corr_timeout), m_seconds_per_op(seconds_per_op){
+    m_corr_timeout(corr_timeout), m_seconds_per_op(seconds_per_op),
+    m_search_stats(new SearchVolumeStats){
     m_upscale_factor[0] = double(m_left_image.cols()) / m_sub_disp.cols();
     m_upscale_factor[1] = double(m_left_image.rows()) / m_sub_disp.rows();
     m_seed_bbox = bounding_box( m_sub_disp );
@@ -424,6 +622,151 @@ public:
     return pixel_type();
   }
 
+  SearchVolumeStats const& search_volume_stats() const { return *m_search_stats; }
+
+  /// The full-resolution search range for a region of the left image,
+  /// from the disparities in D_sub and D_sub_spread in the
+  /// corresponding low-resolution region.
+  BBox2f seeded_search_range(BBox2i const& bbox, Matrix<double> const& lowres_hom) const {
+
+    bool use_local_homography = stereo_settings().use_local_homography;
+    bool do_round = true; // round integer disparities after transform
+
+    // The low-res version of bbox
+    BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
+                      elem_quot(bbox.max(), m_upscale_factor) );
+    seed_bbox.expand(1);
+    seed_bbox.crop( m_seed_bbox );
+    // Get the disparity range in d_sub corresponding to this tile.
+    VW_OUT(DebugMessage, "stereo") << "Getting disparity range for : " << seed_bbox << "\n";
+    DispSeedImageType disparity_in_box = crop( m_sub_disp, seed_bbox );
+
+    BBox2f local_search_range;
+    if (!use_local_homography){
+      local_search_range = stereo::get_disparity_range( disparity_in_box );
+    }else{
+      local_search_range = stereo::get_disparity_range
+        (transform_disparities(do_round, seed_bbox,
+                               lowres_hom, disparity_in_box));
+    }
+
+    bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 &&
+                                 m_sub_disp_spread.rows() != 0 );
+    // Sanity check: If m_sub_disp_spread was provided, it better have the same size as sub_disp.
+    if ( has_sub_disp_spread &&
+         m_sub_disp_spread.cols() != m_sub_disp.cols() &&
+         m_sub_disp_spread.rows() != m_sub_disp.rows() ){
+      vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
+    }
+
+    if (has_sub_disp_spread){
+      // Expand the disparity range by m_sub_disp_spread.
+      SpreadImageType spread_in_box = crop( m_sub_disp_spread, seed_bbox );
+
+      if (!use_local_homography){
+        BBox2f spread = stereo::get_disparity_range( spread_in_box );
+        local_search_range.min() -= spread.max();
+        local_search_range.max() += spread.max();
+      }else{
+        DispSeedImageType upper_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                                             disparity_in_box + spread_in_box);
+        DispSeedImageType lower_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                                             disparity_in_box - spread_in_box);
+        BBox2f upper_range = stereo::get_disparity_range(upper_disp);
+        BBox2f lower_range = stereo::get_disparity_range(lower_disp);
+
+        local_search_range = upper_range;
+        local_search_range.grow(lower_range);
+      } //endif use_local_homography
+    } //endif has_sub_disp_spread
+
+    local_search_range = grow_bbox_to_int(local_search_range);
+    // Expand local_search_range by 1. This is necessary since
+    // m_sub_disp is integer-valued, and perhaps the search
+    // range was supposed to be a fraction of integer bigger.
+    local_search_range.expand(1);
+
+    // Scale the search range to full-resolution
+    local_search_range.min() = floor(elem_prod(local_search_range.min(),m_upscale_factor));
+    local_search_range.max() = ceil (elem_prod(local_search_range.max(),m_upscale_factor));
+
+    return local_search_range;
+  }
+
+  /// The number of pixels in a region times the number of disparities
+  /// searched at each. Correlation time is roughly proportional to it.
+  static double search_volume(BBox2i const& bbox, BBox2f const& search_range) {
+    return double(bbox.width())*double(bbox.height())
+      * (search_range.width() + 1.0)*(search_range.height() + 1.0);
+  }
+
+  /// Split a region in halves along each dimension that is at least
+  /// twice min_size, if the halves together need a search volume
+  /// sufficiently smaller than the region. Recurse into the halves.
+  /// Each sub-region has a collar correlated with it, so small gains
+  /// are not worth the overhead.
+  void subdivide_search(BBox2i const& bbox, BBox2f const& search_range,
+                        Matrix<double> const& lowres_hom, int min_size,
+                        std::vector<BBox2i> & regions,
+                        std::vector<BBox2f> & search_ranges) const {
+
+    const double MIN_GAIN = 0.75;
+
+    std::vector<int> xcuts, ycuts;
+    xcuts.push_back(bbox.min().x());
+    if (bbox.width() >= 2*min_size)
+      xcuts.push_back(bbox.min().x() + bbox.width()/2);
+    xcuts.push_back(bbox.max().x());
+    ycuts.push_back(bbox.min().y());
+    if (bbox.height() >= 2*min_size)
+      ycuts.push_back(bbox.min().y() + bbox.height()/2);
+    ycuts.push_back(bbox.max().y());
+
+    std::vector<BBox2i> sub_boxes;
+    std::vector<BBox2f> sub_ranges;
+    double sub_volume = 0.0;
+    for (size_t i = 0; i + 1 < xcuts.size(); i++) {
+      for (size_t j = 0; j + 1 < ycuts.size(); j++) {
+        BBox2i sub_box(Vector2i(xcuts[i], ycuts[j]), Vector2i(xcuts[i+1], ycuts[j+1]));
+        BBox2f sub_range = seeded_search_range(sub_box, lowres_hom);
+        sub_boxes.push_back(sub_box);
+        sub_ranges.push_back(sub_range);
+        sub_volume += search_volume(sub_box, sub_range);
+      }
+    }
+
+    if (sub_boxes.size() == 1 || sub_volume >= MIN_GAIN*search_volume(bbox, search_range)) {
+      regions.push_back(bbox);
+      search_ranges.push_back(search_range);
+      return;
+    }
+
+    for (size_t it = 0; it < sub_boxes.size(); it++)
+      subdivide_search(sub_boxes[it], sub_ranges[it], lowres_hom, min_size,
+                       regions, search_ranges);
+  }
+
+  /// Correlate a region of the left image against the given right image.
+  template <class RImageT, class RMaskT>
+  ImageView<pixel_type> correlate(RImageT const& right_image, RMaskT const& right_mask,
+                                  BBox2i const& bbox, BBox2f const& search_range) const {
+    typedef vw::stereo::PyramidCorrelationView<ImageType, RImageT, MaskType, RMaskT> CorrView;
+    CorrView corr_view( m_left_image,   right_image,
+                        m_left_mask,    right_mask,
+                        static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode),
+                        stereo_settings().slogW,
+                        search_range,
+                        m_kernel_size,  m_cost_mode,
+                        m_corr_timeout, m_seconds_per_op,
+                        stereo_settings().xcorr_threshold,
+                        stereo_settings().corr_max_levels,
+                        static_cast<vw::stereo::CorrelationAlgorithm>(stereo_settings().stereo_algorithm),
+                        stereo_settings().sgm_collar_size,
+                        stereo_settings().corr_blob_filter_area,
+                        SAVE_CORR_DEBUG );
+    return crop(corr_view.prerasterize(bbox), bbox);
+  }
+
   /// Does the work
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
@@ -435,60 +778,47 @@ public:
     ImageViewRef<InputPixelType> right_trans_img;
     ImageViewRef<vw::uint8     > right_trans_mask;
 
-    bool do_round = true; // round integer disparities after transform
+    // The regions of this tile to correlate, each with its own search range
+    std::vector<BBox2i> regions;
+    std::vector<BBox2f> search_ranges;
 
     // User strategies
-    BBox2f local_search_range;
     if ( stereo_settings().seed_mode > 0 ) {
 
-      // The low-res version of bbox
-      BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
-			                  elem_quot(bbox.max(), m_upscale_factor) );
-      seed_bbox.expand(1);
-      seed_bbox.crop( m_seed_bbox );
-      // Get the disparity range in d_sub corresponding to this tile.
-      VW_OUT(DebugMessage, "stereo") << "Getting disparity range for : " << seed_bbox << "\n";
-      DispSeedImageType disparity_in_box = crop( m_sub_disp, seed_bbox );
-
-      if (!use_local_homography){
-        local_search_range = stereo::get_disparity_range( disparity_in_box );
-      }else{ // seed_mode == 0
+      if (use_local_homography){
         int ts = ASPGlobalOptions::corr_tile_size();
         lowres_hom = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
-        local_search_range = stereo::get_disparity_range
-          (transform_disparities(do_round, seed_bbox,
-			     lowres_hom, disparity_in_box));
       }
 
-      bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 &&
-			                             m_sub_disp_spread.rows() != 0 );
-      // Sanity check: If m_sub_disp_spread was provided, it better have the same size as sub_disp.
-      if ( has_sub_disp_spread &&
-           m_sub_disp_spread.cols() != m_sub_disp.cols() &&
-           m_sub_disp_spread.rows() != m_sub_disp.rows() ){
-        vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
+      BBox2f local_search_range = seeded_search_range(bbox, lowres_hom);
+
+      VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
+                                     << bbox << ") search range "
+                                     << local_search_range << " vs "
+                                     << stereo_settings().search_range << "\n";
+
+      int min_size = stereo_settings().corr_subtile_min_size;
+      if (min_size > 0) {
+        subdivide_search(bbox, local_search_range, lowres_hom, min_size,
+                         regions, search_ranges);
+      }else{
+        regions.push_back(bbox);
+        search_ranges.push_back(local_search_range);
       }
 
-      if (has_sub_disp_spread){
-        // Expand the disparity range by m_sub_disp_spread.
-        SpreadImageType spread_in_box = crop( m_sub_disp_spread, seed_bbox );
-
-        if (!use_local_homography){
-          BBox2f spread = stereo::get_disparity_range( spread_in_box );
-          local_search_range.min() -= spread.max();
-          local_search_range.max() += spread.max();
-        }else{
-          DispSeedImageType upper_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                                               disparity_in_box + spread_in_box);
-          DispSeedImageType lower_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                                               disparity_in_box - spread_in_box);
-          BBox2f upper_range = stereo::get_disparity_range(upper_disp);
-          BBox2f lower_range = stereo::get_disparity_range(lower_disp);
-
-          local_search_range = upper_range;
-          local_search_range.grow(lower_range);
-        } //endif use_local_homography
-      } //endif has_sub_disp_spread
+      double tile_volume = search_volume(bbox, local_search_range), subtile_volume = 0.0;
+      for (size_t it = 0; it < regions.size(); it++)
+        subtile_volume += search_volume(regions[it], search_ranges[it]);
+      if (regions.size() > 1)
+        VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView(" << bbox << ") split into "
+                                       << regions.size() << " sub-tiles, with "
+                                       << 100.0*subtile_volume/tile_volume
+                                       << "% of the search volume.\n";
+      {
+        Mutex::Lock lock(m_search_stats->mutex);
+        m_search_stats->tile_volume    += tile_volume;
+        m_search_stats->subtile_volume += subtile_volume;
+      }
 
       if (use_local_homography){
         Vector3 upscale(     m_upscale_factor[0],     m_upscale_factor[1], 1 );
@@ -498,70 +828,34 @@ public:
         ImageViewRef< PixelMask<InputPixelType> >
           right_trans_masked_img
           = transform (copy_mask( m_right_image.impl(),
-			          create_mask(m_right_mask.impl()) ),
-	               HomographyTransform(fullres_hom),
-	               m_left_image.impl().cols(), m_left_image.impl().rows());
+                                  create_mask(m_right_mask.impl()) ),
+                       HomographyTransform(fullres_hom),
+                       m_left_image.impl().cols(), m_left_image.impl().rows());
         right_trans_img  = apply_mask(right_trans_masked_img);
         right_trans_mask = channel_cast_rescale<uint8>(select_channel(right_trans_masked_img, 1));
       } //endif use_local_homography
 
-      local_search_range = grow_bbox_to_int(local_search_range);
-      // Expand local_search_range by 1. This is necessary since
-      // m_sub_disp is integer-valued, and perhaps the search
-      // range was supposed to be a fraction of integer bigger.
-      local_search_range.expand(1);
-      
-      // Scale the search range to full-resolution
-      local_search_range.min() = floor(elem_prod(local_search_range.min(),m_upscale_factor));
-      local_search_range.max() = ceil (elem_prod(local_search_range.max(),m_upscale_factor));
-
-      VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
-				     << bbox << ") search range "
-				     << local_search_range << " vs "
-				     << stereo_settings().search_range << "\n";
-
     } else{
-      local_search_range = stereo_settings().search_range;
+      regions.push_back(bbox);
+      search_ranges.push_back(stereo_settings().search_range);
       VW_OUT(DebugMessage,"stereo") << "Searching with "
-				    << stereo_settings().search_range << "\n";
+                                    << stereo_settings().search_range << "\n";
     }
 
-    // Now we are ready to actually perform correlation
-    if (use_local_homography){
-      typedef vw::stereo::PyramidCorrelationView<ImageType, ImageViewRef<InputPixelType>, 
-                                                 MaskType,  ImageViewRef<vw::uint8     > > CorrView;
-      CorrView corr_view( m_left_image,   right_trans_img,
-                          m_left_mask,    right_trans_mask,
-                          static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode),
-                          stereo_settings().slogW,
-                          local_search_range,
-                          m_kernel_size,  m_cost_mode,
-                          m_corr_timeout, m_seconds_per_op,
-                          stereo_settings().xcorr_threshold,
-                          stereo_settings().corr_max_levels,
-                          static_cast<vw::stereo::CorrelationAlgorithm>(stereo_settings().stereo_algorithm), 
-                          stereo_settings().sgm_collar_size,
-                          stereo_settings().corr_blob_filter_area,
-                          SAVE_CORR_DEBUG );
-      return corr_view.prerasterize(bbox);
-    }else{
-      typedef vw::stereo::PyramidCorrelationView<ImageType, ImageType, MaskType, MaskType > CorrView;
-      CorrView corr_view( m_left_image,   m_right_image,
-                          m_left_mask,    m_right_mask,
-                          static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode),
-                          stereo_settings().slogW,
-                          local_search_range,
-                          m_kernel_size,  m_cost_mode,
-                          m_corr_timeout, m_seconds_per_op,
-                          stereo_settings().xcorr_threshold,
-                          stereo_settings().corr_max_levels,
-                          static_cast<vw::stereo::CorrelationAlgorithm>(stereo_settings().stereo_algorithm), 
-                          stereo_settings().sgm_collar_size,
-                          stereo_settings().corr_blob_filter_area,
-                          SAVE_CORR_DEBUG );
-      return corr_view.prerasterize(bbox);
+    // Now we are ready to actually perform correlation, and put
+    // together the results for the sub-tiles.
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    for (size_t it = 0; it < regions.size(); it++) {
+      BBox2i region = regions[it] - bbox.min();
+      if (use_local_homography)
+        crop(tile, region) = correlate(right_trans_img, right_trans_mask,
+                                       regions[it], search_ranges[it]);
+      else
+        crop(tile, region) = correlate(m_right_image, m_right_mask,
+                                       regions[it], search_ranges[it]);
     }
-    
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
   } // End function prerasterize_helper
 
   template <class DestT>
@@ -643,11 +937,10 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
 
   // Set up the reference to the stereo disparity code
   // - Processing is limited to trans_crop_win for use with parallel_stereo.
-  ImageViewRef<PixelMask<Vector2f> > fullres_disparity =
-    crop(SeededCorrelatorView( left_disk_image, right_disk_image, Lmask, Rmask,
-                               sub_disp, sub_disp_spread, local_hom, kernel_size, 
-                               cost_mode, corr_timeout, seconds_per_op ), 
-         trans_crop_win);
+  SeededCorrelatorView corr_view( left_disk_image, right_disk_image, Lmask, Rmask,
+                                  sub_disp, sub_disp_spread, local_hom, kernel_size,
+                                  cost_mode, corr_timeout, seconds_per_op );
+  ImageViewRef<PixelMask<Vector2f> > fullres_disparity = crop(corr_view, trans_crop_win);
   
   switch(stereo_settings().pre_filter_mode){
   case 2:
@@ -684,6 +977,12 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
 			        TerminalProgressCallback("asp", "\t--> Correlation :") );
   }
 
+  SearchVolumeStats const& stats = corr_view.search_volume_stats();
+  if (stereo_settings().corr_subtile_min_size > 0 && stats.tile_volume > 0)
+    vw_out() << "\t--> Search volume with sub-tile ranges is "
+             << 100.0*stats.subtile_volume/stats.tile_volume
+             << "% of the one with a range per tile.\n";
+
   vw_out() << "\n[ " << current_posix_time_string() << " ] : CORRELATION FINISHED \n";
 
 } // End function stereo_correlation
@@ -716,7 +1015,10 @@ int main(int argc, char* argv[]) {
 
     // Internal Processes
     //---------------------------------------------------------
-    stereo_correlation( opt );
+    if (stereo_settings().tile_worker)
+      asp::run_tile_worker(opt, stereo_correlation);
+    else
+      stereo_correlation( opt );
   
     xercesc::XMLPlatformUtils::Terminate();
   } ASP_STANDARD_CATCHES;
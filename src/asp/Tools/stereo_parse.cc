@@ -120,6 +120,7 @@ int main( int argc, char* argv[] ) {
     vw_out() << "corr_tile_size," << stereo_settings().corr_tile_size_ovr << endl;
     vw_out() << "rfne_tile_size," << ASPGlobalOptions::rfne_tile_size() << endl;
     vw_out() << "tri_tile_size,"  << ASPGlobalOptions::tri_tile_size()  << endl;
+    vw_out() << "use_local_homography," << stereo_settings().use_local_homography << endl;
 
     vw_out() << "stereo_algorithm," << stereo_settings().stereo_algorithm << endl;
     if (stereo_settings().stereo_algorithm == 0)
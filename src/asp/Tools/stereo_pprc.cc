@@ -26,6 +26,7 @@
 #include <vw/Math/Functors.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/ImagePyramid.h>
 #include <asp/Sessions/ResourceLoader.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -57,6 +58,172 @@ inline mask_above_threshold( ImageViewBase<ImageT> const& image, double threshol
                                                         MaskAboveThreshold(threshold) );
 }
 
+// Resample an image to the given scale, starting from the coarsest
+// level of its pyramid which is at least as fine. The remaining
+// ratio is in (0.5, 1], so plain interpolation is good enough.
+ImageView< PixelMask < PixelGray<float> > >
+subsample_from_pyramid(ImagePyramid const& pyramid, double scale,
+                       Vector2 const& tile_size, uint32 num_threads){
+  int level = pyramid.level_for_scale(scale);
+  vw_out() << "\t--> Subsampling from pyramid level " << level << ".\n";
+  return block_rasterize(resample(pyramid.masked_level(level),
+                                  scale/pyramid.level_scale(level)),
+                         tile_size, num_threads);
+}
+
+/// Sums of the valid pixels of an image over the pixels of a
+/// subsampled image, found one tile at a time. Each pixel of the image
+/// is added to the subsampled pixel containing it, so the result is a
+/// box-filtered version of the image. A disabled accumulator ignores
+/// what is added to it.
+///
+/// The size and the sampling phase are those of resample(): the
+/// subsampled image has int(0.5 + size*scale) columns and rows, and
+/// its pixel i is centered at i/scale in the image, so pixel c of the
+/// image goes to the subsampled pixel nearest to c*scale.
+class SubsampleAccumulator {
+  Vector2i m_full_size, m_sub_size;
+  double m_scale;
+  std::vector<double> m_sums, m_counts;
+  boost::int64_t m_num_added;
+  bool m_enabled;
+  Mutex m_mutex;
+
+  /// The subsampled column or row having the given column or row of the image.
+  int sub_index(int full_index, int dim) const {
+    int sub = int(floor(full_index*m_scale + 0.5));
+    return std::max(0, std::min(sub, m_sub_size[dim] - 1));
+  }
+
+public:
+  SubsampleAccumulator(Vector2i const& full_size, double scale, bool enabled):
+    m_full_size(full_size), m_scale(scale), m_num_added(0), m_enabled(enabled){
+    m_sub_size = Vector2i(std::max(1, int(0.5 + full_size.x()*scale)),
+                          std::max(1, int(0.5 + full_size.y()*scale)));
+    if (!m_enabled)
+      return;
+    m_sums.resize(size_t(m_sub_size.x())*m_sub_size.y(), 0.0);
+    m_counts.resize(m_sums.size(), 0.0);
+  }
+
+  bool enabled() const { return m_enabled; }
+
+  /// Add a tile of the image and of its mask, having the given bounding box.
+  void add(BBox2i const& bbox, ImageView< PixelGray<float> > const& img,
+           ImageView< PixelMask<uint8> > const& mask){
+
+    if (!m_enabled)
+      return;
+
+    // The subsampled pixel each column and row of the tile goes to,
+    // relative to the first one.
+    int sub_col0 = sub_index(bbox.min().x(), 0);
+    int sub_row0 = sub_index(bbox.min().y(), 1);
+    int num_sub_cols = sub_index(bbox.max().x() - 1, 0) - sub_col0 + 1;
+    int num_sub_rows = sub_index(bbox.max().y() - 1, 1) - sub_row0 + 1;
+    std::vector<int> sub_col(bbox.width());
+    for (int col = 0; col < bbox.width(); col++)
+      sub_col[col] = sub_index(bbox.min().x() + col, 0) - sub_col0;
+
+    // Accumulate locally, row by row, without branching on validity
+    std::vector<double> sums  (size_t(num_sub_cols)*num_sub_rows, 0.0);
+    std::vector<double> counts(sums.size(), 0.0);
+    for (int row = 0; row < bbox.height(); row++) {
+      int sub_row = sub_index(bbox.min().y() + row, 1) - sub_row0;
+      double * sum_row   = &sums  [size_t(sub_row)*num_sub_cols];
+      double * count_row = &counts[size_t(sub_row)*num_sub_cols];
+      const PixelGray<float> * img_row  = img.data()  + size_t(row)*img.cols();
+      const PixelMask<uint8> * mask_row = mask.data() + size_t(row)*mask.cols();
+      for (int col = 0; col < bbox.width(); col++) {
+        bool valid = is_valid(mask_row[col]);
+        float val  = valid ? img_row[col].v() : 0.0f;
+        sum_row  [sub_col[col]] += val;
+        count_row[sub_col[col]] += valid;
+      }
+    }
+
+    Mutex::Lock lock(m_mutex);
+    for (int row = 0; row < num_sub_rows; row++) {
+      for (int col = 0; col < num_sub_cols; col++) {
+        size_t index = size_t(sub_row0 + row)*m_sub_size.x() + sub_col0 + col;
+        m_sums  [index] += sums  [size_t(row)*num_sub_cols + col];
+        m_counts[index] += counts[size_t(row)*num_sub_cols + col];
+      }
+    }
+    m_num_added += boost::int64_t(bbox.width())*bbox.height();
+  }
+
+  /// True if each pixel of the image was added exactly once.
+  bool complete() const {
+    return m_enabled && m_num_added == boost::int64_t(m_full_size.x())*m_full_size.y();
+  }
+
+  ImageView< PixelMask < PixelGray<float> > > result() const {
+    ImageView< PixelMask < PixelGray<float> > > sub(m_sub_size.x(), m_sub_size.y());
+    for (int row = 0; row < sub.rows(); row++) {
+      for (int col = 0; col < sub.cols(); col++) {
+        size_t index = size_t(row)*sub.cols() + col;
+        if (m_counts[index] > 0)
+          sub(col, row) = PixelGray<float>(m_sums[index]/m_counts[index]);
+        else
+          sub(col, row).invalidate();
+      }
+    }
+    return sub;
+  }
+};
+
+/// Pass through a mask, while adding each tile of it, together with
+/// the same tile of the image, to a SubsampleAccumulator. Writing the
+/// mask then also creates the subsampled image, without reading the
+/// image and the mask a second time.
+template <class ImageT, class MaskT>
+class MaskAndSubsampleView: public ImageViewBase< MaskAndSubsampleView<ImageT, MaskT> > {
+  ImageT m_image;
+  MaskT  m_mask;
+  SubsampleAccumulator & m_accum;
+public:
+  typedef PixelMask<uint8> pixel_type;
+  typedef pixel_type       result_type;
+  typedef ProceduralPixelAccessor<MaskAndSubsampleView> pixel_accessor;
+
+  MaskAndSubsampleView(ImageT const& image, MaskT const& mask, SubsampleAccumulator & accum):
+    m_image(image), m_mask(mask), m_accum(accum){}
+
+  inline int32 cols  () const { return m_mask.cols(); }
+  inline int32 rows  () const { return m_mask.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  inline pixel_type operator()(double/*i*/, double/*j*/, int32/*p*/ = 0) const {
+    vw_throw(NoImplErr() << "MaskAndSubsampleView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  typedef CropView< ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+    ImageView<pixel_type> mask_tile = crop(m_mask, bbox);
+    if (m_accum.enabled()) {
+      ImageView< PixelGray<float> > img_tile = crop(m_image, bbox);
+      m_accum.add(bbox, img_tile, mask_tile);
+    }
+    return prerasterize_type(mask_tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+template <class ImageT, class MaskT>
+MaskAndSubsampleView<ImageT, MaskT>
+mask_and_subsample(ImageViewBase<ImageT> const& image, ImageViewBase<MaskT> const& mask,
+                   SubsampleAccumulator & accum){
+  return MaskAndSubsampleView<ImageT, MaskT>(image.impl(), mask.impl(), accum);
+}
+
 struct BlobHolder {
   // This object will ensure that the current BlobIndexThreaded object
   // is not de-allocated while still being used to fill holes in a
@@ -191,7 +358,23 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
   bool has_nodata = true;
   float output_nodata = -32768.0;
 
-
+  // The scale of the subsampled images, used later for auto search
+  // range detection.
+  double s = 1500.0;
+  float sub_scale = sqrt(s * s / (float(left_image.cols ()) * float(left_image.rows ())))
+                  + sqrt(s * s / (float(right_image.cols()) * float(right_image.rows())));
+  sub_scale /= 2;
+  if ( sub_scale > 0.6 ) // ???
+    sub_scale = 0.6;
+
+  // If asked, when the masks are written, the subsampled images are
+  // found in the same pass.
+  bool subsample_with_masks = stereo_settings().subsample_with_masks;
+  SubsampleAccumulator left_sub_accum (Vector2i(left_image.cols(),  left_image.rows()),
+                                       sub_scale, subsample_with_masks);
+  SubsampleAccumulator right_sub_accum(Vector2i(right_image.cols(), right_image.rows()),
+                                       sub_scale, subsample_with_masks);
+  bool masks_rebuilt = rebuild;
 
   if (!rebuild) {
     vw_out() << "\t--> Using cached masks.\n";
@@ -301,13 +484,17 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
               );
 
       vw::cartography::block_write_gdal_image(left_mask_file,
-                                  apply_mask(intersect_mask(left_mask, warped_right_mask)),
+                                  apply_mask(mask_and_subsample(left_image,
+                                                                intersect_mask(left_mask, warped_right_mask),
+                                                                left_sub_accum)),
                                   has_left_georef, left_georef,
                                   has_nodata, output_nodata,
                                   opt, TerminalProgressCallback("asp", "\t    Mask L: ")
                                   );
       vw::cartography::block_write_gdal_image(right_mask_file,
-                                  apply_mask(intersect_mask(right_mask, warped_left_mask)),
+                                  apply_mask(mask_and_subsample(right_image,
+                                                                intersect_mask(right_mask, warped_left_mask),
+                                                                right_sub_accum)),
                                   has_right_georef, right_georef,
                                   has_nodata, output_nodata,
                                   opt, TerminalProgressCallback("asp", "\t    Mask R: ")
@@ -317,11 +504,15 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
       // TODO: Even so, the trick above with intersecting the masks will still work,
       // if the images are map-projected (such as with cam2map-ed cubes),
       // but this would require careful research.
-      vw::cartography::block_write_gdal_image( left_mask_file, apply_mask(left_mask),
+      vw::cartography::block_write_gdal_image( left_mask_file,
+                                   apply_mask(mask_and_subsample(left_image, left_mask,
+                                                                 left_sub_accum)),
                                    has_left_georef, left_georef,
                                    has_nodata, output_nodata,
                                    opt, TerminalProgressCallback("asp", "\t Mask L: ") );
-      vw::cartography::block_write_gdal_image( right_mask_file, apply_mask(right_mask),
+      vw::cartography::block_write_gdal_image( right_mask_file,
+                                   apply_mask(mask_and_subsample(right_image, right_mask,
+                                                                 right_sub_accum)),
                                    has_right_georef, right_georef,
                                    has_nodata, output_nodata,
                                    opt, TerminalProgressCallback("asp", "\t Mask R: ") );
@@ -339,36 +530,50 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
   string lmsub = opt.out_prefix+"-lMask_sub.tif";
   string rmsub = opt.out_prefix+"-rMask_sub.tif";
 
+  std::string pyramid_dir = stereo_settings().image_pyramid_dir;
+  bool use_pyramid = (!pyramid_dir.empty() &&
+                      fs::path(left_image_file ).extension() == ".tif" &&
+                      fs::path(right_image_file).extension() == ".tif");
+
+  // Below we use ImageView instead of ImageViewRef as the output
+  // images are small.  Using an ImageViewRef would make the
+  // subsampling operations happen twice, once for L_sub.tif and
+  // second time for lMask_sub.tif.
+  ImageView< PixelMask < PixelGray<float> > > left_sub_image, right_sub_image;
+  bool have_sub_images = false;
+  if (masks_rebuilt && !use_pyramid &&
+      left_sub_accum.complete() && right_sub_accum.complete()) {
+    // Found while writing the masks. Use them, as the masks changed.
+    vw_out() << "\t--> Creating previews. Subsampled by " << sub_scale
+             << " while writing the masks.\n";
+    left_sub_image  = left_sub_accum.result();
+    right_sub_image = right_sub_accum.result();
+    have_sub_images = true;
+  }
+
   // We must always redo the subsampling if we are allowed to crop the images
-  rebuild = crop_left || crop_right;
+  rebuild = crop_left || crop_right || have_sub_images;
 
-  try {
-    // First try to see if the subsampled images exist.
-    if (!fs::exists(lsub)  || !fs::exists(rsub) ||
-        !fs::exists(lmsub) || !fs::exists(rmsub)){
+  if (!rebuild) {
+    try {
+      // First try to see if the subsampled images exist.
+      if (!fs::exists(lsub)  || !fs::exists(rsub) ||
+          !fs::exists(lmsub) || !fs::exists(rmsub)){
+        rebuild = true;
+      }else{
+        // This confusing try catch is to see if the subsampled images actually have content.
+        DiskImageView<PixelGray<float> > testl (lsub );
+        DiskImageView<PixelGray<float> > testr (rsub );
+        DiskImageView<uint8>             testlm(lmsub);
+        DiskImageView<uint8>             testrm(rmsub);
+        vw_out() << "\t--> Using cached subsampled images.\n";
+      }
+    } catch (vw::Exception const& e) {
       rebuild = true;
-    }else{
-      // This confusing try catch is to see if the subsampled images actually have content.
-      DiskImageView<PixelGray<float> > testl (lsub );
-      DiskImageView<PixelGray<float> > testr (rsub );
-      DiskImageView<uint8>             testlm(lmsub);
-      DiskImageView<uint8>             testrm(rmsub);
-      vw_out() << "\t--> Using cached subsampled images.\n";
     }
-  } catch (vw::Exception const& e) {
-    rebuild = true;
   }
 
-  if (rebuild) {
-    // Produce subsampled images, these will be used later for auto
-    // search range detection.
-    double s = 1500.0;
-    float sub_scale = sqrt(s * s / (float(left_image.cols ()) * float(left_image.rows ())))
-                    + sqrt(s * s / (float(right_image.cols()) * float(right_image.rows())));
-    sub_scale /= 2;
-    if ( sub_scale > 0.6 ) // ???
-      sub_scale = 0.6;
-
+  if (rebuild && !have_sub_images) {
     // Solving for the number of threads and the tile size to use for
     // subsampling while only using 500 MiB of memory. (The cache code
     // is a little slow on releasing so it will probably use 1.5GiB
@@ -392,12 +597,19 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
     // resampling the images to interpolate correctly around invalid pixels.
 
     DiskImageView<uint8> left_mask(left_mask_file), right_mask(right_mask_file);
-    // Below we use ImageView instead of ImageViewRef as the output
-    // images are small.  Using an ImageViewRef would make the
-    // subsampling operations happen twice, once for L_sub.tif and
-    // second time for lMask_sub.tif.
-    ImageView< PixelMask < PixelGray<float> > > left_sub_image, right_sub_image;
-    if ( sub_scale > 0.5 ) {
+    if (use_pyramid) {
+      // Build or reuse the pyramids, which other tools can read as well
+      const int min_pyramid_size = 256;
+      bool hash_contents = stereo_settings().image_pyramid_hash_contents;
+      ImagePyramid left_pyramid (left_image_file,  left_mask_file,  pyramid_dir,
+                                 min_pyramid_size, hash_contents, opt);
+      ImagePyramid right_pyramid(right_image_file, right_mask_file, pyramid_dir,
+                                 min_pyramid_size, hash_contents, opt);
+      left_sub_image  = subsample_from_pyramid(left_pyramid,  sub_scale,
+                                               sub_tile_size_vec, sub_threads);
+      right_sub_image = subsample_from_pyramid(right_pyramid, sub_scale,
+                                               sub_tile_size_vec, sub_threads);
+    } else if ( sub_scale > 0.5 ) {
       // When we are near the pixel input to output ratio, standard
       // interpolation gives the best possible results.
       left_sub_image  = block_rasterize(resample(copy_mask(left_image,  create_mask(left_mask)),  sub_scale), 
@@ -420,7 +632,9 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                                  Vector2i(256,256) * sub_scale),
          sub_tile_size_vec, sub_threads);
     }
+  } // End computing the subsampled images
 
+  if (rebuild) {
     // Enforce no predictor in compression, it works badly with sub-images
     vw::cartography::GdalWriteOptions opt_nopred = opt;
     opt_nopred.gdal_options["PREDICTOR"] = "1";
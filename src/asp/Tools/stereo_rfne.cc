@@ -394,7 +394,10 @@ int main(int argc, char* argv[]) {
 
     // Internal Processes
     //---------------------------------------------------------
-    stereo_refinement( opt );
+    if (stereo_settings().tile_worker)
+      asp::run_tile_worker(opt, stereo_refinement);
+    else
+      stereo_refinement( opt );
 
     vw_out() << "\n[ " << current_posix_time_string()
              << " ] : REFINEMENT FINISHED \n";
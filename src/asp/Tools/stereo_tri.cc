@@ -26,6 +26,7 @@
 #include <vw/InterestPoint/InterestData.h>
 
 #include <asp/Camera/RPCModel.h>
+#include <asp/Core/ColumnarPointCloud.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Tools/jitter_adjust.h>
 #include <asp/Tools/ccd_adjust.h>
@@ -207,21 +208,15 @@ stereo_error_triangulate( vector<DisparityT> const& disparities,
   return result_type( disparities, transforms, model, is_map_projected );
 }
 
-/// Bin the disparities, and from each bin get a disparity value.
+/// Bin the disparity, and from each bin get a disparity value.
 /// This will create a correspondence from the left to right image,
-/// which we save in the match format
+/// which we save in the match format. The transforms compensate
+/// for alignment.
 template <class DisparityT, class TXT>
-void compute_matches_from_disp(vector<DisparityT> const& disparities,
-                               vector<TXT>        const& transforms,
-                               std::string        const& match_file) {
-
-  VW_ASSERT( disparities.size() == 1 && transforms.size() == 2,
-               vw::ArgumentErr() << "Expecting two images and one disparity.\n" );
-  DisparityT const& disp = disparities[0]; // pull the disparity
-
-  // Transforms to compensate for alignment
-  TXT left_trans  = transforms[0];
-  TXT right_trans = transforms[1];
+void compute_matches_from_disp(DisparityT  const& disp,
+                               TXT                left_trans,
+                               TXT                right_trans,
+                               std::string const& match_file) {
 
   std::vector<vw::ip::InterestPoint> left_ip, right_ip;
 
@@ -309,9 +304,27 @@ namespace asp{
                         ASPGlobalOptions const& opt){
 
     vw_out() << "Writing point cloud: " << point_cloud_file << "\n";
+
     bool has_georef = true;
     cartography::GeoReference georef = opt.session->get_georef();
 
+    if (asp::is_columnar_point_cloud(point_cloud_file)) {
+      // ISIS does not support multi-threading
+      int num_threads = vw_settings().default_num_threads();
+      if ( (opt.session->name() == "isis") || (opt.session->name() == "isismapisis"))
+        num_threads = 1;
+      double rounding_error = 0.0;
+      if (norm_2(shift) > 0)
+        rounding_error = asp::get_rounding_error(shift,
+                                                 stereo_settings().point_cloud_rounding_error);
+      asp::write_columnar_point_cloud
+        ( point_cloud_file, shift, rounding_error, point_cloud,
+          opt.raster_tile_size[0], num_threads,
+          TerminalProgressCallback("asp", "\t--> Triangulating: "),
+          georef.get_wkt());
+      return;
+    }
+
     bool has_nodata = false;
     double nodata = -std::numeric_limits<float>::max(); // smallest float
 
@@ -512,15 +525,27 @@ void stereo_triangulation( string          const& output_prefix,
     if (stereo_settings().image_lines_per_piecewise_adjustment > 0 &&
         !stereo_settings().skip_computing_piecewise_adjustments){
 
-      std::string match_file = output_prefix + "-disp.match";
-      compute_matches_from_disp(disparity_maps, transforms, match_file);
+      // The left image is shared among all pairs, so each disparity
+      // gives matches between image 0 and image p + 1.
+      std::map< std::pair<int, int>, std::string> match_files;
+      for (int p = 0; p < (int)disparity_maps.size(); p++) {
+        std::ostringstream os;
+        os << output_prefix << "-disp";
+        if (disparity_maps.size() > 1)
+          os << "-" << p + 1;
+        os << ".match";
+        std::string match_file = os.str();
+        compute_matches_from_disp(disparity_maps[p], transforms[0], transforms[p + 1],
+                                  match_file);
+        match_files[std::pair<int, int>(0, p + 1)] = match_file;
+      }
 
       int num_threads = opt_vec[0].num_threads;
       if (opt_vec[0].session->name() == "isis" || opt_vec[0].session->name() == "isismapisis")
         num_threads = 1;
       asp::jitter_adjust(image_files, camera_files, cameras,
 			 output_prefix, opt_vec[0].session->name(),
-			 match_file,  num_threads);
+			 match_files,  num_threads);
       //asp::ccd_adjust(image_files, camera_files, cameras, output_prefix,
       //                match_file,  num_threads);
     }
@@ -593,6 +618,8 @@ void stereo_triangulation( string          const& output_prefix,
     // so force rasterization in that box only using crop().
     BBox2i cbox = stereo_settings().trans_crop_win;
     string point_cloud_file = output_prefix + "-PC.tif";
+    if (stereo_settings().point_cloud_format == "apc")
+      point_cloud_file = output_prefix + "-PC" + asp::columnar_point_cloud_extension();
     if (stereo_settings().compute_error_vector){
 
       if (num_cams > 2)